@@ -0,0 +1,133 @@
+// -*- comment-column: 50; fill-column: 110; c-basic-offset: 4; tab-width: 4; indent-tabs-mode: nil -*-
+
+#pragma once
+
+#include <cstdint>
+#include <cstring>
+
+// Where our SimConnect traffic goes. Every call goes through RECORD, which counts it here by its call site,
+// with what it sends, and the dispatch procedure counts every packet received by its SIMCONNECT_RECV_ID and
+// request ID. The counters are fixed-size arrays, and counting never allocates.
+//
+// The counters only grow. For rates, keep a copy from the last time and subtract it, see since(). The gauge
+// publishes totals() in its metrics (see Metrics.h).
+
+class Accounting {
+public:
+    // Call sites beyond this many, and packets with an ID or request ID beyond these, are counted in the
+    // last slot
+    static constexpr int MaxSites = 64;
+    static constexpr int MaxReceiveIds = 32;
+    static constexpr int MaxRequests = 8;
+
+    struct Site {
+        int line;                                 // Zero if unused
+        const char *call;                         // The text of the call, a string literal
+        int apiLength;                            // Of the name of the API at the start of call
+        uint64_t calls, failures;
+        uint64_t bytes;                           // Sent along, for SetDataOnSimObject and the like
+    };
+
+    struct Received {
+        uint64_t packets, bytes;
+    };
+
+    // Over all call sites and packets
+    struct Totals {
+        uint64_t calls, failures, bytesSent;
+        uint64_t packets, bytesReceived;
+        uint64_t otherRequests;                   // Packets counted in the last request slot
+    };
+
+    Accounting() : sites_(), received_() {
+    }
+
+    void sent(int line, const char *call, bool succeeded, uint32_t bytes) {
+        Site &site = find(line, call);
+        site.calls++;
+        site.failures += !succeeded;
+        site.bytes += bytes;
+    }
+
+    // The request is that of SIMOBJECT_DATA and CLIENT_DATA packets counted from the first of the caller's,
+    // and zero for others. Map requests that are not the caller's to MaxRequests - 1.
+    void received(uint32_t id, uint32_t request, uint32_t bytes) {
+        Received &slot = received_[id < MaxReceiveIds ? id : MaxReceiveIds - 1]
+                                  [request < MaxRequests ? request : MaxRequests - 1];
+        slot.packets++;
+        slot.bytes += bytes;
+    }
+
+    const Site &site(int index) const {
+        return sites_[index];
+    }
+
+    const Received &received(int id, int request) const {
+        return received_[id][request];
+    }
+
+    Totals totals() const {
+        Totals result = {};
+        for (int i = 0; i < MaxSites; i++) {
+            result.calls += sites_[i].calls;
+            result.failures += sites_[i].failures;
+            result.bytesSent += sites_[i].bytes;
+        }
+        for (int id = 0; id < MaxReceiveIds; id++) {
+            for (int request = 0; request < MaxRequests; request++) {
+                result.packets += received_[id][request].packets;
+                result.bytesReceived += received_[id][request].bytes;
+            }
+            result.otherRequests += received_[id][MaxRequests - 1].packets;
+        }
+        return result;
+    }
+
+    // The counts since earlier, a copy of this taken then
+    Accounting since(const Accounting &earlier) const {
+        Accounting result = *this;
+        for (int i = 0; i < MaxSites; i++) {
+            result.sites_[i].calls -= earlier.sites_[i].calls;
+            result.sites_[i].failures -= earlier.sites_[i].failures;
+            result.sites_[i].bytes -= earlier.sites_[i].bytes;
+        }
+        for (int id = 0; id < MaxReceiveIds; id++) {
+            for (int request = 0; request < MaxRequests; request++) {
+                result.received_[id][request].packets -= earlier.received_[id][request].packets;
+                result.received_[id][request].bytes -= earlier.received_[id][request].bytes;
+            }
+        }
+        return result;
+    }
+
+    // Whether two sites call the same API
+    static bool sameApi(const Site &a, const Site &b) {
+        return a.apiLength == b.apiLength && std::strncmp(a.call, b.call, a.apiLength) == 0;
+    }
+
+private:
+    Site sites_[MaxSites];
+    Received received_[MaxReceiveIds][MaxRequests];
+
+    // Open addressing on the line number. The slot of a site never changes, so since() can match them up.
+    Site &find(int line, const char *call) {
+        for (int probe = 0; probe < MaxSites - 1; probe++) {
+            Site &site = sites_[(line + probe) % (MaxSites - 1)];
+            if (site.line == line)
+                return site;
+            if (site.line == 0) {
+                site.line = line;
+                site.call = call;
+                site.apiLength = int(std::strcspn(call, "("));
+                return site;
+            }
+        }
+        Site &overflow = sites_[MaxSites - 1];
+        if (overflow.line == 0) {
+            overflow.line = -1;
+            overflow.call = "other";
+            overflow.apiLength = 5;
+        }
+        return overflow;
+    }
+};
@@ -0,0 +1,114 @@
+// -*- comment-column: 50; fill-column: 110; c-basic-offset: 4; tab-width: 4; indent-tabs-mode: nil -*-
+
+#pragma once
+
+#include <chrono>
+#include <cstdint>
+
+// Commands from an external SimConnect client (a test driver, an autopilot prototype, a scripted demo) that
+// writes the client data area named THISAIRCRAFT ".Command". The layout of the record is the contract with
+// those clients, so only append to it. Use only 64-bit types, like in the other SimConnect structs.
+//
+// A writer increments sequence for each new command, and writes the same value in sequenceCheck after the
+// payload. If a record is received where the two differ, the writer was in the middle of an update, so the
+// record is dropped and the one before it stays in force.
+
+enum CommandMode : int64_t {
+    CommandModeNone = 0,
+    CommandModeAxes = 1 << 0,                     // rudder, aileron, elevator and throttle replace the pilot's
+    CommandModeVelocity = 1 << 1,                 // velBodyZ and velBodyX, in feet/second
+    CommandModeYawRate = 1 << 2,                  // yawRate, in radians/second
+    CommandModeVerticalSpeed = 1 << 3,            // verticalSpeed, in feet/second
+};
+
+enum CommandPriority : int64_t {
+    // The pilot wins on each axis that is moved out of its centre (or for the throttle, out of its dead
+    // zone). The command is used for the others.
+    CommandPriorityPilot = 0,
+
+    // The command wins on everything it sets, whatever the pilot does.
+    CommandPriorityCommand = 1,
+};
+
+struct CommandRecord {
+    int64_t sequence;
+    int64_t mode;                                 // A bitmask of CommandMode
+    int64_t priority;                             // A CommandPriority
+    int64_t validMilliseconds;                    // How long the command stays in force, zero means the default
+
+    double velBodyZ, velBodyX;
+    double yawRate;
+    double verticalSpeed;
+
+    double rudder, aileron, elevator, throttle;
+
+    int64_t sequenceCheck;
+};
+
+// A single-slot mailbox between the dispatch procedure, which posts each received record, and handleState(),
+// which reads the latest one once per frame. The sim calls both on the same thread, one after the other, so a
+// plain copy is all it takes. A torn record is dropped when it is posted, so the last good command stays in
+// force until it expires.
+
+class CommandMailbox {
+public:
+    typedef std::chrono::steady_clock Clock;
+
+    // Used when the writer leaves validMilliseconds zero
+    static constexpr int64_t DefaultValidMilliseconds = 500;
+
+private:
+    CommandRecord record;
+    Clock::time_point received;
+
+    uint64_t posted_;
+    uint64_t torn_;
+    uint64_t gaps_;
+
+public:
+    CommandMailbox()
+        : record(),
+          received(),
+          posted_(0),
+          torn_(0),
+          gaps_(0)
+    {
+    }
+
+    void post(const CommandRecord &incoming, Clock::time_point now) {
+        if (incoming.sequence != incoming.sequenceCheck) {
+            torn_++;
+            return;
+        }
+        if (posted_ > 0 && incoming.sequence != record.sequence + 1)
+            gaps_++;
+
+        record = incoming;
+        received = now;
+        posted_++;
+    }
+
+    // Copy the last good record into result. Returns false if none was posted yet, in which case result is
+    // untouched.
+    bool read(CommandRecord &result, Clock::time_point &receivedAt) const {
+        if (posted_ == 0)
+            return false;
+
+        result = record;
+        receivedAt = received;
+        return true;
+    }
+
+    // Number of records accepted, dropped as torn, and accepted after a gap in the sequence numbers
+    uint64_t posted() const {
+        return posted_;
+    }
+
+    uint64_t torn() const {
+        return torn_;
+    }
+
+    uint64_t gaps() const {
+        return gaps_;
+    }
+};
@@ -0,0 +1,90 @@
+// -*- comment-column: 50; fill-column: 110; c-basic-offset: 4; tab-width: 4; indent-tabs-mode: nil -*-
+
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <cmath>
+
+// The contact points from the [CONTACT_POINTS] section of flight_model.cfg, kept as a structure of arrays so
+// that the per-frame transform is a straight loop over contiguous doubles that the compiler can vectorize.
+//
+// The coordinates are as in flight_model.cfg: longitudinal (positive forward), lateral (positive right) and
+// vertical (positive up), in feet relative to the reference datum.
+
+class ContactPoints {
+public:
+    // The SDK allows more, but we have twelve. Keep the capacity a multiple of any plausible SIMD width.
+    static constexpr int Capacity = 16;
+
+private:
+    int number;
+
+    // Unused slots are copies of the first point so that the loop in lowest() can always run over all of
+    // them without affecting the result.
+    alignas(64) std::array<double, Capacity> longitudinal;
+    alignas(64) std::array<double, Capacity> lateral;
+    alignas(64) std::array<double, Capacity> vertical;
+
+public:
+    ContactPoints()
+        : number(0)
+    {
+        longitudinal.fill(0);
+        lateral.fill(0);
+        vertical.fill(0);
+    }
+
+    bool add(double longitudinal_, double lateral_, double vertical_) {
+        if (number == Capacity)
+            return false;
+
+        if (number == 0) {
+            longitudinal.fill(longitudinal_);
+            lateral.fill(lateral_);
+            vertical.fill(vertical_);
+        } else {
+            longitudinal[number] = longitudinal_;
+            lateral[number] = lateral_;
+            vertical[number] = vertical_;
+        }
+        number++;
+        return true;
+    }
+
+    int size() const {
+        return number;
+    }
+
+    // The vertical position (positive up) of the lowest contact point relative to the reference datum, at the
+    // given attitude. The arguments are as in the PLANE PITCH DEGREES and PLANE BANK DEGREES simvars, in
+    // radians: nose up and right wing down are negative. Heading does not affect vertical positions, so it is
+    // not needed. With no contact points this returns zero. Sources/Tools/MathCheck.cpp checks the signs.
+    double lowest(double pitch, double bank) const {
+        const double noseUp = -pitch;
+        const double rightWingDown = -bank;
+
+        // The world vertical component of a body vector is
+        //   longitudinal * sin(noseUp) + cos(noseUp) * (vertical * cos(rightWingDown) - lateral * sin(rightWingDown))
+        // so with three per-frame coefficients the per-point work is two multiply-adds.
+        const double cosNoseUp = std::cos(noseUp);
+        const double a = std::sin(noseUp);
+        const double b = cosNoseUp * std::cos(rightWingDown);
+        const double c = -cosNoseUp * std::sin(rightWingDown);
+
+        alignas(64) std::array<double, Capacity> up;
+        for (int i = 0; i < Capacity; i++)
+            up[i] = a * longitudinal[i] + b * vertical[i] + c * lateral[i];
+
+        double result = up[0];
+        for (int i = 1; i < Capacity; i++)
+            result = std::min(result, up[i]);
+
+        return result;
+    }
+
+    // The same at zero pitch and bank, which is how the aircraft sits on the ground.
+    double lowestLevel() const {
+        return *std::min_element(vertical.begin(), vertical.end());
+    }
+};
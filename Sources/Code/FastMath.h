@@ -0,0 +1,162 @@
+// -*- comment-column: 50; fill-column: 110; c-basic-offset: 4; tab-width: 4; indent-tabs-mode: nil -*-
+
+#pragma once
+
+#include <cmath>
+
+// The trigonometry of the control law, as polynomials. WebAssembly has instructions for sqrt and floor but
+// not for sin, cos or atan2, so in the gauge those are libm routines in software, with the care for huge
+// arguments and special cases that libm needs and that the controller does not: its angles are headings,
+// tracks and latitudes, all within a few turns of zero. Which to use is chosen at compile time, see
+// FLYINGBRICK_FASTMATH in FlyingBrick.cpp. LibMath has the same functions as calls to libm.
+//
+// The polynomials are near-minimax fits (Chebyshev, made with mpmath) on reduced ranges. The largest errors,
+// as measured by Sources/Tools/MathCheck.cpp against long double, and the bounds it checks them against:
+//
+//                                            FastMath  bound    libm
+//   sinCos   |x| <= 1e5                      1.7e-16   4.5e-16  5.6e-17
+//   atan2    finite y, x, signed zeros too   4.3e-16   1e-15    2.2e-16
+//   wrap     within a turn of [0, 2 pi)      the same as the loop of LibMath, except never 2 pi
+//
+// What the controller can tolerate is far more. It integrates velocities over 30 ms or so per frame, and a
+// heading or track off by 1e-9 radians puts the aircraft 1 mm off course after an hour at 300 ft/s. The
+// state the sim gets has the precision of the float epsilons anyway. So these are as exact as doubles can
+// reasonably be, and the speed comes from the simpler range reduction and from getting sin and cos in one
+// go. Beyond |x| = 1e5 sinCos falls back to libm rather than lose precision in the range reduction.
+
+class FastMath {
+public:
+    // Both at once, as the control law needs both of the same angle
+    static void sinCos(double x, double &sine, double &cosine) {
+        if (!(std::abs(x) <= MaxReduced)) {
+            sine = std::sin(x);
+            cosine = std::cos(x);
+            return;
+        }
+
+        // Cody-Waite: the first part of pi/2 has few enough bits that k times it is exact
+        const double k = std::floor(x * TwoOverPi + 0.5);
+        const double r = (x - k * PiOverTwo1) - k * PiOverTwo1Tail;
+        const double r2 = r * r;
+
+        const double s = r + r * r2 * (S1 + r2 * (S2 + r2 * (S3 + r2 * (S4 + r2 * (S5 + r2 * S6)))));
+        const double c = (1 - 0.5 * r2)
+            + r2 * r2 * (C1 + r2 * (C2 + r2 * (C3 + r2 * (C4 + r2 * (C5 + r2 * C6)))));
+
+        // The quadrant as selects rather than branches, which the angles of a turn would mispredict
+        const long long quadrant = static_cast<long long>(k);
+        const double a = (quadrant & 1) ? c : s, b = (quadrant & 1) ? s : c;
+        sine = (quadrant & 2) ? -a : a;
+        cosine = ((quadrant + 1) & 2) ? -b : b;
+    }
+
+    static double cos(double x) {
+        double sine, cosine;
+        sinCos(x, sine, cosine);
+        return cosine;
+    }
+
+    static double atan2(double y, double x) {
+        const double ax = std::abs(x), ay = std::abs(y);
+        const bool steep = ay > ax;
+        const double large = steep ? ay : ax, small = steep ? ax : ay;
+
+        // atan(small / large) is in [0, pi/4]. Above pi/8 it is pi/4 + atan((small - large) / (small +
+        // large)), so that the polynomial needs to cover only up to tan(pi/8), with one division either way.
+        // Selects rather than branches throughout, as the signs of velocities change all the time.
+        const bool far = small > large * TanPiOverEight;
+        const double numerator = far ? small - large : small, denominator = far ? small + large : large;
+        const double t = denominator > 0 ? numerator / denominator : 0;
+        const double t2 = t * t;
+        const double p = A6 + t2 * (A7 + t2 * (A8 + t2 * (A9 + t2 * (A10 + t2 * A11))));
+        double r = t + t * t2 * (A1 + t2 * (A2 + t2 * (A3 + t2 * (A4 + t2 * (A5 + t2 * p)))));
+        r += far ? Pi / 4 : 0;
+
+        r = steep ? Pi / 2 - r : r;
+        r = std::signbit(x) ? Pi - r : r;
+        return std::copysign(r, y);
+    }
+
+    // sqrt is an instruction. Unlike std::hypot, no care is taken for squares that overflow or underflow,
+    // which speeds in feet per second do not.
+    static double hypot(double x, double y) {
+        return std::sqrt(x * x + y * y);
+    }
+
+    // Into [0, 2 pi). Within a turn of it, as a heading after a frame's turn is, the same as the loop of
+    // LibMath, except that it never gives 2 pi.
+    static double wrap(double x) {
+        if (x < 0)
+            x += 2 * Pi;
+        else if (x >= 2 * Pi)
+            x -= 2 * Pi;
+        else
+            return x;
+        if (x < 0 || x >= 2 * Pi)
+            x -= 2 * Pi * std::floor(x * (1 / (2 * Pi)));
+        return x < 2 * Pi ? x : 0;
+    }
+
+private:
+    static constexpr double Pi = 3.14159265358979323846;
+    static constexpr double TwoOverPi = 6.36619772367581382433e-01;
+    static constexpr double PiOverTwo1 = 1.57079632673412561417e+00;          // The first 33 bits
+    static constexpr double PiOverTwo1Tail = 6.07710050650619224932e-11;      // pi/2 - PiOverTwo1
+    static constexpr double MaxReduced = 1e5;
+    static constexpr double TanPiOverEight = 0.41421356237309504880;
+
+    // sin(r) = r + r³ (S1 + S2 r² + ...), cos(r) = 1 - r²/2 + r⁴ (C1 + C2 r² + ...), |r| <= pi/4
+    static constexpr double S1 = -1.66666666666666646235e-1;
+    static constexpr double S2 = 8.33333333333094848555e-3;
+    static constexpr double S3 = -1.98412698367585743230e-4;
+    static constexpr double S4 = 2.75573161025524401188e-6;
+    static constexpr double S5 = -2.50511318450036244168e-8;
+    static constexpr double S6 = 1.59181292948666086668e-10;
+    static constexpr double C1 = 4.16666666666666653887e-2;
+    static constexpr double C2 = -1.38888888888873972367e-3;
+    static constexpr double C3 = 2.48015872987656879273e-5;
+    static constexpr double C4 = -2.75573172717297928820e-7;
+    static constexpr double C5 = 2.08761462684031978934e-9;
+    static constexpr double C6 = -1.13826324255217180054e-11;
+
+    // atan(t) = t + t³ (A1 + A2 t² + ...), |t| <= tan(pi/8)
+    static constexpr double A1 = -3.33333333333333301597e-1;
+    static constexpr double A2 = 1.99999999999955206778e-1;
+    static constexpr double A3 = -1.42857142846665429225e-1;
+    static constexpr double A4 = 1.11111110152563617275e-1;
+    static constexpr double A5 = -9.09090457812390189048e-2;
+    static constexpr double A6 = 7.69218319082608656369e-2;
+    static constexpr double A7 = -6.66451144738194800010e-2;
+    static constexpr double A8 = 5.85814891280220988165e-2;
+    static constexpr double A9 = -5.08544973794025986132e-2;
+    static constexpr double A10 = 3.92316582955871913028e-2;
+    static constexpr double A11 = -1.91768871190622589893e-2;
+};
+
+class LibMath {
+public:
+    static void sinCos(double x, double &sine, double &cosine) {
+        sine = std::sin(x);
+        cosine = std::cos(x);
+    }
+
+    static double cos(double x) {
+        return std::cos(x);
+    }
+
+    static double atan2(double y, double x) {
+        return std::atan2(y, x);
+    }
+
+    static double hypot(double x, double y) {
+        return std::sqrt(x * x + y * y);
+    }
+
+    static double wrap(double x) {
+        while (x >= 2 * M_PI)
+            x -= 2 * M_PI;
+        while (x < 0)
+            x += 2 * M_PI;
+        return x;
+    }
+};
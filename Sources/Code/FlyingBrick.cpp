@@ -1,14 +1,22 @@
 // -*- comment-column: 50; fill-column: 110; c-basic-offset: 4; tab-width: 4; indent-tabs-mode: nil -*-
 
+#include <algorithm>
 #include <array>
 #include <cassert>
 #include <chrono>
 #include <cmath>
+#include <cstddef>
+#include <cstdio>
+#include <cstring>
+#include <ctime>
 #include <iomanip>
 #include <iostream>
 #include <map>
 #include <sstream>
 #include <string>
+#include <type_traits>
+
+#include <sys/stat.h>
 
 #pragma GCC diagnostic push
 #pragma GCC diagnostic ignored "-Wignored-attributes"
@@ -20,30 +28,85 @@
 
 #include "minIni.h"
 
+#include "Accounting.h"
+#include "CommandChannel.h"
+#include "ContactPoints.h"
+#include "FastMath.h"
+#include "FrameBudget.h"
+#include "FrameClock.h"
+#include "Metrics.h"
+#include "Recorder.h"
+#include "ResponseCurve.h"
+#include "Scheduler.h"
+#include "Sequencer.h"
+#include "StateBus.h"
+#include "StateEstimator.h"
 #include "ThisAircraft.h"
+#include "Trace.h"
+#include "Variant.h"
 
 static HANDLE hSimConnect = 0;
 
 static double static_cg_height;
 
+// From the point.N entries in flight_model.cfg
+static ContactPoints contactPoints;
+
 static constexpr bool verbose = true;
 
-// As soon as an API call fails or we get an exception we are in an unknown state and it is not worth
-// to continue attempting to do anything.
+// When an API call fails or we get an exception we try to recover, see recover(). Only if that does not help,
+// or the problem is one that retrying can not fix, we give up and stop attempting to do anything.
 static bool failed = false;
 
 static bool simPaused = false;                    // Whether the "Paused" event with value 1 has been received
-static bool gotFirstState = false;
 static bool simFrozen = false;                    // Whether we are controlling the aircraft or not
-static bool landing = false;
-static bool takingOff = false;
 static bool ignitionSwitch = false;               // Whether the ignition switch was last seen on or off
 
+// How long to ignore state callbacks for after the gauge starts or a flight is loaded, to let the sim settle,
+// unless we can warm start from a snapshot, see restoreSnapshot(). A time and not a number of callbacks, as
+// how many come in depends on the epsilons of the subscription: parked, as few as one every few seconds.
+static constexpr int WarmUpMilliSeconds = 150;
+static FrameClock::time_point warmUpUntil;
+
+static void startWarmUp() {
+    warmUpUntil = FrameClock::now() + std::chrono::milliseconds(WarmUpMilliSeconds);
+}
+
+static bool warmingUp() {
+    return FrameClock::now() < warmUpUntil;
+}
+
+// The longest time the control law integrates over in one go, see handleState()
+static constexpr int MaxIntegrationMilliSeconds = 100;
+
+// Written by the dispatch procedure when an external client sets the command client data, read by
+// handleState()
+static CommandMailbox commandMailbox;
+
+// Housekeeping that does not need to be done on every frame, see initialize()
+static Scheduler scheduler;
+
+// How long each call into the gauge takes, and what is shed to keep it short
+static FrameBudget frameBudget;
+
+// Fuses the pose the sim echoes with the one we command, see fuseEcho()
+static StateEstimator estimator;
+
 // Use different numeric ranges for the enums to recognize the values if they show up in unexpected places
 
 enum DataDefinition : SIMCONNECT_DATA_DEFINITION_ID {
     DataDefinitionMutableState = 1000,
     DataDefinitionAllState,
+    DataDefinitionCommand,
+
+    // The groups of MutableState fields we set, see outputGroups
+    DataDefinitionAttitude,
+    DataDefinitionPosition,
+    DataDefinitionBodyVelocity,
+    DataDefinitionWorldVelocity,
+    DataDefinitionIndications,
+
+    DataDefinitionMetrics,
 };
 
 enum Event : SIMCONNECT_CLIENT_EVENT_ID {
@@ -51,14 +114,24 @@ enum Event : SIMCONNECT_CLIENT_EVENT_ID {
     EventFreezeAltSet,
     EventFreezeAttSet,
     EventFreezePosSet,
-    EventParkingBrakeToggle
+    EventParkingBrakeToggle,
+    EventWriteTrace,
+    EventFlightLoaded,
+    EventRecord,
 };
 
 enum Request : DWORD {
     RequestAllState = 3000,
+    RequestCommand,
+};
+
+enum ClientData : SIMCONNECT_CLIENT_DATA_ID {
+    ClientDataCommand = 4000,
+    ClientDataMetrics,
 };
 
 enum Group : SIMCONNECT_NOTIFICATION_GROUP_ID {
+    GroupCustom = 5000,
 };
 
 struct ReadonlyState {
@@ -93,6 +166,103 @@ struct AllState {
     MutableState state;
 };
 
+// The fields of each, in order, for going over them by index, in the order of readonlyData and mutableData.
+// MutableState is all doubles, so its fields can be members of a table of one type, and the output groups
+// are ranges of it; ReadonlyState has integers too, so its table is of offsets. Every field is eight bytes
+// and there are no gaps, which is also what the data definitions rely on.
+static constexpr double MutableState::*mutableFields[] = {
+    &MutableState::heading, &MutableState::bank, &MutableState::pitch,
+    &MutableState::lat, &MutableState::lon, &MutableState::msl,
+    &MutableState::velBodyX, &MutableState::velBodyY, &MutableState::velBodyZ,
+    &MutableState::velWorldX, &MutableState::velWorldY, &MutableState::velWorldZ,
+    &MutableState::kias, &MutableState::ktas, &MutableState::vs,
+};
+
+constexpr size_t MutableFields = sizeof(mutableFields) / sizeof(mutableFields[0]);
+
+static_assert(sizeof(MutableState) == MutableFields * sizeof(double) && std::is_standard_layout<MutableState>::value,
+              "MutableState is not just the doubles in mutableFields");
+
+static constexpr size_t readonlyOffsets[] = {
+    offsetof(ReadonlyState, rudder), offsetof(ReadonlyState, aileron), offsetof(ReadonlyState, elevator),
+    offsetof(ReadonlyState, throttle), offsetof(ReadonlyState, agl),
+    offsetof(ReadonlyState, velWindX), offsetof(ReadonlyState, velWindY), offsetof(ReadonlyState, velWindZ),
+    offsetof(ReadonlyState, onGround), offsetof(ReadonlyState, ignitionSwitch), offsetof(ReadonlyState, parkingBrake),
+    offsetof(ReadonlyState, altFreeze), offsetof(ReadonlyState, attFreeze), offsetof(ReadonlyState, posFreeze),
+    offsetof(ReadonlyState, pressure),
+};
+
+constexpr size_t ReadonlyFields = sizeof(readonlyOffsets) / sizeof(readonlyOffsets[0]);
+
+static constexpr bool packedFields(const size_t *offsets, size_t count, size_t size) {
+    for (size_t i = 0; i < count; i++) {
+        if (offsets[i] != i * 8)
+            return false;
+    }
+    return size == count * 8;
+}
+
+static_assert(packedFields(readonlyOffsets, ReadonlyFields, sizeof(ReadonlyState)),
+              "ReadonlyState is not the eight-byte fields in readonlyOffsets");
+
+// What we are doing, for how much each field of AllState may change before the sim sends it again, see
+// adaptSubscription()
+enum FlightPhase {
+    PhaseParked,                                  // Not in control, the sim has the aircraft
+    PhaseHovering,                                // In control and not moving
+    PhaseCruising,                                // In control and moving
+    PhaseCount,
+};
+
+// How the controller is scheduled. With FLYINGBRICK_TICK defined as 0 it runs in the dispatch procedure for
+// each state callback, so it runs only as often as callbacks arrive. We ask for the state with
+// SIMCONNECT_DATA_REQUEST_FLAG_CHANGED, so while nothing changes none arrive and the aircraft stops being
+// moved. Defined as 1, a state callback only keeps a copy of the state, see latestState, and the controller
+// runs with the latest copy on each PANEL_SERVICE_PRE_UPDATE, so it integrates and sets the state on every
+// frame however often the state arrives.
+#ifndef FLYINGBRICK_TICK
+#define FLYINGBRICK_TICK 0
+#endif
+
+// The trigonometry of the control law in handleState(). With FLYINGBRICK_FASTMATH defined as 1 it is the
+// polynomials of FastMath.h, otherwise libm. Sources/Tools/MathCheck.cpp has their errors and speed.
+#ifndef FLYINGBRICK_FASTMATH
+#define FLYINGBRICK_FASTMATH 0
+#endif
+
+#if FLYINGBRICK_FASTMATH
+typedef FastMath ControlMath;
+#else
+typedef LibMath ControlMath;
+#endif
+
+// How the response curves get into the control path, see ControlPath. With FLYINGBRICK_RUNTIME_PARAMETERS
+// defined as 0 the gauge of each variant has a control path of its own with the variant's curves as
+// constants, and only an aircraft.cfg that overrides them gets the path with tables built at run time.
+// Defined as 1, every gauge uses that one path, which leaves out the tables and the control inputs of each
+// variant. Sources/Tools/Variants.cpp and Worst.cpp show what either costs per frame.
+#ifndef FLYINGBRICK_RUNTIME_PARAMETERS
+#define FLYINGBRICK_RUNTIME_PARAMETERS 0
+#endif
+
+// The latest state callback, for FLYINGBRICK_TICK
+static struct {
+    AllState input;
+    bool valid;                                   // Since the connection was opened or a flight loaded
+    bool fresh;                                   // Not run by the controller yet
+} latestState;
+
+// How evenly the controller runs, to compare the two ways of scheduling it. Intervals longer than a stall
+// are counted as stalls and not included in the interval statistics.
+static struct Cadence {
+    static constexpr double StallMilliSeconds = 200;
+
+    FrameClock::time_point last;
+    uint64_t runs, fresh;                         // Runs, and those with a state not run before
+    uint64_t intervals, stalls;
+    double sum, sumOfSquares, max;                // Milliseconds between runs
+} cadence;
+
 // Helper functions, don't warn if not used
 #pragma GCC diagnostic push
 #pragma GCC diagnostic ignored "-Wunused-function"
@@ -242,6 +412,33 @@ static std::string data_request_flags(int flags) {
     return result;
 }
 
+static std::string recv_id(int id) {
+    switch (id) {
+    case SIMCONNECT_RECV_ID_NULL:
+        return "NULL";
+    case SIMCONNECT_RECV_ID_EXCEPTION:
+        return "EXCEPTION";
+    case SIMCONNECT_RECV_ID_OPEN:
+        return "OPEN";
+    case SIMCONNECT_RECV_ID_QUIT:
+        return "QUIT";
+    case SIMCONNECT_RECV_ID_EVENT:
+        return "EVENT";
+    case SIMCONNECT_RECV_ID_EVENT_FILENAME:
+        return "EVENT_FILENAME";
+    case SIMCONNECT_RECV_ID_EVENT_FRAME:
+        return "EVENT_FRAME";
+    case SIMCONNECT_RECV_ID_SIMOBJECT_DATA:
+        return "SIMOBJECT_DATA";
+    case SIMCONNECT_RECV_ID_SYSTEM_STATE:
+        return "SYSTEM_STATE";
+    case SIMCONNECT_RECV_ID_CLIENT_DATA:
+        return "CLIENT_DATA";
+    default:
+        return "RECV_ID " + std::to_string(id);
+    }
+}
+
 static std::string panel_service(int type) {
     switch (type) {
     case PANEL_SERVICE_PRE_QUERY:
@@ -336,14 +533,27 @@ private:
     // How many times we have stored new values into this struct
     int rounds_;
 
-    // The history of state received from the sim
-    std::array<AllState, HistoryLength> input;
+    // How many callbacks were discarded without storing anything
+    int discarded_;
 
-    // Timestamps of the inputs
-    std::array<std::chrono::time_point<std::chrono::steady_clock>, HistoryLength> time;
+    // The history of state received from the sim, with the timestamp of each. Each slot starts on a cache
+    // line of its own.
+    struct alignas(64) Slot {
+        AllState input;
+        FrameClock::time_point time;
+    };
+    std::array<Slot, HistoryLength> slots;
 
-    // The history of state set into the sim
-    std::array<MutableState, HistoryLength> output_;
+    // Time since the previous callback that was either stored or discarded after the point where we would
+    // have stored it, and when that was
+    FrameClock::duration sinceLast;
+    FrameClock::time_point lastTime;
+
+    // The state we set into the sim. It is carried over from frame to frame and updated in place.
+    MutableState output_;
+
+    // Height of the lowest contact point above ground for the latest input, see groundClearance()
+    double clearance;
 
 public:
     AllStateHistory()
@@ -351,7 +561,12 @@ public:
           current(0),
           previous(0),
           callbacks_(0),
-          rounds_(0)
+          rounds_(0),
+          discarded_(0),
+          sinceLast(),
+          lastTime(),
+          output_(),
+          clearance(0)
     {
     }
 
@@ -359,7 +574,21 @@ public:
         return ++callbacks_;
     }
 
+    // Note a callback that is discarded after checking its contents in place
+    void discard() {
+        discarded_++;
+    }
+
+    // The same, but for a callback that would have been stored if it had not been of no interest. Its time
+    // is noted, so that the time difference for the next stored one is to it and not to the one before.
+    void skip() {
+        discarded_++;
+        lastTime = FrameClock::now();
+    }
+
     void bump(const AllState &receivedInput) {
+        TRACE_SCOPE("bump");
+
         rounds_++;
 
         if (number < HistoryLength)
@@ -367,9 +596,21 @@ public:
 
         previous = current;
         current = (current + 1) % HistoryLength;
-        input[current] = receivedInput;
-        output_[current] = output_[previous];
-        time[current] = std::chrono::steady_clock::now();
+
+        Slot &slot = slots[current];
+        slot.input = receivedInput;
+        slot.time = FrameClock::now();
+
+        sinceLast = slot.time - lastTime;
+        lastTime = slot.time;
+
+        // The AGL is that of the reference datum. How high the lowest contact point is depends on the
+        // attitude. Compare that to how high it is when the aircraft is resting level on the ground, which is
+        // what static_cg_height says, so that a level aircraft gets the same value as plain AGL minus
+        // static_cg_height.
+        clearance = (receivedInput.readonly.agl
+                     + contactPoints.lowest(receivedInput.state.pitch, receivedInput.state.bank)
+                     - (static_cg_height + contactPoints.lowestLevel()));
     }
 
     int callbacks() const {
@@ -380,20 +621,43 @@ public:
         return rounds_;
     }
 
+    int discarded() const {
+        return discarded_;
+    }
+
     const ReadonlyState& readonly() const {
-        return input[current].readonly;
+        return slots[current].input.readonly;
     }
 
     const MutableState& state() const {
-        return input[current].state;
+        return slots[current].input.state;
     }
 
     MutableState& output() {
-        return output_[current];
+        return output_;
+    }
+
+    const MutableState& output() const {
+        return output_;
+    }
+
+    // How many feet higher the lowest contact point is than when resting on the ground
+    double groundClearance() const {
+        return clearance;
+    }
+
+    FrameClock::time_point timestamp() const {
+        return slots[current].time;
     }
 
     int milliSecondsSinceLast() const {
-        return std::chrono::duration_cast<std::chrono::milliseconds>(time[current] - time[previous]).count();
+        return std::chrono::duration_cast<std::chrono::milliseconds>(sinceLast).count();
+    }
+
+    // Use this as the time since the previous frame for the latest one, when there was no previous frame that
+    // means anything, like when restoring a snapshot
+    void assumeSinceLast(FrameClock::duration duration) {
+        sinceLast = duration;
     }
 
     void setMotionless() {
@@ -401,7 +665,7 @@ public:
 
         std::cout << THISAIRCRAFT << ": setMotionless()" << std::flush;
 
-        output() = input[current].state;
+        output() = state();
 
         // Keep heading as is
 
@@ -424,42 +688,79 @@ public:
             std::cout << std::flush;
         }
     }
+};
 
-    bool aboveGround() {
-        // Use hysteresis to avoid toggling freeze back and forth. When we are controlling the aircraft
-        // (simFrozen true), we decide that we are landing when the AGL below above static_cg_height + 1.
-        // When we are not controlling the aircraft (letting it land "softly" by itself, we require AGL to be one
-        // foot higher to decide we are not landing any more.
-
-        assert(!(landing && takingOff));
+// The parts of our SimConnect setup that can be re-created independently of each other after an exception
+enum Subsystem {
+    SubsystemConnection,                          // Opening, system event subscriptions, the dispatch procedure
+    SubsystemEvents,                              // Client events mapped to sim events
+    SubsystemAllState,
+    SubsystemMutableState,
+    SubsystemCommand,
+    SubsystemMetrics,                             // The outbound client data area, see publishMetrics()
+    SubsystemCount
+};
 
-        if (simFrozen && !landing && !takingOff)
-            return readonly().agl > static_cg_height + 1;
-        else if (takingOff)
-            return true;
-        else
-            return (!readonly().onGround && readonly().agl > static_cg_height + 2);
+static const char *subsystem_name(Subsystem subsystem) {
+    switch (subsystem) {
+    case SubsystemConnection:
+        return "connection";
+    case SubsystemEvents:
+        return "events";
+    case SubsystemAllState:
+        return "AllState";
+    case SubsystemMutableState:
+        return "MutableState";
+    case SubsystemCommand:
+        return "command";
+    case SubsystemMetrics:
+        return "metrics";
+    default:
+        assert(false);
     }
+}
+
+enum RecoveryAction {
+    RecoveryIgnore,
+    RecoveryReset,                                // Re-create the subsystem that the failed call belongs to
+    RecoveryReopen,                               // Close and re-open the connection and set up everything
+    RecoveryGiveUp
+};
+
+static void recover(RecoveryAction action, Subsystem subsystem);
+
+struct RecordedCall {
+    std::string call;
+    Subsystem subsystem;
 };
 
-static std::map<DWORD, std::string> calls;
+static std::map<DWORD, RecordedCall> calls;
+
+static Accounting accounting;
 
 static HRESULT recordCall(int lineNumber,
-                          std::string call,
-                          HRESULT value) {
+                          Subsystem subsystem,
+                          const char *call,
+                          HRESULT value,
+                          uint32_t bytes) {
+    accounting.sent(lineNumber, call, SUCCEEDED(value), bytes);
+
     if (!SUCCEEDED(value)) {
         // Output to std::cerr is unbuffered, and appears in the Console window each part on a separate line.
         // Not ideal. So collect output to std::cerr into one string and write it in one go.
         std::stringstream output;
         output << THISAIRCRAFT ": The call '" << call << "' failed at line " << lineNumber;
         std::cerr << output.str() << std::flush;
-        failed = true;
+
+        // A call failing right away, as opposed to an exception later, means the connection itself is in
+        // trouble.
+        recover(RecoveryReopen, subsystem);
         return value;
     }
 
     DWORD id;
     SimConnect_GetLastSentPacketID(hSimConnect, &id);
-    calls[id] = call;
+    calls[id] = RecordedCall{call, subsystem};
 
     static uint64_t counter = 0;
     if ((++counter % 100) == 0 && id > 100)
@@ -472,22 +773,263 @@ static HRESULT recordCall(int lineNumber,
     return value;
 }
 
-#define RECORD(expr) \
-    recordCall(__LINE__, #expr, expr);
+#define RECORD(subsystem, expr) \
+    recordCall(__LINE__, subsystem, #expr, expr, 0);
+
+// For calls that send data along, with its size
+#define RECORD_SENDING(subsystem, bytes, expr) \
+    recordCall(__LINE__, subsystem, #expr, expr, bytes);
+
+// The recovery state. Resets and re-opens are counted since the last time things were healthy for a while,
+// to escalate from resetting a subsystem to re-opening, and from re-opening to giving up.
+struct Recovery {
+    static constexpr int MaxResets = 3;
+    static constexpr int MaxReopens = 5;
+
+    // How many state callbacks without problems it takes to consider things healthy again
+    static constexpr int HealthyCallbacks = 100;
+
+    int resets;
+    int reopens;
+    int healthyCallbacks;
+    bool reopenPending;
+
+    // Gauge update frames since the first failure that we have not yet recovered from, or -1 if none
+    int framesSinceFailure;
+    std::chrono::steady_clock::time_point failedAt;
+
+    Recovery()
+        : resets(0),
+          reopens(0),
+          healthyCallbacks(0),
+          reopenPending(false),
+          framesSinceFailure(-1),
+          failedAt()
+    {
+    }
+};
+
+static Recovery recovery;
+
+// Logged with the other statistics, see logRecovery(), and published, see publishMetrics()
+struct RecoveryStatistics {
+    uint64_t exceptions;
+    uint64_t ignored;
+    uint64_t resets;
+    uint64_t reopens;
+    uint64_t recovered;                           // Times back in control after a failure
+    double lastReopenMilliSeconds;
+    double maxReopenMilliSeconds;
+    int maxFramesToControl;
+};
+
+static RecoveryStatistics recoveryStatistics;
+
+static void recoveryStarted() {
+    recovery.healthyCallbacks = 0;
+    if (recovery.framesSinceFailure < 0) {
+        recovery.framesSinceFailure = 0;
+        recovery.failedAt = std::chrono::steady_clock::now();
+    }
+}
+
+static void recoveryHealthyCallback() {
+    if (++recovery.healthyCallbacks >= Recovery::HealthyCallbacks)
+        recovery.resets = recovery.reopens = 0;
+}
+
+// Called when we have sent the aircraft state to the sim, which means we are in control
+static void recoveredControl() {
+    if (recovery.framesSinceFailure < 0)
+        return;
+
+    recoveryStatistics.recovered++;
+    recoveryStatistics.maxFramesToControl = std::max(recoveryStatistics.maxFramesToControl, recovery.framesSinceFailure);
+    if (verbose)
+        std::cout << THISAIRCRAFT ": In control again after " << recovery.framesSinceFailure << " frames, "
+                  << std::fixed << std::setprecision(1)
+                  << std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - recovery.failedAt).count()
+                  << "ms (max " << recoveryStatistics.maxFramesToControl << " frames)" << std::flush;
+    recovery.framesSinceFailure = -1;
+}
+
+// Time to first control: from when we see that we should control the aircraft, after the gauge starts, a
+// flight is loaded or the ignition is switched on, to when we first set its state
+struct ControlStart {
+    const char *reason;                           // Why we are not in control, for the log
+    bool waiting;
+    bool warm;
+    int frames;                                   // State callbacks since we started waiting
+    FrameClock::time_point since;
+};
+
+static ControlStart controlStart = { "gauge start", false, false, 0, {} };
+
+struct ControlStartStatistics {
+    uint64_t warm;
+    uint64_t cold;
+    int maxColdFrames;
+    int maxWarmFrames;
+};
+
+static ControlStartStatistics controlStartStatistics;
+
+static void wantControl() {
+    if (controlStart.waiting)
+        return;
+    controlStart.waiting = true;
+    controlStart.warm = false;
+    controlStart.frames = 0;
+    controlStart.since = FrameClock::now();
+}
+
+// Called when we have sent the aircraft state to the sim
+static void tookControl() {
+    if (!controlStart.waiting)
+        return;
+    controlStart.waiting = false;
+
+    int &maxFrames = controlStart.warm ? controlStartStatistics.maxWarmFrames : controlStartStatistics.maxColdFrames;
+    maxFrames = std::max(maxFrames, controlStart.frames);
+    (controlStart.warm ? controlStartStatistics.warm : controlStartStatistics.cold)++;
+    if (verbose)
+        std::cout << THISAIRCRAFT ": Took control " << controlStart.frames << " frames, " << std::fixed << std::setprecision(1)
+                  << std::chrono::duration<double, std::milli>(FrameClock::now() - controlStart.since).count()
+                  << "ms after " << controlStart.reason << ", " << (controlStart.warm ? "warm" : "cold")
+                  << " (warm " << controlStartStatistics.warm << " max " << controlStartStatistics.maxWarmFrames << " frames"
+                  << ", cold " << controlStartStatistics.cold << " max " << controlStartStatistics.maxColdFrames << " frames)"
+                  << std::flush;
+}
 
 constexpr auto HUNDREDTH = 0.01;
 
 constexpr auto EARTH_RADIUS_FT = m2ft(6371000);
 
-// Full throttle means 1000 fpm up, zero throttle means 1000 fpm down. Keep a large dead zone around 50%
-// throttle.
-static double throttle2vs(double throttle) {
-    if (throttle < 0.45)
-        return fpm2fps((throttle - 0.45) / 0.45 * 1000);
-    else if (throttle > 0.55)
-        return fpm2fps((throttle - 0.55) / 0.45 * 1000);
-    else
-        return 0;
+// What the control law works from: the pilot's axes converted to rates and velocities, possibly overridden by
+// an external command.
+struct ControlInputs {
+    double yawRate;                               // radians/second
+    double velBodyZ, velBodyX;                    // feet/second
+    double verticalSpeed;                         // feet/second
+};
+
+// The response curves of the variant flown, see Variant.h, are the defaults, which the [FLYING_BRICK_RESPONSE]
+// section of aircraft.cfg can override, see response_callback(). The control inputs come from the curves
+// through one of the specializations of controlInputs(): VariantControl<Variant>, with the variant's curves
+// constant-folded in, or, if aircraft.cfg overrides them, ConfiguredCurves, with tables built at run time.
+// Which one is only known once aircraft.cfg is read, so the gauge picks the control path of it then, see
+// ControlPath.
+struct ResponseCurves {
+    ResponseCurve rudder, aileron, elevator, throttle;
+};
+
+// Those of FlyingBrick until the configuration is loaded
+static ResponseCurves responseCurves = {
+    ResponseCurve(variantResponseCurves<FlyingBrickVariant>().rudder),
+    ResponseCurve(variantResponseCurves<FlyingBrickVariant>().aileron),
+    ResponseCurve(variantResponseCurves<FlyingBrickVariant>().elevator),
+    ResponseCurve(variantResponseCurves<FlyingBrickVariant>().throttle),
+};
+
+struct ConfiguredCurves {
+    static void axes2inputs(double rudder, double aileron, double elevator, double throttle,
+                            ControlInputs &inputs) {
+        inputs.yawRate = responseCurves.rudder(rudder);
+        inputs.velBodyX = responseCurves.aileron(aileron);
+        inputs.velBodyZ = responseCurves.elevator(elevator);
+        inputs.verticalSpeed = responseCurves.throttle(throttle);
+    }
+
+    static double verticalSpeed(double throttle) {
+        return responseCurves.throttle(throttle);
+    }
+};
+
+struct CommandStatistics {
+    int64_t lastSequence;
+    uint64_t applied;
+    uint64_t expired;
+    double latencySum;                            // milliseconds
+    double latencyMax;
+};
+
+static CommandStatistics commandStatistics = { -1, 0, 0, 0, 0 };
+
+// Merge the latest external command, if any and still in force, into what the pilot's axes say according to
+// its priority policy.
+template <typename Curves>
+static void applyCommand(const AllStateHistory &state, ControlInputs &inputs) {
+    CommandRecord command;
+    FrameClock::time_point received;
+    if (!commandMailbox.read(command, received))
+        return;
+
+    const double age = std::chrono::duration<double, std::milli>(state.timestamp() - received).count();
+    const int64_t valid = command.validMilliseconds > 0 ? command.validMilliseconds : CommandMailbox::DefaultValidMilliseconds;
+    const bool isNew = command.sequence != commandStatistics.lastSequence;
+
+    if (age > valid) {
+        if (isNew)
+            commandStatistics.expired++;
+        commandStatistics.lastSequence = command.sequence;
+        return;
+    }
+
+    if (isNew) {
+        commandStatistics.lastSequence = command.sequence;
+        commandStatistics.applied++;
+        commandStatistics.latencySum += age;
+        commandStatistics.latencyMax = std::max(commandStatistics.latencyMax, age);
+
+        if (verbose && (commandStatistics.applied % 100) == 0) {
+            std::cout << THISAIRCRAFT ": Commands applied " << commandStatistics.applied
+                      << " expired " << commandStatistics.expired
+                      << " torn " << commandMailbox.torn()
+                      << " gaps " << commandMailbox.gaps()
+                      << " latency avg " << std::fixed << std::setprecision(2) << commandStatistics.latencySum / commandStatistics.applied
+                      << "ms max " << commandStatistics.latencyMax << "ms" << std::flush;
+        }
+    }
+
+    const ReadonlyState &pilot = state.readonly();
+    const bool commandFirst = command.priority == CommandPriorityCommand;
+
+    // With the pilot having priority, an axis counts as in use by the pilot when outside its dead zone
+    const bool pilotYaws = !commandFirst && std::abs(pilot.rudder) > HUNDREDTH;
+    const bool pilotMovesZ = !commandFirst && std::abs(pilot.elevator) > HUNDREDTH;
+    const bool pilotMovesX = !commandFirst && std::abs(pilot.aileron) > HUNDREDTH;
+    const bool pilotClimbs = !commandFirst && Curves::verticalSpeed(pilot.throttle) != 0;
+
+    if (command.mode & CommandModeAxes) {
+        ControlInputs commanded;
+        Curves::axes2inputs(command.rudder, command.aileron, command.elevator, command.throttle, commanded);
+        if (!pilotYaws)
+            inputs.yawRate = commanded.yawRate;
+        if (!pilotMovesZ)
+            inputs.velBodyZ = commanded.velBodyZ;
+        if (!pilotMovesX)
+            inputs.velBodyX = commanded.velBodyX;
+        if (!pilotClimbs)
+            inputs.verticalSpeed = commanded.verticalSpeed;
+    }
+    if ((command.mode & CommandModeVelocity)) {
+        if (!pilotMovesZ)
+            inputs.velBodyZ = command.velBodyZ;
+        if (!pilotMovesX)
+            inputs.velBodyX = command.velBodyX;
+    }
+    if ((command.mode & CommandModeYawRate) && !pilotYaws)
+        inputs.yawRate = command.yawRate;
+    if ((command.mode & CommandModeVerticalSpeed) && !pilotClimbs)
+        inputs.verticalSpeed = command.verticalSpeed;
+}
+
+// What the control law works from, see ResponseCurves
+template <typename Curves>
+static void controlInputs(const AllStateHistory &state, ControlInputs &inputs) {
+    const ReadonlyState &pilot = state.readonly();
+    Curves::axes2inputs(pilot.rudder, pilot.aileron, pilot.elevator, pilot.throttle, inputs);
+    applyCommand<Curves>(state, inputs);
 }
 
 static bool doDisplay(const AllStateHistory &state) {
@@ -495,20 +1037,136 @@ static bool doDisplay(const AllStateHistory &state) {
     return state.readonly().agl < 10 || (state.rounds() % 500) < 5;
 }
 
+// What we set, in groups of neighbouring MutableState fields that each have a data definition of their own,
+// so that a frame sends only the groups that changed. A pure yaw sends only the attitude, and a hover
+// nothing but the occasional refresh.
+struct OutputGroup {
+    DataDefinition definition;
+    size_t first, count;                          // In mutableFields
+
+    size_t size() const {
+        return count * sizeof(double);
+    }
+};
+
+static constexpr OutputGroup outputGroups[] = {
+    { DataDefinitionAttitude, 0, 3 },             // heading, bank, pitch
+    { DataDefinitionPosition, 3, 3 },             // lat, lon, msl
+    { DataDefinitionBodyVelocity, 6, 3 },
+    { DataDefinitionWorldVelocity, 9, 3 },
+    { DataDefinitionIndications, 12, 3 },         // kias, ktas, vs
+};
+
+constexpr int OutputGroupCount = sizeof(outputGroups) / sizeof(outputGroups[0]);
+
+static constexpr bool groupsCoverMutableFields() {
+    size_t next = 0;
+    for (const OutputGroup &group: outputGroups) {
+        if (group.first != next)
+            return false;
+        next += group.count;
+    }
+    return next == MutableFields;
+}
+
+static_assert(groupsCoverMutableFields(), "outputGroups are not the fields of MutableState in order");
+
+// From this many changed groups on, send the whole MutableState instead
+constexpr int OutputGroupsInOneCall = 3;
+
+// How much each field has to differ from what was last sent for its group to be sent again. Small, so that
+// slow movement is not sent in visible steps.
+static constexpr MutableState outputEpsilons = {
+    1e-6, 1e-6, 1e-6,                             // Radians
+    1e-10, 1e-10, 0.001,                          // Radians, around 0.002ft, and feet
+    0.001, 0.001, 0.001,                          // Feet per second
+    0.001, 0.001, 0.001,
+    0.01, 0.01, 0.1,                              // Knots and feet per minute
+};
+
+struct SentOutput {
+    // Send all groups this often anyway, in case the sim has changed something we do not expect it to
+    static constexpr int RefreshCallbacks = 60;
+
+    MutableState sent;
+    bool valid;                                   // Whether the sim has what is in sent, as far as we know
+    int callback;                                 // state.callbacks() when last sent
+    int sinceRefresh;
+
+    uint64_t frames, calls, bytes;
+};
+
+static SentOutput sentOutput = {};
+
 static void setDirectControl(AllStateHistory &state) {
-    if (verbose && doDisplay(state)) {
+    TRACE_SCOPE("setDirectControl");
+
+    if (verbose && doDisplay(state) && frameBudget.allows(FrameWorkDiagnostics)) {
+        TRACE_SCOPE("log");
         std::cout << THISAIRCRAFT ": " << std::setw(5) << state.callbacks() << " Set state:";
         dumpMutableState(state.output());
         std::cout << std::flush;
     }
-    assert(sizeof(MutableState) == sizeof(state.output()));
-    RECORD(SimConnect_SetDataOnSimObject(hSimConnect, DataDefinitionMutableState,
-                                         SIMCONNECT_OBJECT_ID_USER, 0,
-                                         0, sizeof(MutableState), (void*)&state.output()));
+
+    // Everything if we have not been setting the state in every frame, as the sim may have moved the
+    // aircraft meanwhile, and now and then anyway
+    bool all = (!sentOutput.valid || state.callbacks() > sentOutput.callback + 1
+                || ++sentOutput.sinceRefresh >= SentOutput::RefreshCallbacks);
+
+    const MutableState &output = state.output();
+    bool dirty[OutputGroupCount];
+    int dirtyCount = 0;
+    for (int g = 0; g < OutputGroupCount; g++) {
+        const OutputGroup &group = outputGroups[g];
+        dirty[g] = false;
+        for (size_t i = group.first; !dirty[g] && i < group.first + group.count; i++) {
+            const double MutableState::*field = mutableFields[i];
+            dirty[g] = !(std::fabs(output.*field - sentOutput.sent.*field) <= outputEpsilons.*field);
+        }
+        dirtyCount += dirty[g];
+    }
+
+    // A call costs more than the bytes it saves, so from a few groups on send them all in one
+    all = all || dirtyCount >= OutputGroupsInOneCall;
+    if (all) {
+        sentOutput.sinceRefresh = 0;
+        RECORD_SENDING(SubsystemMutableState, sizeof(MutableState),
+               SimConnect_SetDataOnSimObject(hSimConnect, DataDefinitionMutableState,
+                                             SIMCONNECT_OBJECT_ID_USER, 0,
+                                             0, sizeof(MutableState), (void*)&state.output()));
+        sentOutput.sent = state.output();
+        sentOutput.calls++;
+        sentOutput.bytes += sizeof(MutableState);
+    } else {
+        for (int g = 0; g < OutputGroupCount; g++) {
+            if (!dirty[g])
+                continue;
+
+            // The fields of a group are next to each other, see mutableFields
+            const OutputGroup &group = outputGroups[g];
+            const double *data = &(output.*mutableFields[group.first]);
+            RECORD_SENDING(SubsystemMutableState, group.size(),
+                   SimConnect_SetDataOnSimObject(hSimConnect, group.definition,
+                                                 SIMCONNECT_OBJECT_ID_USER, 0,
+                                                 0, group.size(), (void*)data));
+            for (size_t i = group.first; i < group.first + group.count; i++)
+                sentOutput.sent.*mutableFields[i] = output.*mutableFields[i];
+            sentOutput.calls++;
+            sentOutput.bytes += group.size();
+        }
+    }
+
+    Recorder::add(RecordOutput, &state.output(), sizeof(MutableState));
+
+    sentOutput.valid = true;
+    sentOutput.callback = state.callbacks();
+    sentOutput.frames++;
+
+    recoveredControl();
+    tookControl();
 }
 
-static void setVerticalSpeed(double throttle, double timeSinceLast, MutableState &control) {
-    const double vs = throttle2vs(throttle);
+static void setVerticalSpeed(double vs, double timeSinceLast, MutableState &control) {
     if (vs != 0) {
         control.velBodyY = vs;
         control.velWorldY = control.velBodyY;
@@ -522,232 +1180,936 @@ static void setVerticalSpeed(double throttle, double timeSinceLast, MutableState
 }
 
 static void freezeSimulation(const ReadonlyState &state) {
+    TRACE_SCOPE("freezeSimulation");
+
     if (!state.altFreeze) {
         if (verbose)
             std::cout << THISAIRCRAFT ": Freezing ALT" << std::flush;
-        RECORD(SimConnect_TransmitClientEvent(hSimConnect, SIMCONNECT_OBJECT_ID_USER, EventFreezeAltSet, TRUE,
+        RECORD(SubsystemEvents,
+               SimConnect_TransmitClientEvent(hSimConnect, SIMCONNECT_OBJECT_ID_USER, EventFreezeAltSet, TRUE,
                                               SIMCONNECT_GROUP_PRIORITY_HIGHEST_MASKABLE, SIMCONNECT_EVENT_FLAG_GROUPID_IS_PRIORITY));
     }
     if (!state.attFreeze) {
         if (verbose)
             std::cout << THISAIRCRAFT ": Freezing ATT" << std::flush;
-        RECORD(SimConnect_TransmitClientEvent(hSimConnect, SIMCONNECT_OBJECT_ID_USER, EventFreezeAttSet, TRUE,
+        RECORD(SubsystemEvents,
+               SimConnect_TransmitClientEvent(hSimConnect, SIMCONNECT_OBJECT_ID_USER, EventFreezeAttSet, TRUE,
                                               SIMCONNECT_GROUP_PRIORITY_HIGHEST_MASKABLE, SIMCONNECT_EVENT_FLAG_GROUPID_IS_PRIORITY));
     }
     if (!state.posFreeze) {
         if (verbose)
             std::cout << THISAIRCRAFT ": Freezing POS" << std::flush;
-        RECORD(SimConnect_TransmitClientEvent(hSimConnect, SIMCONNECT_OBJECT_ID_USER, EventFreezePosSet, TRUE,
+        RECORD(SubsystemEvents,
+               SimConnect_TransmitClientEvent(hSimConnect, SIMCONNECT_OBJECT_ID_USER, EventFreezePosSet, TRUE,
                                               SIMCONNECT_GROUP_PRIORITY_HIGHEST_MASKABLE, SIMCONNECT_EVENT_FLAG_GROUPID_IS_PRIORITY));
     }
     simFrozen = true;
 }
 
 static void unfreezeSimulation(const ReadonlyState &state) {
+    TRACE_SCOPE("unfreezeSimulation");
+
     if (state.altFreeze) {
         if (verbose)
             std::cout << THISAIRCRAFT ": Unfreezing ALT" << std::flush;
-        RECORD(SimConnect_TransmitClientEvent(hSimConnect, SIMCONNECT_OBJECT_ID_USER, EventFreezeAltSet, FALSE,
+        RECORD(SubsystemEvents,
+               SimConnect_TransmitClientEvent(hSimConnect, SIMCONNECT_OBJECT_ID_USER, EventFreezeAltSet, FALSE,
                                               SIMCONNECT_GROUP_PRIORITY_HIGHEST_MASKABLE, SIMCONNECT_EVENT_FLAG_GROUPID_IS_PRIORITY));
     }
     if (state.attFreeze) {
         if (verbose)
             std::cout << THISAIRCRAFT ": Unfreezing ATT" << std::flush;
-        RECORD(SimConnect_TransmitClientEvent(hSimConnect, SIMCONNECT_OBJECT_ID_USER, EventFreezeAttSet, FALSE,
+        RECORD(SubsystemEvents,
+               SimConnect_TransmitClientEvent(hSimConnect, SIMCONNECT_OBJECT_ID_USER, EventFreezeAttSet, FALSE,
                                               SIMCONNECT_GROUP_PRIORITY_HIGHEST_MASKABLE, SIMCONNECT_EVENT_FLAG_GROUPID_IS_PRIORITY));
     }
 #if 0 // We never want to let the simulator move the aircraft as it seems to let the wind affect it wildly
     if (state.posFreeze) {
         if (verbose)
             std::cout << THISAIRCRAFT ": Unfreezing POS" << std::flush;
-        RECORD(SimConnect_TransmitClientEvent(hSimConnect, SIMCONNECT_OBJECT_ID_USER, EventFreezePosSet, FALSE,
+        RECORD(SubsystemEvents,
+               SimConnect_TransmitClientEvent(hSimConnect, SIMCONNECT_OBJECT_ID_USER, EventFreezePosSet, FALSE,
                                               SIMCONNECT_GROUP_PRIORITY_HIGHEST_MASKABLE, SIMCONNECT_EVENT_FLAG_GROUPID_IS_PRIORITY));
     }
 #endif
     simFrozen = false;
 }
 
-static void handleState(const AllState &input) {
-            
-    // If paused, do nothing
-    if (simPaused)
-        return;
+// Whether all the freezes we ask for read back as on
+static bool freezeAcknowledged(const ReadonlyState &state) {
+    return state.altFreeze && state.attFreeze && state.posFreeze;
+}
 
-    // Check if we are in a "zombie" state when the sim is in the main menu, at "Null Island" (0N 0E).
-    // In that case, do nothing.1
-    if (std::abs(input.state.lat) < 0.0001 && std::abs(input.state.lon) < 0.0001)
-        return;
+// What we do with the aircraft, from when the ignition is switched on until it is switched off, as resumable
+// sequences, see Sequencer.h. The sequence active, and where it is in it, is all there is to the phase of the
+// flight; each frame evaluates only what that sequence waits for. The sequences themselves, and how they
+// lead into each other, are after handleState(), which resumes them.
+enum Sequence {
+    SequenceTakeControl,                          // Freeze, once frozen set motionless, then fly
+    SequenceFly,                                  // Run the control law until within a foot of the ground
+    SequenceLand,                                 // Set motionless and let the sim have it on the ground
+    SequenceGround,                               // Wait for the throttle, or to be in the air again
+    SequenceTakeOff,                              // Freeze, once frozen climb until clear of the ground
+    SequenceAcquireFreeze,                        // Freeze and wait until the flags read back
+    SequenceCount
+};
 
-    // Another "zombie" state: Deep down under ground or up in the stratosphere.
-    if (input.readonly.agl < -100 || input.readonly.agl > 100000
-        || input.state.msl < -100 || input.state.msl > 100000)
-        return;
+struct FlightContext;
+typedef Sequencer<FlightContext> FlightSequencer;
 
-    // If ignition switch off, do nothing. When turning it off, let the simulator handle the aircraft
-    // falling down, typically. When turning it on, take control.
+static FlightSequencer::Action takeControl(FlightContext &context, FlightSequencer::Frame &frame);
+static FlightSequencer::Action fly(FlightContext &context, FlightSequencer::Frame &frame);
+static FlightSequencer::Action land(FlightContext &context, FlightSequencer::Frame &frame);
+static FlightSequencer::Action waitOnGround(FlightContext &context, FlightSequencer::Frame &frame);
+static FlightSequencer::Action takeOff(FlightContext &context, FlightSequencer::Frame &frame);
+static FlightSequencer::Action acquireFreeze(FlightContext &context, FlightSequencer::Frame &frame);
 
-    if (ignitionSwitch && !input.readonly.ignitionSwitch) {
-        ignitionSwitch = false;
-        unfreezeSimulation(input.readonly);
-        gotFirstState = false;
-        return;
-    }
+static const FlightSequencer::Body flightSequences[SequenceCount] = {
+    takeControl, fly, land, waitOnGround, takeOff, acquireFreeze,
+};
 
-    static AllStateHistory state;
+static const char *const flightSequenceNames[SequenceCount] = {
+    "take control", "fly", "land", "ground", "take off", "acquire freeze",
+};
 
-    // Ignore first couple of state callbacks
-    if (state.bumpCallbacks() < 5)
-        return;
+static FlightSequencer flight(flightSequences, SequenceCount);
 
-    state.bump(input);
+// A compact snapshot of the controller state, taken each frame we are in control. It is restored when we
+// take control again after a flight is loaded, the gauge is restarted, or the ignition is switched back on,
+// so that we can continue where we were instead of ignoring the first callbacks and stopping the aircraft
+// dead with setMotionless(). It is written to the work folder when the gauge is killed and read back when it
+// starts. A snapshot is only used if it is recent and the aircraft is where it says, see snapshotMatches().
 
-    MutableState& control = state.output();
+struct ControllerSnapshot {
+    static constexpr uint32_t Magic = 0x4b534246; // "FBSK"
+    static constexpr int TailLength = 4;
 
-    if (!ignitionSwitch && state.readonly().ignitionSwitch) {
-        ignitionSwitch = true;
-        freezeSimulation(state.readonly());
-        std::cout << THISAIRCRAFT << ": line " << __LINE__ << std::flush;
-        state.setMotionless();
-    } else if (!state.readonly().ignitionSwitch) {
-        return;
-    }
+    // How old and how far off a snapshot can be to still be used
+    static constexpr int64_t MaxAgeSeconds = 60;
+    static constexpr double MaxDistanceFeet = 100;
+    static constexpr double MaxAltitudeFeet = 20;
+    static constexpr double MaxHeadingDegrees = 5;
 
-    if (verbose && doDisplay(state)) {
-        std::cout << THISAIRCRAFT ": " << std::setw(5) << state.callbacks() << " Got RO state:";
-        dumpReadonlyState(state.readonly());
-        std::cout << std::flush;
-        std::cout << THISAIRCRAFT ": " << std::setw(5) << state.callbacks() << " Got state:";
-        dumpMutableState(state.state());
-        std::cout << std::flush;
-    }
+    static constexpr double MaxFrameMilliSeconds = 200;
 
-    // We want the parking brake to be always on when on ground
-    if (state.readonly().onGround && state.readonly().parkingBrake < 0.5) {
-        if (verbose)
-            std::cout << THISAIRCRAFT ": Setting parking brake" << std::flush;
-        RECORD(SimConnect_TransmitClientEvent(hSimConnect, SIMCONNECT_OBJECT_ID_USER, EventParkingBrakeToggle, TRUE,
-                                              SIMCONNECT_GROUP_PRIORITY_HIGHEST_MASKABLE, SIMCONNECT_EVENT_FLAG_GROUPID_IS_PRIORITY));
-    }
+    uint32_t magic;
+    uint32_t size;                                // sizeof(ControllerSnapshot), as a version check
+    int64_t savedAt;                              // std::time()
+    int64_t valid;                                // Whether we were in control
 
-    auto timeSinceLast = state.milliSecondsSinceLast();
+    int64_t sequence;                             // SequenceFly or SequenceTakeOff
+    int64_t onGround;
 
-    // Obviously we can turn and move only in the air
-    if (state.aboveGround()) {
+    MutableState output;                          // What we last set
 
-        if (state.readonly().agl > static_cg_height + 2)
-            takingOff = false;
+    // Milliseconds between the latest stored frames, the newest last
+    double frameIntervals[TailLength];
+};
 
-        // Make sure the simulator itself is not trying to move the aircraft.
-        freezeSimulation(state.readonly());
+static ControllerSnapshot snapshot;
 
-        if (!gotFirstState) {
-            std::cout << THISAIRCRAFT << ": line " << __LINE__ << std::flush;
-            state.setMotionless();
-            ignitionSwitch = state.readonly().ignitionSwitch;
-            gotFirstState = true;
-        } else {
-            // Arbitrary choice: Full rudder pedal deflection means 45 degrees per second yaw rate.
-            auto diff = state.readonly().rudder * timeSinceLast / 1000 * deg2rad(45);
-            control.heading += diff;
-            while (control.heading >= 2 * M_PI)
-                control.heading -= 2 * M_PI;
-            while (control.heading < 0)
-                control.heading += 2 * M_PI;
-
-            // Another arbitrary choice: Full elevator control deflection means 100 knots GS
-            // forward or 50 knots backward. Full aileron control deflection means 50 knots left or right.
-
-            // Stick pushed forward: negative elevator input, set speed forward.
-            // Stick pulled back: positive elevator input, set speed backward.
-            if (state.readonly().elevator < -HUNDREDTH)
-                control.velBodyZ = -state.readonly().elevator * kn2fps(100);
-            else if (state.readonly().elevator > HUNDREDTH)
-                control.velBodyZ = -state.readonly().elevator * kn2fps(50);
-            else
-                control.velBodyZ = 0;
+static const char *const snapshotFileName = WORK_FOLDER "snapshot.bin";
 
-            // Stick tilted sideways: aileron input, set speed sideways
-            if (std::abs(state.readonly().aileron) > HUNDREDTH)
-                control.velBodyX = state.readonly().aileron * kn2fps(50);
-            else
-                control.velBodyX = 0;
+static void captureSnapshot(const AllStateHistory &state) {
+    const int sequence = flight.sequence();
+    if (!simFrozen || !ignitionSwitch || (sequence != SequenceFly && sequence != SequenceTakeOff)) {
+        snapshot.valid = false;
+        return;
+    }
 
-            const double bodyRelativeAbsoluteVelocity = std::sqrt(control.velBodyZ * control.velBodyZ
-                                                                  + control.velBodyX * control.velBodyX);
+    snapshot.magic = ControllerSnapshot::Magic;
+    snapshot.size = sizeof(ControllerSnapshot);
+    snapshot.savedAt = std::time(nullptr);
+    snapshot.valid = true;
+    snapshot.sequence = sequence;
+    snapshot.onGround = state.readonly().onGround;
+    snapshot.output = state.output();
+    for (int i = 1; i < ControllerSnapshot::TailLength; i++)
+        snapshot.frameIntervals[i - 1] = snapshot.frameIntervals[i];
+    snapshot.frameIntervals[ControllerSnapshot::TailLength - 1] = state.milliSecondsSinceLast();
+}
 
-            const double bodyRelativeTrack = M_PI/2 - std::atan2(control.velBodyZ, control.velBodyX);
+static void writeSnapshot() {
+    std::FILE *file = std::fopen(snapshotFileName, "wb");
+    if (file == nullptr) {
+        std::cerr << THISAIRCRAFT ": Could not create " << snapshotFileName << std::flush;
+        return;
+    }
+    if (std::fwrite(&snapshot, sizeof(snapshot), 1, file) != 1)
+        std::cerr << THISAIRCRAFT ": Could not write " << snapshotFileName << std::flush;
+    std::fclose(file);
+}
 
-            const double worldRelativeTrack = control.heading + bodyRelativeTrack;
+static void readSnapshot() {
+    snapshot = ControllerSnapshot();
 
-            control.velWorldZ = std::cos(worldRelativeTrack) * bodyRelativeAbsoluteVelocity;
-            control.velWorldX = std::sin(worldRelativeTrack) * bodyRelativeAbsoluteVelocity;
+    std::FILE *file = std::fopen(snapshotFileName, "rb");
+    if (file == nullptr)
+        return;
 
-            // This is just a toy, so use a spherical Earth approximation and ignore the poles
-            // and the antimeridian.
-            control.lat += control.velWorldZ * timeSinceLast / 1000 / EARTH_RADIUS_FT;
-            control.lon += control.velWorldX * timeSinceLast / 1000 * std::cos(control.lat) / EARTH_RADIUS_FT;
+    ControllerSnapshot read;
+    if (std::fread(&read, sizeof(read), 1, file) == 1
+        && read.magic == ControllerSnapshot::Magic && read.size == sizeof(ControllerSnapshot))
+        snapshot = read;
+    std::fclose(file);
+}
 
-            // Assume this aircraft is used only at low altitudes and ignore wind
-            control.kias = fps2kn(bodyRelativeAbsoluteVelocity);
-            control.ktas = control.kias;
+// Whether the snapshot can be used for the situation in this state callback
+static bool snapshotMatches(const AllState &input) {
+    if (!snapshot.valid || (snapshot.sequence != SequenceFly && snapshot.sequence != SequenceTakeOff))
+        return false;
 
-            // Vertical speed and position handled in setVerticalSpeed().
-            setVerticalSpeed(state.readonly().throttle, timeSinceLast, control);
-        }
-        setDirectControl(state);
-    } else {
+    const int64_t age = std::time(nullptr) - snapshot.savedAt;
+    if (age < 0 || age > ControllerSnapshot::MaxAgeSeconds)
+        return false;
+
+    if (!input.readonly.ignitionSwitch || (input.readonly.onGround != 0) != (snapshot.onGround != 0))
+        return false;
 
-        assert(!state.aboveGround());
+    // Radians, so a spherical Earth approximation as in the control law is good enough for this
+    const MutableState &then = snapshot.output;
+    const double north = (input.state.lat - then.lat) * EARTH_RADIUS_FT;
+    const double east = (input.state.lon - then.lon) * std::cos(then.lat) * EARTH_RADIUS_FT;
+    if (std::sqrt(north * north + east * east) > ControllerSnapshot::MaxDistanceFeet
+        || std::abs(input.state.msl - then.msl) > ControllerSnapshot::MaxAltitudeFeet)
+        return false;
 
-        // Vertical velocity however can be changed while on the ground. We can lift off.
+    const double heading = std::remainder(input.state.heading - then.heading, 2 * M_PI);
+    return std::abs(heading) <= deg2rad(ControllerSnapshot::MaxHeadingDegrees);
+}
 
-        if (throttle2vs(state.readonly().throttle) > 0) {
-            landing = false;
-            takingOff = true;
-            setVerticalSpeed(state.readonly().throttle, timeSinceLast, control);
-            freezeSimulation(state.readonly());
-            setDirectControl(state);
-        } else if (gotFirstState) {
-            landing = true;
-            std::cout << THISAIRCRAFT << ": line " << __LINE__ << std::flush;
-            state.setMotionless();
-            setDirectControl(state);
-
-            // Let the simulator itself handle it on ground
-            unfreezeSimulation(state.readonly());
+// Instead of setMotionless(), when taking control: continue with the velocities in the snapshot from where
+// the sim says we are now, in the sequence it was in. Returns false, and does nothing, if the snapshot does not
+// fit.
+static bool restoreSnapshot(AllStateHistory &state, const AllState &input) {
+    if (!snapshotMatches(input))
+        return false;
 
-            gotFirstState = false;
+    const MutableState &then = snapshot.output;
+    MutableState &output = state.output();
+
+    output = state.state();
+    output.bank = output.pitch = 0;
+    output.velBodyX = then.velBodyX;
+    output.velBodyY = then.velBodyY;
+    output.velBodyZ = then.velBodyZ;
+    output.velWorldX = then.velWorldX;
+    output.velWorldY = then.velWorldY;
+    output.velWorldZ = then.velWorldZ;
+    output.kias = then.kias;
+    output.ktas = then.ktas;
+    output.vs = then.vs;
+
+    flight.start(int(snapshot.sequence));
+
+    // The first frame after taking control has no sensible time since the previous one, so use the typical
+    // interval from before, ignoring any that are not plausible frame times
+    double interval = 0;
+    int intervals = 0;
+    for (const double milliSeconds: snapshot.frameIntervals) {
+        if (milliSeconds > 0 && milliSeconds <= ControllerSnapshot::MaxFrameMilliSeconds) {
+            interval += milliSeconds;
+            intervals++;
         }
     }
+    if (intervals > 0)
+        interval /= intervals;
+    state.assumeSinceLast(std::chrono::duration_cast<FrameClock::duration>(
+                              std::chrono::duration<double, std::milli>(interval)));
+
+    // Once only, what we do from now on supersedes it
+    snapshot.valid = false;
+
+    if (verbose) {
+        std::cout << THISAIRCRAFT ": " << std::setw(5) << state.callbacks() << " Restored snapshot from "
+                  << std::time(nullptr) - snapshot.savedAt << "s ago:";
+        dumpMutableState(output);
+        std::cout << std::flush;
+    }
+    return true;
 }
 
-static void dispatchProc(SIMCONNECT_RECV *pData, DWORD cbData, void *pContext) {
-    if (failed)
-        return;
+// Whether a state callback is worth looking at further. This is checked in place in the SimConnect receive
+// buffer, before anything is copied.
+static bool interesting(const AllState &input) {
+    TRACE_SCOPE("zombie checks");
 
-    switch(pData->dwID) {
-    case SIMCONNECT_RECV_ID_EVENT: {
-        SIMCONNECT_RECV_EVENT *event = (SIMCONNECT_RECV_EVENT*)pData;
+    // If paused, do nothing
+    if (simPaused)
+        return false;
 
-        switch(event->uEventID) {
-        case EventPause:
-            simPaused = event->dwData;
-            if (verbose)
-                std::cout << THISAIRCRAFT ": PAUSE " << (simPaused ? "ON" : "OFF") << std::flush;
-            break;
-        default:
-            if (verbose)
-                std::cout << THISAIRCRAFT ": EVENT " << event->uEventID << " " << event->dwData << std::flush;
-            break;
-        }
-        break;
-    }
+    // Check if we are in a "zombie" state when the sim is in the main menu, at "Null Island" (0N 0E).
+    // In that case, do nothing.1
+    if (std::abs(input.state.lat) < 0.0001 && std::abs(input.state.lon) < 0.0001)
+        return false;
+
+    // Another "zombie" state: Deep down under ground or up in the stratosphere.
+    if (input.readonly.agl < -100 || input.readonly.agl > 100000
+        || input.state.msl < -100 || input.state.msl > 100000)
+        return false;
+
+    return true;
+}
+
+// Publish what we know in this frame for other gauges in the module, see StateBus.h. Output is what we set,
+// or null if we are not in control.
+static void publishState(const AllState &input, const MutableState *output) {
+    static uint64_t frame = 0;
+
+    const int sequence = flight.sequence();
+    StateBusSnapshot snapshot = {};
+    snapshot.frame = ++frame;
+    snapshot.time = FrameClock::nanoseconds(FrameClock::now());
+    snapshot.flags = (output != nullptr ? StateBusInControl : 0u)
+        | (input.readonly.onGround ? StateBusOnGround : 0u)
+        | (simFrozen ? StateBusFrozen : 0u)
+        | (simPaused ? StateBusPaused : 0u)
+        | (sequence == SequenceLand || sequence == SequenceGround ? StateBusLanding : 0u)
+        | (sequence == SequenceTakeOff ? StateBusTakingOff : 0u);
+
+    snapshot.heading = input.state.heading;
+    snapshot.bank = input.state.bank;
+    snapshot.pitch = input.state.pitch;
+    snapshot.lat = input.state.lat;
+    snapshot.lon = input.state.lon;
+    snapshot.msl = input.state.msl;
+    snapshot.agl = input.readonly.agl;
+    snapshot.kias = input.state.kias;
+    snapshot.ktas = input.state.ktas;
+    snapshot.vs = input.state.vs;
+    snapshot.rudder = input.readonly.rudder;
+    snapshot.aileron = input.readonly.aileron;
+    snapshot.elevator = input.readonly.elevator;
+    snapshot.throttle = input.readonly.throttle;
+
+    const MutableState &sent = output != nullptr ? *output : input.state;
+    snapshot.outputHeading = sent.heading;
+    snapshot.outputMsl = sent.msl;
+    snapshot.outputVs = sent.vs;
+
+    StateBus::publish(snapshot);
+}
+
+// Correct what we command for the sim having moved the aircraft by itself, see StateEstimator.h
+static void fuseEcho(const AllStateHistory &state, MutableState &control, int milliSeconds) {
+    const EstimatorPose echo = { state.state().lat, state.state().lon, state.state().msl, state.state().heading };
+    EstimatorPose commanded = { control.lat, control.lon, control.msl, control.heading };
+    const StateEstimator::Result result = estimator.fuse(commanded, echo, milliSeconds / 1000.0);
+    if (result != StateEstimator::EstimatorCorrected && result != StateEstimator::EstimatorSnapped)
+        return;
+
+    control.lat = commanded.lat;
+    control.lon = commanded.lon;
+    control.msl = commanded.msl;
+    control.heading = commanded.heading;
+    if (verbose && result == StateEstimator::EstimatorSnapped)
+        std::cout << THISAIRCRAFT ": " << std::setw(5) << state.callbacks() << " The sim moved the aircraft, continuing from there"
+                  << std::flush;
+}
+
+static void noteSent(const MutableState &control) {
+    estimator.sent({ control.lat, control.lon, control.msl, control.heading });
+}
+
+static void logEstimator() {
+    const StateEstimator::Statistics &statistics = estimator.statistics();
+    std::cout << THISAIRCRAFT ": Compared " << statistics.frames << " echoes, corrected " << statistics.corrected
+              << " snapped " << statistics.snapped << std::fixed << std::setprecision(2)
+              << ", largest residual " << statistics.maxResidual[StateEstimator::North] << "/"
+              << statistics.maxResidual[StateEstimator::East] << "/" << statistics.maxResidual[StateEstimator::Up]
+              << "ft " << rad2deg(statistics.maxResidual[StateEstimator::Heading]) << "deg"
+              << ", largest step " << statistics.maxStep[StateEstimator::North] << "/"
+              << statistics.maxStep[StateEstimator::East] << "/" << statistics.maxStep[StateEstimator::Up]
+              << "ft " << rad2deg(statistics.maxStep[StateEstimator::Heading]) << "deg" << std::flush;
+}
+
+static void logCadence() {
+    const double mean = cadence.sum / std::max<uint64_t>(1, cadence.intervals);
+    const double deviation = std::sqrt(std::max(0.0, cadence.sumOfSquares / std::max<uint64_t>(1, cadence.intervals)
+                                                - mean * mean));
+    std::cout << THISAIRCRAFT ": Controller " << (FLYINGBRICK_TICK ? "ticked" : "called back") << " " << cadence.runs
+              << " times, " << std::fixed << std::setprecision(1)
+              << 100.0 * cadence.fresh / std::max<uint64_t>(1, cadence.runs) << "% with a new state, every "
+              << std::setprecision(2) << mean << "ms (deviation " << deviation << "ms, max " << cadence.max
+              << "ms), stalled " << cadence.stalls << " times" << std::flush;
+}
+
+static void adaptSubscription(FlightPhase phase);
+static void observeTraffic(const AllState &input);
+static void logSubscription();
+
+// The latest state stored by handleState(), for the housekeeping tasks. Fresh until a task that must act on
+// each state only once has looked at it.
+static struct {
+    ReadonlyState readonly;
+    bool valid;
+    bool fresh;
+} housekeeping;
+
+// What the sequences work with in a frame
+struct FlightContext {
+    AllStateHistory &state;
+    const ControlInputs &inputs;
+    int timeSinceLast;                            // Milliseconds
+    bool fresh;
+};
+
+// The first half of handleState(): stores the state and takes or gives up control. Returns the stored state,
+// or null if there is nothing for the controller to do with it.
+static AllStateHistory *acceptState(const AllState &input) {
+    static AllStateHistory state;
+
+    if (!interesting(input)) {
+        state.discard();
+        return nullptr;
+    }
+
+    if (controlStart.waiting)
+        controlStart.frames++;
+    else if (!ignitionSwitch && input.readonly.ignitionSwitch && !input.readonly.onGround)
+        wantControl();
+
+    // If ignition switch off, do nothing. When turning it off, let the simulator handle the aircraft
+    // falling down, typically. When turning it on, take control.
+
+    if (ignitionSwitch && !input.readonly.ignitionSwitch) {
+        ignitionSwitch = false;
+        unfreezeSimulation(input.readonly);
+        housekeeping.valid = false;
+        flight.stop();
+        controlStart.reason = "ignition on";
+        state.discard();
+        return nullptr;
+    }
+
+    state.bumpCallbacks();
+
+    // Ignore the state callbacks while warming up, unless there is a snapshot to continue from
+    if (warmingUp()) {
+        if (snapshotMatches(input)) {
+            warmUpUntil = FrameClock::time_point();
+        } else {
+            state.discard();
+            return nullptr;
+        }
+    }
+
+    // Ignition off and not just turned on, so nothing to do either
+    if (!ignitionSwitch && !input.readonly.ignitionSwitch) {
+        state.skip();
+        if (frameBudget.allows(FrameWorkTelemetry))
+            publishState(input, nullptr);
+        adaptSubscription(PhaseParked);
+        return nullptr;
+    }
+
+    // Only now store it
+    state.bump(input);
+    housekeeping.readonly = state.readonly();
+    housekeeping.valid = housekeeping.fresh = true;
+
+    if (verbose && (state.rounds() % 1000) == 0 && frameBudget.allows(FrameWorkStatistics))
+        std::cout << THISAIRCRAFT ": Stored " << state.rounds() << " state callbacks, discarded " << state.discarded()
+                  << ", set the state in " << sentOutput.frames << " frames with " << std::fixed << std::setprecision(2)
+                  << double(sentOutput.calls) / std::max<uint64_t>(1, sentOutput.frames) << " calls and "
+                  << double(sentOutput.bytes) / std::max<uint64_t>(1, sentOutput.frames) << " bytes per frame"
+                  << std::flush;
+
+    if (!ignitionSwitch) {
+        assert(state.readonly().ignitionSwitch);
+        ignitionSwitch = true;
+        estimator.reset();
+        controlStart.warm = restoreSnapshot(state, input);
+        if (controlStart.warm)
+            freezeSimulation(state.readonly());
+        else
+            flight.start(SequenceTakeControl);
+    }
+
+    if (verbose && doDisplay(state) && frameBudget.allows(FrameWorkDiagnostics)) {
+        TRACE_SCOPE("log");
+        std::cout << THISAIRCRAFT ": " << std::setw(5) << state.callbacks() << " Got RO state:";
+        dumpReadonlyState(state.readonly());
+        std::cout << std::flush;
+        std::cout << THISAIRCRAFT ": " << std::setw(5) << state.callbacks() << " Got state:";
+        dumpMutableState(state.state());
+        std::cout << std::flush;
+    }
+
+    return &state;
+}
+
+// The second half of handleState(): runs the sequences with the control inputs, and sets and publishes what
+// they come up with
+static void controlState(AllStateHistory &state, const AllState &input, const ControlInputs &inputs,
+                         bool fresh) {
+    MutableState& control = state.output();
+
+    // Asking for the state only when it changes, callbacks can be seconds apart, as when parked. Moving by the
+    // whole gap when they start again would make the aircraft jump.
+    auto timeSinceLast = std::min(state.milliSecondsSinceLast(), MaxIntegrationMilliSeconds);
+
+    FlightContext context = { state, inputs, timeSinceLast, fresh };
+    flight.resume(context);
+
+    if (frameBudget.allows(FrameWorkTelemetry))
+        publishState(input, &control);
+    captureSnapshot(state);
+
+    // Not moving is when nothing we set would move the aircraft
+    const bool moving = (std::abs(control.velBodyX) > 0.1 || std::abs(control.velBodyY) > 0.1
+                         || std::abs(control.velBodyZ) > 0.1 || inputs.yawRate != 0);
+    adaptSubscription(!simFrozen ? PhaseParked : moving ? PhaseCruising : PhaseHovering);
+}
+
+// Fresh is whether the controller has not run with this state before, see runController(). Only the control
+// inputs depend on Control, see ControlPath.
+template <typename Control>
+static void handleState(const AllState &input, bool fresh) {
+    AllStateHistory *state = acceptState(input);
+    if (state == nullptr)
+        return;
+
+    ControlInputs inputs;
+    controlInputs<Control>(*state, inputs);
+    controlState(*state, input, inputs, fresh);
+}
+
+// Freezing takes a frame or more to show in the state. Ask again and go on anyway after this many.
+static constexpr int FreezeTimeoutFrames = 15;
+
+static uint64_t freezeTimeouts;
+
+static FlightSequencer::Action enter(const FlightContext &context, FlightSequencer::Frame &frame,
+                                     Sequence next) {
+    if (verbose)
+        std::cout << THISAIRCRAFT ": " << std::setw(5) << context.state.callbacks() << " "
+                  << flightSequenceNames[frame.sequence] << " -> " << flightSequenceNames[next] << " after "
+                  << frame.frames << " frames" << std::flush;
+    return frame.become(next);
+}
+
+static void runControlLaw(const FlightContext &context) {
+    TRACE_SCOPE("control law");
+
+    AllStateHistory &state = context.state;
+    const ControlInputs &inputs = context.inputs;
+    const int timeSinceLast = context.timeSinceLast;
+    MutableState &control = state.output();
+
+    // With FLYINGBRICK_TICK the same echo can come several times, compare it only once
+    if (context.fresh)
+        fuseEcho(state, control, timeSinceLast);
+
+    auto diff = inputs.yawRate * timeSinceLast / 1000;
+    control.heading = ControlMath::wrap(control.heading + diff);
+
+    control.velBodyZ = inputs.velBodyZ;
+    control.velBodyX = inputs.velBodyX;
+
+    const double bodyRelativeAbsoluteVelocity = ControlMath::hypot(control.velBodyZ, control.velBodyX);
+
+    const double bodyRelativeTrack = M_PI/2 - ControlMath::atan2(control.velBodyZ, control.velBodyX);
+
+    const double worldRelativeTrack = control.heading + bodyRelativeTrack;
+
+    double trackSine, trackCosine;
+    ControlMath::sinCos(worldRelativeTrack, trackSine, trackCosine);
+    control.velWorldZ = trackCosine * bodyRelativeAbsoluteVelocity;
+    control.velWorldX = trackSine * bodyRelativeAbsoluteVelocity;
+
+    // This is just a toy, so use a spherical Earth approximation and ignore the poles
+    // and the antimeridian.
+    control.lat += control.velWorldZ * timeSinceLast / 1000 / EARTH_RADIUS_FT;
+    control.lon += control.velWorldX * timeSinceLast / 1000 * ControlMath::cos(control.lat) / EARTH_RADIUS_FT;
+
+    // Assume this aircraft is used only at low altitudes and ignore wind
+    control.kias = fps2kn(bodyRelativeAbsoluteVelocity);
+    control.ktas = control.kias;
+
+    // Vertical speed and position handled in setVerticalSpeed().
+    setVerticalSpeed(inputs.verticalSpeed, timeSinceLast, control);
+}
+
+// Set the state as it is now, without motion, and from then on control the aircraft. The sim must not move it
+// meanwhile, so not before the freeze is in. On the ground the sim has it, unless the pilot takes off.
+static FlightSequencer::Action takeControl(FlightContext &context, FlightSequencer::Frame &frame) {
+    enum { Start, Frozen };
+
+    AllStateHistory &state = context.state;
+    switch (frame.step) {
+    case Start:
+        if (state.readonly().onGround || state.groundClearance() <= 1) {
+            unfreezeSimulation(state.readonly());
+            return enter(context, frame, SequenceGround);
+        }
+        return frame.call(SequenceAcquireFreeze, Frozen);
+
+    case Frozen:
+    default:
+        state.setMotionless();
+        estimator.reset();
+        setDirectControl(state);
+        noteSent(state.output());
+        enter(context, frame, SequenceFly);
+        return frame.yield();
+    }
+}
+
+// While we control the aircraft the sim must not move it, yet it can undo the freeze at any time. Check each
+// new state, as a frame with a flag off is a frame in which the sim moves the aircraft too. Only what is off
+// is asked for again.
+static void verifyFreeze(const FlightContext &context) {
+    if (context.fresh)
+        freezeSimulation(context.state.readonly());
+}
+
+// Use hysteresis to avoid toggling the freeze back and forth: land when the ground clearance goes below one
+// foot, but let the sim have the aircraft back only when it is two feet up, see waitOnGround().
+static FlightSequencer::Action fly(FlightContext &context, FlightSequencer::Frame &frame) {
+    AllStateHistory &state = context.state;
+    if (state.groundClearance() <= 1)
+        return enter(context, frame, SequenceLand);
+
+    verifyFreeze(context);
+    runControlLaw(context);
+    setDirectControl(state);
+    noteSent(state.output());
+    return frame.yield();
+}
+
+static FlightSequencer::Action land(FlightContext &context, FlightSequencer::Frame &frame) {
+    AllStateHistory &state = context.state;
+
+    // The sim has a say on the ground, see fuseEcho()
+    estimator.reset();
+    state.setMotionless();
+    setDirectControl(state);
+
+    // Let the simulator itself handle it on ground
+    unfreezeSimulation(state.readonly());
+
+    enter(context, frame, SequenceGround);
+    return frame.yield();
+}
+
+// Vertical velocity however can be changed while on the ground. We can lift off. Or the sim can put the
+// aircraft in the air, as when it bounces.
+static FlightSequencer::Action waitOnGround(FlightContext &context, FlightSequencer::Frame &frame) {
+    const AllStateHistory &state = context.state;
+    if (context.inputs.verticalSpeed > 0)
+        return enter(context, frame, SequenceTakeOff);
+    if (!state.readonly().onGround && state.groundClearance() > 2)
+        return enter(context, frame, SequenceTakeControl);
+    return frame.yield();
+}
+
+// Climb with the control law from where the aircraft is until two feet up, and then fly. Until then the
+// ground clearance does not mean landing, unless the pilot gives up on taking off.
+static FlightSequencer::Action takeOff(FlightContext &context, FlightSequencer::Frame &frame) {
+    enum { Start, Frozen, Climb };
+
+    AllStateHistory &state = context.state;
+    switch (frame.step) {
+    case Start:
+        estimator.reset();
+        return frame.call(SequenceAcquireFreeze, Frozen);
+
+    case Frozen:
+        if (context.inputs.verticalSpeed <= 0)
+            return enter(context, frame, SequenceLand);
+        state.setMotionless();
+        setVerticalSpeed(context.inputs.verticalSpeed, context.timeSinceLast, state.output());
+        setDirectControl(state);
+        return frame.yieldAt(Climb);
+
+    case Climb:
+    default:
+        if (state.groundClearance() > 2)
+            return enter(context, frame, SequenceFly);
+        if (context.inputs.verticalSpeed <= 0 && state.groundClearance() <= 1)
+            return enter(context, frame, SequenceLand);
+        verifyFreeze(context);
+        runControlLaw(context);
+        setDirectControl(state);
+        noteSent(state.output());
+        return frame.yield();
+    }
+}
+
+// Make sure the simulator itself is not trying to move the aircraft. That it stays so is checked by
+// verifyFreeze().
+static FlightSequencer::Action acquireFreeze(FlightContext &context, FlightSequencer::Frame &frame) {
+    enum { Start, Wait };
+
+    const ReadonlyState &readonly = context.state.readonly();
+    switch (frame.step) {
+    case Start:
+        freezeSimulation(readonly);
+        return frame.goTo(Wait);
+
+    case Wait:
+    default:
+        if (freezeAcknowledged(readonly))
+            return frame.finish();
+        if (frame.waited >= FreezeTimeoutFrames) {
+            freezeTimeouts++;
+            freezeSimulation(readonly);
+            return frame.finish();
+        }
+        return frame.yield();
+    }
+}
+
+// We want the parking brake to be always on when on ground. The event toggles it, so act on each state only
+// once, lest we toggle it back before the sim tells us it is on.
+static void enforceParkingBrake() {
+    if (!housekeeping.valid || !housekeeping.fresh || failed || recovery.reopenPending || hSimConnect == 0)
+        return;
+    housekeeping.fresh = false;
+    if (housekeeping.readonly.onGround && housekeeping.readonly.parkingBrake < 0.5) {
+        if (verbose)
+            std::cout << THISAIRCRAFT ": Setting parking brake" << std::flush;
+        RECORD(SubsystemEvents,
+               SimConnect_TransmitClientEvent(hSimConnect, SIMCONNECT_OBJECT_ID_USER, EventParkingBrakeToggle, TRUE,
+                                              SIMCONNECT_GROUP_PRIORITY_HIGHEST_MASKABLE, SIMCONNECT_EVENT_FLAG_GROUPID_IS_PRIORITY));
+    }
+}
+
+static void logRecovery() {
+    std::cout << THISAIRCRAFT ": Recovery from " << recoveryStatistics.exceptions << " exceptions: ignored "
+              << recoveryStatistics.ignored << ", reset " << recoveryStatistics.resets << ", re-opened "
+              << recoveryStatistics.reopens << " (last " << std::fixed << std::setprecision(2)
+              << recoveryStatistics.lastReopenMilliSeconds << "ms, max " << recoveryStatistics.maxReopenMilliSeconds
+              << "ms), back in control " << recoveryStatistics.recovered << " times (max "
+              << recoveryStatistics.maxFramesToControl << " frames)" << (failed ? ", given up" : "") << std::flush;
+}
+
+// Once a second, see MetricsRecord
+static void publishMetrics() {
+    if (hSimConnect == 0 || recovery.reopenPending)
+        return;
+
+    static MetricsRecord record = {};
+    record.sequence++;
+    record.exceptions = recoveryStatistics.exceptions;
+    record.exceptionsIgnored = recoveryStatistics.ignored;
+    record.resets = recoveryStatistics.resets;
+    record.reopens = recoveryStatistics.reopens;
+    record.recovered = recoveryStatistics.recovered;
+    record.maxFramesToControl = recoveryStatistics.maxFramesToControl;
+    record.lastReopenMilliSeconds = recoveryStatistics.lastReopenMilliSeconds;
+    record.maxReopenMilliSeconds = recoveryStatistics.maxReopenMilliSeconds;
+    record.failed = failed;
+
+    const Accounting::Totals traffic = accounting.totals();
+    record.calls = traffic.calls;
+    record.callsFailed = traffic.failures;
+    record.bytesSent = traffic.bytesSent;
+    record.packetsReceived = traffic.packets;
+    record.bytesReceived = traffic.bytesReceived;
+    record.otherRequests = traffic.otherRequests;
+    record.sequenceCheck = record.sequence;
+
+    RECORD(SubsystemMetrics,
+           SimConnect_SetClientData(hSimConnect, ClientDataMetrics, DataDefinitionMetrics,
+                                    SIMCONNECT_CLIENT_DATA_SET_FLAG_DEFAULT, 0, sizeof(record), &record));
+}
+
+static void logStatistics() {
+    if (!verbose)
+        return;
+    logCadence();
+    logEstimator();
+    logSubscription();
+    logRecovery();
+
+    const FlightSequencer::Statistics &sequences = flight.statistics();
+    std::cout << THISAIRCRAFT ": Sequences started " << sequences.started << ", stopped " << sequences.stopped
+              << ", resumed " << sequences.resumptions << " times for " << sequences.steps << " steps, "
+              << (flight.active() != FlightSequencer::None ? flightSequenceNames[flight.active()] : "none")
+              << " active, max depth " << sequences.maxDepth << ", pool exhausted " << sequences.poolExhausted
+              << " times, runaways " << sequences.runaways << ", freeze timeouts " << freezeTimeouts
+              << std::flush;
+
+    static const char *const workNames[] = { "diagnostics", "statistics", "recorder", "telemetry" };
+    const FrameBudget::Statistics &budget = frameBudget.statistics();
+    std::cout << THISAIRCRAFT ": Calls into the gauge " << budget.slices << ", over the " << std::fixed
+              << std::setprecision(1) << FrameBudget::BudgetNanoseconds / 1000.0 << "us budget "
+              << budget.overruns << " times, max " << budget.maxNanoseconds / 1000.0 << "us, shed";
+    for (int work = 0; work < FrameWorkEssential; work++)
+        std::cout << (work > 0 ? ", " : " ") << workNames[work] << " " << budget.shed[work];
+    std::cout << std::flush;
+
+    for (int i = 0; i < scheduler.tasksAdded(); i++) {
+        const Scheduler::Statistics &task = scheduler.statistics(i);
+        std::cout << THISAIRCRAFT ": Task " << task.name << " every " << std::fixed << std::setprecision(0)
+                  << task.periodMilliSeconds << "ms ran " << task.runs << " times, max " << std::setprecision(1)
+                  << task.maxMicroSeconds << "us, over its " << std::setprecision(0) << task.budgetMicroSeconds
+                  << "us budget " << task.overruns << " times, deferred " << task.deferrals << " times"
+                  << std::flush;
+    }
+}
+
+static RecoveryAction classifyException(DWORD exception, Subsystem subsystem) {
+    switch (exception) {
+    case SIMCONNECT_EXCEPTION_UNOPENED:
+    case SIMCONNECT_EXCEPTION_VERSION_MISMATCH:
+    case SIMCONNECT_EXCEPTION_TOO_MANY_GROUPS:
+    case SIMCONNECT_EXCEPTION_TOO_MANY_EVENT_NAMES:
+    case SIMCONNECT_EXCEPTION_TOO_MANY_MAPS:
+    case SIMCONNECT_EXCEPTION_TOO_MANY_OBJECTS:
+    case SIMCONNECT_EXCEPTION_TOO_MANY_REQUESTS:
+        return RecoveryReopen;
+
+    // These mean a bug in our definitions. Retrying will just fail the same way. The command channel is
+    // optional, though, so we can live without it.
+    case SIMCONNECT_EXCEPTION_SIZE_MISMATCH:
+    case SIMCONNECT_EXCEPTION_NAME_UNRECOGNIZED:
+    case SIMCONNECT_EXCEPTION_INVALID_DATA_TYPE:
+    case SIMCONNECT_EXCEPTION_INVALID_DATA_SIZE:
+    case SIMCONNECT_EXCEPTION_DEFINITION_ERROR:
+    case SIMCONNECT_EXCEPTION_DATUM_ID:
+        return subsystem == SubsystemCommand || subsystem == SubsystemMetrics ? RecoveryIgnore : RecoveryGiveUp;
+
+    // Harmless, we get these when re-doing something that survived
+    case SIMCONNECT_EXCEPTION_ALREADY_SUBSCRIBED:
+    case SIMCONNECT_EXCEPTION_ALREADY_CREATED:
+    case SIMCONNECT_EXCEPTION_EVENT_ID_DUPLICATE:
+    case SIMCONNECT_EXCEPTION_DUPLICATE_ID:
+        return RecoveryIgnore;
+    }
+
+    switch (subsystem) {
+    case SubsystemConnection:
+        return RecoveryReopen;
+    case SubsystemEvents:
+        // The freeze and parking brake events are sent again on the next frame if needed anyway
+        return RecoveryIgnore;
+    default:
+        return RecoveryReset;
+    }
+}
+
+static void handleException(const SIMCONNECT_RECV_EXCEPTION &exception) {
+    const auto call = calls.find(exception.dwSendID);
+
+    std::stringstream output;
+    output << THISAIRCRAFT ": EXCEPTION "
+           << exception_type(exception.dwException) << " "
+           << (call != calls.end() ? ("from " + call->second.call) : "from unknown API call") << " "
+           << exception.dwIndex;
+    std::cerr << output.str() << std::flush;
+
+    recoveryStatistics.exceptions++;
+
+    // If we don't know where it came from, start from scratch
+    const Subsystem subsystem = call != calls.end() ? call->second.subsystem : SubsystemConnection;
+    recover(classifyException(exception.dwException, subsystem), subsystem);
+}
+
+// A state callback taking longer than this triggers writing out the trace
+static constexpr int64_t traceSlowFrameNanoseconds = 5000000;
+
+// Fresh is whether the controller has not run with this state before
+template <typename Control>
+static void runController(const AllState &input, bool fresh) {
+    const FrameClock::time_point now = FrameClock::now();
+    if (cadence.runs > 0) {
+        const double milliSeconds = std::chrono::duration<double, std::milli>(now - cadence.last).count();
+        if (milliSeconds > Cadence::StallMilliSeconds) {
+            cadence.stalls++;
+        } else {
+            cadence.intervals++;
+            cadence.sum += milliSeconds;
+            cadence.sumOfSquares += milliSeconds * milliSeconds;
+            cadence.max = std::max(cadence.max, milliSeconds);
+        }
+    }
+    cadence.last = now;
+    cadence.runs++;
+    cadence.fresh += fresh;
+
+    const int64_t start = Trace::now();
+    handleState<Control>(input, fresh);
+    if (FLYINGBRICK_TRACE && Trace::now() - start > traceSlowFrameNanoseconds)
+        Trace::requestWrite("slow frame");
+}
+
+// Run the controller with the latest state, for FLYINGBRICK_TICK
+template <typename Control>
+static void tickController() {
+    if (!latestState.valid || failed || recovery.reopenPending || hSimConnect == 0)
+        return;
+
+    const bool fresh = latestState.fresh;
+    latestState.fresh = false;
+    runController<Control>(latestState.input, fresh);
+}
+
+// All that the dispatch procedure receives but the state, which is the same for every control path. Returns
+// whether it is the state, to be handled by the dispatch procedure of the control path.
+static bool dispatchReceived(SIMCONNECT_RECV *pData, DWORD cbData) {
+    // Requests are counted from the first of ours, and any that is not ours in the last slot
+    const bool hasRequest = (pData->dwID == SIMCONNECT_RECV_ID_SIMOBJECT_DATA
+                             || pData->dwID == SIMCONNECT_RECV_ID_CLIENT_DATA);
+    uint32_t request = 0;
+    if (hasRequest) {
+        const DWORD requestId = ((SIMCONNECT_RECV_SIMOBJECT_DATA*)pData)->dwRequestID;
+        request = requestId >= RequestAllState && requestId < RequestAllState + Accounting::MaxRequests - 1
+            ? requestId - RequestAllState : Accounting::MaxRequests - 1;
+    }
+    accounting.received(pData->dwID, request, cbData);
+
+    if (failed || recovery.reopenPending)
+        return false;
+
+    switch(pData->dwID) {
+    case SIMCONNECT_RECV_ID_EVENT: {
+        SIMCONNECT_RECV_EVENT *event = (SIMCONNECT_RECV_EVENT*)pData;
+
+        switch(event->uEventID) {
+        case EventPause:
+            Recorder::addEvent("Pause", event->dwData);
+            simPaused = event->dwData;
+            if (verbose)
+                std::cout << THISAIRCRAFT ": PAUSE " << (simPaused ? "ON" : "OFF") << std::flush;
+            break;
+        case EventWriteTrace:
+            Trace::requestWrite("requested");
+            break;
+        case EventRecord:
+            if (event->dwData)
+                Recorder::requestStart();
+            else
+                Recorder::requestStop();
+            break;
+        default:
+            if (verbose)
+                std::cout << THISAIRCRAFT ": EVENT " << event->uEventID << " " << event->dwData << std::flush;
+            break;
+        }
+        break;
+    }
     case SIMCONNECT_RECV_ID_EVENT_FILENAME: {
         SIMCONNECT_RECV_EVENT_FILENAME *filename = (SIMCONNECT_RECV_EVENT_FILENAME*)pData;
         if (verbose)
             std::cout << THISAIRCRAFT ": EVENT_FILENAME "
                       << filename->szFileName;
         switch (filename->uEventID) {
+        case EventFlightLoaded:
+            Recorder::addEvent("FlightLoaded", 0);
+
+            // A new situation, so start over as if the gauge had just started. If the snapshot fits the new
+            // situation it will be used.
+            ignitionSwitch = false;
+            flight.stop();
+            startWarmUp();
+            latestState.valid = false;
+            housekeeping.valid = false;
+            controlStart.reason = "flight load";
+            controlStart.waiting = false;
+            break;
         default:
             if (verbose)
                 std::cout << " " << filename->uEventID;
@@ -761,232 +2123,1043 @@ static void dispatchProc(SIMCONNECT_RECV *pData, DWORD cbData, void *pContext) {
         SIMCONNECT_RECV_SIMOBJECT_DATA *data = (SIMCONNECT_RECV_SIMOBJECT_DATA*)pData;
         switch (data->dwRequestID) {
         case RequestAllState:
-            handleState(*(AllState*)&data->dwData);
+            return true;
+        default:
+            assert(false);
+        }
+        break;
+    }
+    case SIMCONNECT_RECV_ID_CLIENT_DATA: {
+        SIMCONNECT_RECV_CLIENT_DATA *data = (SIMCONNECT_RECV_CLIENT_DATA*)pData;
+        switch (data->dwRequestID) {
+        case RequestCommand: {
+            CommandRecord command;
+            std::memcpy(&command, &data->dwData, sizeof(command));
+            Recorder::add(RecordCommand, &command, sizeof(command));
+            commandMailbox.post(command, FrameClock::now());
             break;
+        }
         default:
             assert(false);
         }
         break;
     }
     case SIMCONNECT_RECV_ID_EXCEPTION: {
-        SIMCONNECT_RECV_EXCEPTION *exception = (SIMCONNECT_RECV_EXCEPTION*)pData;
-        std::stringstream output;
-        output << THISAIRCRAFT ": EXCEPTION "
-               << exception_type(exception->dwException) << " "
-               << (calls.count(exception->dwSendID) ? ("from " + calls[exception->dwSendID]) : "from unknown API call") << " "
-               << exception->dwIndex;
-        std::cerr << output.str() << std::flush;
-        failed = true;
+        handleException(*(SIMCONNECT_RECV_EXCEPTION*)pData);
         break;
     }
     }
+    return false;
+}
+
+template <typename Control>
+static void dispatchProc(SIMCONNECT_RECV *pData, DWORD cbData, void * /*pContext*/) {
+    TRACE_SCOPE("dispatch");
+    FrameSlice slice(frameBudget);
+
+    if (!dispatchReceived(pData, cbData))
+        return;
+
+    // Copied out, as the payload is declared as a DWORD and may not be aligned for a double
+    AllState input;
+    std::memcpy(&input, &((SIMCONNECT_RECV_SIMOBJECT_DATA*)pData)->dwData, sizeof(input));
+    Recorder::add(RecordState, &input, sizeof(input));
+    observeTraffic(input);
+
+    if (FLYINGBRICK_TICK) {
+        latestState.input = input;
+        latestState.valid = latestState.fresh = true;
+    } else {
+        runController<Control>(input, true);
+    }
+    recoveryHealthyCallback();
 }
 
-static bool flight_model_callback(const char *Section, const char *Key, const char *Value, void *UserData) {
-    if (strcasecmp(Section, "CONTACT_POINTS") == 0
-        && strcasecmp(Key, "static_cg_height") == 0) {
+// The control path of a gauge, with the response curves of Control, see ResponseCurves. It is picked once the
+// configuration is loaded, see initialize(), so that no state callback has to find out which one to take.
+struct ControlPath {
+    DispatchProc dispatch;
+    void (*tick)();
+};
+
+template <typename Control>
+static constexpr ControlPath controlPathOf = { dispatchProc<Control>, tickController<Control> };
+
+static const ControlPath *controlPath = &controlPathOf<ConfiguredCurves>;
 
+// The curves of the control path of a variant unless aircraft.cfg overrides them
+template <typename Variant>
+using VariantCurves = typename std::conditional<FLYINGBRICK_RUNTIME_PARAMETERS, ConfiguredCurves,
+                                                VariantControl<Variant>>::type;
+
+static bool flight_model_callback(const char *Section, const char *Key, const char *Value,
+                                  void * /*UserData*/) {
+    if (strcasecmp(Section, "CONTACT_POINTS") != 0)
+        return true;
+
+    if (strcasecmp(Key, "static_cg_height") == 0) {
         static_cg_height = strtod(Value, NULL);
         if (verbose)
             std::cout << THISAIRCRAFT ": Static CG height from flight_model.cfg: " << static_cg_height << "ft" << std::flush;
+    } else if (strncasecmp(Key, "point.", 6) == 0) {
+        // The first four fields are the type and the longitudinal, lateral and vertical position. Type 0 means
+        // none.
+        char *end;
+        const long type = strtol(Value, &end, 10);
+        double position[3];
+        for (auto &coordinate: position) {
+            while (*end == ',' || *end == ' ')
+                end++;
+            coordinate = strtod(end, &end);
+        }
+        if (type != 0 && !contactPoints.add(position[0], position[1], position[2]))
+            std::cerr << THISAIRCRAFT ": Too many contact points in flight_model.cfg, ignoring " << Key << std::flush;
+    }
+
+    // Continue browsing.
+    return true;
+}
+
+// The axes that can be configured in the [FLYING_BRICK_RESPONSE] section of aircraft.cfg, with the unit the
+// curve outputs are given in there.
+struct ResponseAxis {
+    const char *name;
+    CurveDefinition ResponseCurveDefinitions::*definition;
+    double (*convert)(double);                    // From the unit in aircraft.cfg to what the control law wants
+    const char *unit;
+};
 
-        // That is all we want.
+static constexpr ResponseAxis responseAxes[] = {
+    { "rudder", &ResponseCurveDefinitions::rudder, deg2rad, "degrees/second" },
+    { "aileron", &ResponseCurveDefinitions::aileron, kn2fps, "knots" },
+    { "elevator", &ResponseCurveDefinitions::elevator, kn2fps, "knots" },
+    { "throttle", &ResponseCurveDefinitions::throttle, fpm2fps, "feet/minute" },
+};
+
+// A curve is a comma-separated list of position:output points, the position in the units of the axis (-1 to 1,
+// or 0 to 1 for the throttle), sorted. Leaves definition untouched if there is anything wrong with it.
+static bool parseCurve(const char *value, const ResponseAxis &axis, CurveDefinition &definition) {
+    const double toNormalized = 2 / (definition.inputMax - definition.inputMin);
+
+    CurveDefinition parsed = definition;
+    parsed.count = 0;
+
+    const char *next = value;
+    while (*next != '\0') {
+        if (parsed.count == CurveDefinition::MaxPoints)
+            return false;
+
+        char *end;
+        const double position = strtod(next, &end);
+        if (end == next || *end != ':')
+            return false;
+        next = end + 1;
+        const double output = strtod(next, &end);
+        if (end == next)
+            return false;
+        next = end;
+        while (*next == ' ' || *next == '\t')
+            next++;
+        if (*next == ',')
+            next++;
+
+        CurvePoint &point = parsed.points[parsed.count];
+        point.x = (position - definition.inputMin) * toNormalized - 1;
+        point.y = axis.convert(output);
+        if (point.x < -1 || point.x > 1 || (parsed.count > 0 && point.x < parsed.points[parsed.count - 1].x))
+            return false;
+        parsed.count++;
+    }
+    if (parsed.count == 0)
         return false;
+
+    definition = parsed;
+    return true;
+}
+
+static bool response_callback(const char *Section, const char *Key, const char *Value, void *UserData) {
+    if (strcasecmp(Section, "FLYING_BRICK_RESPONSE") != 0)
+        return true;
+
+    ResponseCurveDefinitions &definitions = *(ResponseCurveDefinitions*)UserData;
+
+    for (const auto &axis: responseAxes) {
+        const size_t length = strlen(axis.name);
+        if (strncasecmp(Key, axis.name, length) != 0 || Key[length] != '_')
+            continue;
+
+        CurveDefinition &definition = definitions.*axis.definition;
+        const char *setting = Key + length + 1;
+        if (strcasecmp(setting, "dead_zone") == 0) {
+            // Given in the units of the axis, kept as a fraction of its half range
+            definition.deadZone = std::abs(strtod(Value, NULL)) * 2 / (definition.inputMax - definition.inputMin);
+        } else if (strcasecmp(setting, "expo") == 0) {
+            definition.expo = std::min(std::max(0.0, strtod(Value, NULL)), 1.0);
+        } else if (strcasecmp(setting, "curve") == 0) {
+            if (!parseCurve(Value, axis, definition))
+                std::cerr << THISAIRCRAFT ": Invalid " << Key << " in aircraft.cfg, expected sorted position:" << axis.unit
+                          << " pairs, ignoring it" << std::flush;
+        } else {
+            std::cerr << THISAIRCRAFT ": Unknown " << Key << " in aircraft.cfg, ignoring it" << std::flush;
+        }
+        return true;
     }
+    std::cerr << THISAIRCRAFT ": Unknown " << Key << " in aircraft.cfg, ignoring it" << std::flush;
 
     // Continue browsing.
     return true;
 }
 
-static void initialize() {
-    if (hSimConnect != 0)
+// What tells that a file may have changed without reading it
+struct FileStamp {
+    int64_t size;
+    int64_t modifiedNanoSeconds;
+};
+
+// What we take from the aircraft's .cfg files, compiled into a binary file in the work folder the first time
+// and read back in one go after that, so that starting the gauge does not parse the text every time. Only the
+// size and modification time of the .cfg files are looked at. When those differ from what was compiled the
+// file is hashed, and parsed again only if its contents have changed too.
+struct CompiledConfiguration {
+    static constexpr uint32_t Magic = 0x4346424b;   // "KBFC"
+
+    // Bump this when what is compiled changes meaning without changing size
+    static constexpr uint32_t Version = 3;
+
+    static constexpr int Sources = 2;
+
+    uint32_t magic;
+    uint32_t version;
+    uint32_t size;                                // sizeof(CompiledConfiguration)
+    uint64_t variant;                             // A hash of its name, as its defaults are compiled in
+    uint64_t sourceHashes[Sources];               // Of its flight_model.cfg and aircraft.cfg
+    FileStamp sourceStamps[Sources];              // Of the same, as they were when last hashed
+
+    double staticCgHeight;
+    ContactPoints contactPoints;
+    ResponseCurveDefinitions responseCurves;
+
+    uint64_t checksum;                            // Of everything before it
+};
+
+// One per variant, so that flying them in turn does not parse each one's files every time
+static std::string compiledConfigurationFileName;
+
+// What the configuration of the variant flown is loaded from, see loadConfiguration()
+struct VariantConfiguration {
+    const char *name;
+    const char *sources[CompiledConfiguration::Sources];
+    ResponseCurveDefinitions responseCurves;      // The defaults
+};
+
+template <typename Variant>
+static constexpr VariantConfiguration variantConfiguration = {
+    Variant::name(),
+    { Variant::flightModelFile(), Variant::aircraftFile() },
+    variantResponseCurves<Variant>(),
+};
+
+// FNV-1a, eight bytes at a time
+static uint64_t hashBytes(const void *data, size_t size, uint64_t hash = 0xcbf29ce484222325ULL) {
+    static constexpr uint64_t Prime = 0x100000001b3ULL;
+    const unsigned char *bytes = static_cast<const unsigned char*>(data);
+    for (; size >= 8; bytes += 8, size -= 8) {
+        uint64_t word;
+        std::memcpy(&word, bytes, 8);
+        hash = (hash ^ word) * Prime;
+    }
+    for (; size > 0; bytes++, size--)
+        hash = (hash ^ *bytes) * Prime;
+    return hash;
+}
+
+// Zero if the file cannot be read, so that a missing file is parsed, and found missing, every time
+static uint64_t hashFile(const char *fileName) {
+    std::FILE *file = std::fopen(fileName, "rb");
+    if (file == nullptr)
+        return 0;
+
+    uint64_t hash = 0xcbf29ce484222325ULL;
+    char buffer[8192];
+    size_t read;
+    while ((read = std::fread(buffer, 1, sizeof(buffer), file)) > 0)
+        hash = hashBytes(buffer, read, hash);
+    std::fclose(file);
+    return hash;
+}
+
+// All zero if the file cannot be looked at, which never matches a file that has been hashed
+static FileStamp stampFile(const char *fileName) {
+    struct stat status;
+    if (stat(fileName, &status) != 0)
+        return FileStamp();
+    return { int64_t(status.st_size), int64_t(status.st_mtim.tv_sec) * 1000000000 + status.st_mtim.tv_nsec };
+}
+
+static bool sameStamp(const FileStamp &a, const FileStamp &b) {
+    return a.size == b.size && a.modifiedNanoSeconds == b.modifiedNanoSeconds && a.modifiedNanoSeconds != 0;
+}
+
+static uint64_t configurationChecksum(const CompiledConfiguration &compiled) {
+    return hashBytes(&compiled, offsetof(CompiledConfiguration, checksum));
+}
+
+static uint64_t variantHash(const VariantConfiguration &variant) {
+    return hashBytes(variant.name, std::strlen(variant.name));
+}
+
+static bool readCompiledConfiguration(const VariantConfiguration &variant, CompiledConfiguration &compiled) {
+    std::FILE *file = std::fopen(compiledConfigurationFileName.c_str(), "rb");
+    if (file == nullptr)
+        return false;
+    const bool read = std::fread(&compiled, sizeof(compiled), 1, file) == 1;
+    std::fclose(file);
+
+    return (read
+            && compiled.magic == CompiledConfiguration::Magic
+            && compiled.version == CompiledConfiguration::Version
+            && compiled.size == sizeof(CompiledConfiguration)
+            && compiled.variant == variantHash(variant)
+            && compiled.checksum == configurationChecksum(compiled));
+}
+
+static void writeCompiledConfiguration(CompiledConfiguration &compiled) {
+    compiled.magic = CompiledConfiguration::Magic;
+    compiled.version = CompiledConfiguration::Version;
+    compiled.size = sizeof(CompiledConfiguration);
+    compiled.checksum = configurationChecksum(compiled);
+
+    std::FILE *file = std::fopen(compiledConfigurationFileName.c_str(), "wb");
+    if (file == nullptr) {
+        std::cerr << THISAIRCRAFT ": Could not create " << compiledConfigurationFileName << std::flush;
         return;
+    }
+    if (std::fwrite(&compiled, sizeof(compiled), 1, file) != 1)
+        std::cerr << THISAIRCRAFT ": Could not write " << compiledConfigurationFileName << std::flush;
+    std::fclose(file);
+}
 
-    if (!SUCCEEDED(SimConnect_Open(&hSimConnect, THISAIRCRAFT, nullptr, 0, 0, 0))) {
-        std::cerr << THISAIRCRAFT ": SimConnect_Open failed" << std::flush;
+// The longest it took to start from the compiled configuration and from parsing, in microseconds
+static double maxCompiledConfigurationMicroSeconds, maxParsedConfigurationMicroSeconds;
+
+static bool sameCurve(const CurveDefinition &a, const CurveDefinition &b) {
+    if (a.inputMin != b.inputMin || a.inputMax != b.inputMax || a.deadZone != b.deadZone || a.expo != b.expo
+        || a.count != b.count)
+        return false;
+    for (int i = 0; i < a.count; i++) {
+        if (a.points[i].x != b.points[i].x || a.points[i].y != b.points[i].y)
+            return false;
+    }
+    return true;
+}
+
+// Returns whether aircraft.cfg overrides the response curves of the variant
+static bool loadConfiguration(const VariantConfiguration &variant) {
+    const int64_t start = Trace::now();
+
+    compiledConfigurationFileName = std::string(WORK_FOLDER) + variant.name + ".bin";
+    const char *const (&sources)[CompiledConfiguration::Sources] = variant.sources;
+    FileStamp stamps[CompiledConfiguration::Sources];
+    for (int i = 0; i < CompiledConfiguration::Sources; i++)
+        stamps[i] = stampFile(sources[i]);
+
+    // Static, as ContactPoints wants more alignment than the stack may have in wasm
+    static CompiledConfiguration compiled;
+    bool fromCompiled = readCompiledConfiguration(variant, compiled);
+    bool restamped = false;
+    for (int i = 0; fromCompiled && i < CompiledConfiguration::Sources; i++) {
+        if (sameStamp(stamps[i], compiled.sourceStamps[i]))
+            continue;
+
+        // Copied, touched or edited: only an edit needs parsing again
+        const uint64_t hash = hashFile(sources[i]);
+        fromCompiled = hash != 0 && hash == compiled.sourceHashes[i];
+        restamped = true;
+    }
+
+    if (!fromCompiled) {
+        compiled = CompiledConfiguration();
+        compiled.variant = variantHash(variant);
+        for (int i = 0; i < CompiledConfiguration::Sources; i++)
+            compiled.sourceHashes[i] = hashFile(sources[i]);
+
+        // Read our flight_model.cfg to avoid having to duplicate some information as magic numbers in this
+        // file. Start from nothing, as what was loaded before is what it replaces.
+        static_cg_height = 0;
+        contactPoints = ContactPoints();
+        ini_browse(flight_model_callback, NULL, sources[0]);
+        compiled.staticCgHeight = static_cg_height;
+        compiled.contactPoints = contactPoints;
+
+        // The response curves, as those of the variant with what aircraft.cfg overrides
+        compiled.responseCurves = variant.responseCurves;
+        ini_browse(response_callback, &compiled.responseCurves, sources[1]);
+    }
+    if (!fromCompiled || restamped) {
+        std::copy(std::begin(stamps), std::end(stamps), compiled.sourceStamps);
+        writeCompiledConfiguration(compiled);
+    }
+
+    static_cg_height = compiled.staticCgHeight;
+    contactPoints = compiled.contactPoints;
+    responseCurves.rudder = ResponseCurve(compiled.responseCurves.rudder);
+    responseCurves.aileron = ResponseCurve(compiled.responseCurves.aileron);
+    responseCurves.elevator = ResponseCurve(compiled.responseCurves.elevator);
+    responseCurves.throttle = ResponseCurve(compiled.responseCurves.throttle);
+    const ResponseCurveDefinitions &defaults = variant.responseCurves;
+    const bool overridden = !(sameCurve(compiled.responseCurves.rudder, defaults.rudder)
+                              && sameCurve(compiled.responseCurves.aileron, defaults.aileron)
+                              && sameCurve(compiled.responseCurves.elevator, defaults.elevator)
+                              && sameCurve(compiled.responseCurves.throttle, defaults.throttle));
+
+    const double microSeconds = (Trace::now() - start) / 1000.0;
+    double &max = fromCompiled ? maxCompiledConfigurationMicroSeconds : maxParsedConfigurationMicroSeconds;
+    max = std::max(max, microSeconds);
+    if (verbose)
+        std::cout << THISAIRCRAFT ": Configuration of " << variant.name << " "
+                  << (fromCompiled ? "from " : "parsed into ") << compiledConfigurationFileName
+                  << " in " << std::fixed << std::setprecision(1) << microSeconds << "us"
+                  << " (max compiled " << maxCompiledConfigurationMicroSeconds
+                  << "us, parsed " << maxParsedConfigurationMicroSeconds << "us)"
+                  << ", contact points " << contactPoints.size() << ", lowest " << contactPoints.lowestLevel() << "ft"
+                  << ", response curves " << (overridden ? "of aircraft.cfg" : "of the variant")
+                  << std::flush;
+    return overridden;
+}
+
+// Our SimConnect data definitions as data. They are replayed by the setup functions below, both initially and
+// when recovering, so the setup after re-opening the connection is a straight run over these tables and
+// not a long hand-written sequence.
+
+struct Datum {
+    const char *name;
+    const char *unit;
+    SIMCONNECT_DATATYPE type;
+    float epsilon;
+};
+
+// In the order of the fields of ReadonlyState. Use only 64-bit types so that the sizes of the structs
+// (without any packing pragmas) match what SimConnect wants.
+static const Datum readonlyData[] = {
+    { "RUDDER PEDAL POSITION", "position", SIMCONNECT_DATATYPE_FLOAT64, HUNDREDTH },
+    { "AILERON POSITION", "position", SIMCONNECT_DATATYPE_FLOAT64, HUNDREDTH },
+    { "ELEVATOR POSITION", "position", SIMCONNECT_DATATYPE_FLOAT64, HUNDREDTH },
+    { "GENERAL ENG THROTTLE LEVER POSITION:1", "position", SIMCONNECT_DATATYPE_FLOAT64, HUNDREDTH },
+    { "PLANE ALT ABOVE GROUND", "feet", SIMCONNECT_DATATYPE_FLOAT64, HUNDREDTH },
+
+    { "RELATIVE WIND VELOCITY BODY X", "feet/second", SIMCONNECT_DATATYPE_FLOAT64, HUNDREDTH },
+    { "RELATIVE WIND VELOCITY BODY Y", "feet/second", SIMCONNECT_DATATYPE_FLOAT64, HUNDREDTH },
+    { "RELATIVE WIND VELOCITY BODY Z", "feet/second", SIMCONNECT_DATATYPE_FLOAT64, HUNDREDTH },
+
+    { "SIM ON GROUND", "boolean", SIMCONNECT_DATATYPE_INT64, 0 },
+    { "MASTER IGNITION SWITCH", "boolean", SIMCONNECT_DATATYPE_INT64, 0 },
+    { "BRAKE PARKING POSITION", "position", SIMCONNECT_DATATYPE_FLOAT64, 0 },
+    { "IS ALTITUDE FREEZE ON", "boolean", SIMCONNECT_DATATYPE_INT64, 0 },
+    { "IS ATTITUDE FREEZE ON", "boolean", SIMCONNECT_DATATYPE_INT64, 0 },
+    { "IS LATITUDE LONGITUDE FREEZE ON", "boolean", SIMCONNECT_DATATYPE_INT64, 0 },
+    { "AMBIENT PRESSURE", "inHg", SIMCONNECT_DATATYPE_FLOAT64, 0 },
+};
+
+// In the order of the fields of MutableState
+static const Datum mutableData[] = {
+    { "PLANE HEADING DEGREES TRUE", "radians", SIMCONNECT_DATATYPE_FLOAT64, 0 },
+    { "PLANE BANK DEGREES", "radians", SIMCONNECT_DATATYPE_FLOAT64, 10 },
+    { "PLANE PITCH DEGREES", "radians", SIMCONNECT_DATATYPE_FLOAT64, 10 },
+
+    { "PLANE LATITUDE", "radians", SIMCONNECT_DATATYPE_FLOAT64, 0 },
+    { "PLANE LONGITUDE", "radians", SIMCONNECT_DATATYPE_FLOAT64, 0 },
+    { "PLANE ALTITUDE", "feet", SIMCONNECT_DATATYPE_FLOAT64, 0 },
+
+    { "VELOCITY BODY X", "feet/second", SIMCONNECT_DATATYPE_FLOAT64, 0 },
+    { "VELOCITY BODY Y", "feet/second", SIMCONNECT_DATATYPE_FLOAT64, 0 },
+    { "VELOCITY BODY Z", "feet/second", SIMCONNECT_DATATYPE_FLOAT64, 0 },
+
+    { "VELOCITY WORLD X", "feet/second", SIMCONNECT_DATATYPE_FLOAT64, 0 },
+    { "VELOCITY WORLD Y", "feet/second", SIMCONNECT_DATATYPE_FLOAT64, 0 },
+    { "VELOCITY WORLD Z", "feet/second", SIMCONNECT_DATATYPE_FLOAT64, 0 },
+
+    { "AIRSPEED INDICATED", "knots", SIMCONNECT_DATATYPE_FLOAT64, 10 },
+    { "AIRSPEED TRUE", "knots", SIMCONNECT_DATATYPE_FLOAT64, 10 },
+    { "VERTICAL SPEED", "feet/minute", SIMCONNECT_DATATYPE_FLOAT64, 10 },
+};
+
+static_assert(sizeof(readonlyData) / sizeof(readonlyData[0]) == ReadonlyFields, "readonlyData does not match ReadonlyState");
+static_assert(sizeof(mutableData) / sizeof(mutableData[0]) == MutableFields, "mutableData does not match MutableState");
+
+static constexpr size_t AllStateFields = (sizeof(readonlyData) / sizeof(readonlyData[0])
+                                          + sizeof(mutableData) / sizeof(mutableData[0]));
+
+// How far each field of AllState can be from the sim's value without the control law doing anything
+// different, in each phase, in the order of readonlyData and mutableData. We ask for the state with these as
+// the epsilons, so they are also the worst-case error that asking for it only when it changes introduces.
+//
+// - The control axes: the response curves do not tell a hundredth apart.
+// - AGL: the ground logic decides at one and two feet of ground clearance.
+// - The flags: any change.
+// - Wind, bank, pitch and the indications: not used.
+// - Position, altitude and heading: in control, half the dead band of the state estimator, so that it still
+//   sees what the sim does beyond the dead band. Parked, the sim has the aircraft and we only need to know
+//   about where it is when we take control.
+// - Velocities: in control they are what we set. Parked, they do not matter until we take control.
+//
+// Paced fields change on every frame while moving. When the state callbacks drive the controller
+// (FLYINGBRICK_TICK 0) and one of them has been changing by less than twice its tolerance per callback while
+// cruising, it is asked for on any change, so that the callbacks keep coming on every frame.
+struct Tolerance {
+    float phases[PhaseCount];                     // Parked, hovering, cruising
+    bool paced;
+};
+
+static constexpr float FootInRadians = float(1 / EARTH_RADIUS_FT);
+
+static const Tolerance allStateTolerances[] = {
+    { { HUNDREDTH, HUNDREDTH, HUNDREDTH }, false },                // RUDDER PEDAL POSITION
+    { { HUNDREDTH, HUNDREDTH, HUNDREDTH }, false },                // AILERON POSITION
+    { { HUNDREDTH, HUNDREDTH, HUNDREDTH }, false },                // ELEVATOR POSITION
+    { { HUNDREDTH, HUNDREDTH, HUNDREDTH }, false },                // GENERAL ENG THROTTLE LEVER POSITION:1
+    { { 0.5, 0.1, 0.1 }, false },                                  // PLANE ALT ABOVE GROUND
+
+    { { 10, 10, 10 }, false },                                     // RELATIVE WIND VELOCITY BODY X
+    { { 10, 10, 10 }, false },                                     // RELATIVE WIND VELOCITY BODY Y
+    { { 10, 10, 10 }, false },                                     // RELATIVE WIND VELOCITY BODY Z
+
+    { { 0, 0, 0 }, false },                                        // SIM ON GROUND
+    { { 0, 0, 0 }, false },                                        // MASTER IGNITION SWITCH
+    { { 0, 0, 0 }, false },                                        // BRAKE PARKING POSITION
+    { { 0, 0, 0 }, false },                                        // IS ALTITUDE FREEZE ON
+    { { 0, 0, 0 }, false },                                        // IS ATTITUDE FREEZE ON
+    { { 0, 0, 0 }, false },                                        // IS LATITUDE LONGITUDE FREEZE ON
+    { { HUNDREDTH, HUNDREDTH, HUNDREDTH }, false },                // AMBIENT PRESSURE
+
+    { { 0.01, 0.005, 0.005 }, true },                              // PLANE HEADING DEGREES TRUE
+    { { 10, 10, 10 }, false },                                     // PLANE BANK DEGREES
+    { { 10, 10, 10 }, false },                                     // PLANE PITCH DEGREES
+
+    { { 5 * FootInRadians, FootInRadians, FootInRadians }, true }, // PLANE LATITUDE
+    { { 5 * FootInRadians, FootInRadians, FootInRadians }, true }, // PLANE LONGITUDE
+    { { 1, 0.5, 0.5 }, true },                                     // PLANE ALTITUDE
+
+    { { 0.5, 0.1, 0.1 }, true },                                   // VELOCITY BODY X
+    { { 0.5, 0.1, 0.1 }, true },                                   // VELOCITY BODY Y
+    { { 0.5, 0.1, 0.1 }, true },                                   // VELOCITY BODY Z
+
+    { { 0.5, 0.1, 0.1 }, true },                                   // VELOCITY WORLD X
+    { { 0.5, 0.1, 0.1 }, true },                                   // VELOCITY WORLD Y
+    { { 0.5, 0.1, 0.1 }, true },                                   // VELOCITY WORLD Z
+
+    { { 10, 10, 10 }, false },                                     // AIRSPEED INDICATED
+    { { 10, 10, 10 }, false },                                     // AIRSPEED TRUE
+    { { 10, 10, 10 }, false },                                     // VERTICAL SPEED
+};
+
+static_assert(sizeof(allStateTolerances) / sizeof(allStateTolerances[0]) == AllStateFields,
+              "allStateTolerances does not match readonlyData and mutableData");
+
+// The epsilons the state is requested with, and the traffic that results
+static struct Subscription {
+    // Renegotiating costs a few dozen calls, so when only the change rates move it is done at most this often
+    static constexpr double RetuneSeconds = 2;
+
+    // Stop cruising only after not moving for this long, not to go back and forth
+    static constexpr double CruisingSeconds = 1;
+
+    FlightPhase phase;
+    std::array<float, AllStateFields> epsilons;   // As requested
+    std::array<double, AllStateFields> rates;     // Change per callback, smoothed
+    std::array<double, AllStateFields> previous;
+    bool havePrevious;
+    FrameClock::time_point renegotiated, moved, accounted;
+    uint64_t renegotiations;
+    std::array<uint64_t, PhaseCount> callbacks;
+    std::array<double, PhaseCount> seconds;
+} subscription;
+
+// A field of AllState by its index, see AllStateFields
+static double allStateField(const AllState &state, size_t index) {
+    if (index >= ReadonlyFields)
+        return state.state.*mutableFields[index - ReadonlyFields];
+
+    const char *field = reinterpret_cast<const char*>(&state.readonly) + readonlyOffsets[index];
+    if (readonlyData[index].type == SIMCONNECT_DATATYPE_INT64) {
+        int64_t value;
+        std::memcpy(&value, field, sizeof(value));
+        return double(value);
+    }
+    double value;
+    std::memcpy(&value, field, sizeof(value));
+    return value;
+}
+
+static void chooseEpsilons(FlightPhase phase, std::array<float, AllStateFields> &epsilons) {
+    for (size_t i = 0; i < AllStateFields; i++) {
+        epsilons[i] = allStateTolerances[i].phases[phase];
+        if (!FLYINGBRICK_TICK && phase == PhaseCruising && allStateTolerances[i].paced
+            && subscription.rates[i] < 2 * epsilons[i])
+            epsilons[i] = 0;
+    }
+}
+
+// Note a state callback, for the change rates and the traffic
+static void observeTraffic(const AllState &input) {
+    subscription.callbacks[subscription.phase]++;
+    for (size_t i = 0; i < AllStateFields; i++) {
+        const double value = allStateField(input, i);
+        if (subscription.havePrevious)
+            subscription.rates[i] += 0.1 * (std::abs(value - subscription.previous[i]) - subscription.rates[i]);
+        subscription.previous[i] = value;
+    }
+    subscription.havePrevious = true;
+}
+
+// Called on each gauge update, so that the time without callbacks counts too
+static void accountTraffic() {
+    const FrameClock::time_point now = FrameClock::now();
+    if (subscription.accounted != FrameClock::time_point())
+        subscription.seconds[subscription.phase] += std::chrono::duration<double>(now - subscription.accounted).count();
+    subscription.accounted = now;
+}
+
+static void logSubscription() {
+    static const char *const phaseNames[] = { "parked", "hovering", "cruising" };
+    static constexpr size_t lat = offsetof(AllState, state.lat) / 8, msl = offsetof(AllState, state.msl) / 8,
+        heading = offsetof(AllState, state.heading) / 8, velocity = offsetof(AllState, state.velBodyX) / 8;
+
+    std::cout << THISAIRCRAFT ": State callbacks per second";
+    for (int phase = 0; phase < PhaseCount; phase++)
+        std::cout << (phase > 0 ? ", " : " ") << phaseNames[phase] << " " << std::fixed << std::setprecision(1)
+                  << subscription.callbacks[phase] / std::max(1e-3, subscription.seconds[phase]);
+    std::cout << ", renegotiated " << subscription.renegotiations << " times, now " << phaseNames[subscription.phase]
+              << " with errors up to " << std::setprecision(2) << subscription.epsilons[lat] * EARTH_RADIUS_FT
+              << "ft position, " << subscription.epsilons[msl] << "ft altitude, "
+              << rad2deg(subscription.epsilons[heading]) << "deg heading, " << subscription.epsilons[velocity]
+              << "ft/s velocity" << std::flush;
+}
+
+// Where the SimConnect traffic went since the last time: the calls per second and the bytes they sent along,
+// per API and per call site, and the packets received per type and request
+static void logTraffic() {
+    static Accounting reported;
+    static FrameClock::time_point reportedAt = FrameClock::now();
+
+    const FrameClock::time_point now = FrameClock::now();
+    const double seconds = std::chrono::duration<double>(now - reportedAt).count();
+    if (!verbose || seconds <= 0)
         return;
+    const Accounting traffic = accounting.since(reported);
+    reported = accounting;
+    reportedAt = now;
+
+    const Accounting::Totals totals = traffic.totals();
+    std::cout << THISAIRCRAFT ": SimConnect traffic in " << std::fixed << std::setprecision(1) << seconds
+              << "s: sent " << totals.calls / seconds << " calls/s (" << totals.failures << " failed), "
+              << totals.bytesSent / seconds << " bytes/s; received " << totals.packets / seconds
+              << " packets/s, " << totals.bytesReceived / seconds << " bytes/s" << std::flush;
+
+    // Per API, listed at the first of its call sites
+    for (int i = 0; i < Accounting::MaxSites; i++) {
+        const Accounting::Site &site = traffic.site(i);
+        if (site.line == 0)
+            continue;
+        bool listed = false;
+        for (int j = 0; j < i && !listed; j++)
+            listed = traffic.site(j).line != 0 && Accounting::sameApi(traffic.site(j), site);
+        uint64_t apiCalls = 0, apiBytes = 0;
+        for (int j = i; j < Accounting::MaxSites && !listed; j++) {
+            if (traffic.site(j).line != 0 && Accounting::sameApi(traffic.site(j), site)) {
+                apiCalls += traffic.site(j).calls;
+                apiBytes += traffic.site(j).bytes;
+            }
+        }
+        if (!listed && apiCalls > 0)
+            std::cout << THISAIRCRAFT ":   " << std::string(site.call, site.apiLength) << " " << apiCalls / seconds
+                      << " calls/s, " << apiBytes / seconds << " bytes/s" << std::flush;
+    }
+    for (int i = 0; i < Accounting::MaxSites; i++) {
+        const Accounting::Site &site = traffic.site(i);
+        if (site.line != 0 && site.calls > 0)
+            std::cout << THISAIRCRAFT ":     line " << site.line << " " << std::string(site.call, site.apiLength) << " "
+                      << site.calls / seconds << " calls/s, " << site.bytes / seconds << " bytes/s" << std::flush;
+    }
+    for (int id = 0; id < Accounting::MaxReceiveIds; id++) {
+        for (int request = 0; request < Accounting::MaxRequests; request++) {
+            const Accounting::Received &packets = traffic.received(id, request);
+            const bool hasRequest = (id == SIMCONNECT_RECV_ID_SIMOBJECT_DATA
+                                     || id == SIMCONNECT_RECV_ID_CLIENT_DATA);
+            if (packets.packets > 0)
+                std::cout << THISAIRCRAFT ":   " << recv_id(id)
+                          << (!hasRequest ? "" : request == Accounting::MaxRequests - 1 ? " other requests"
+                              : " request " + std::to_string(RequestAllState + request)) << " "
+                          << packets.packets / seconds << " packets/s, " << packets.bytes / seconds << " bytes/s"
+                          << std::flush;
+        }
     }
+}
 
-    // Read our flight_model.cfg to avoid having to duplicate some information as magic numbers in this file.
-    ini_browse(flight_model_callback, NULL, ".\\SimObjects\\Airplanes\\" THISAIRCRAFT "\\flight_model.cfg");
+template <size_t N>
+static void addData(Subsystem subsystem, DataDefinition definition, const Datum (&data)[N],
+                    const float *epsilons = nullptr) {
+    for (size_t i = 0; i < N; i++)
+        RECORD(subsystem,
+               SimConnect_AddToDataDefinition(hSimConnect, definition, data[i].name, data[i].unit, data[i].type,
+                                              epsilons != nullptr ? epsilons[i] : data[i].epsilon));
+}
 
-    // Let's re-set this to false after each SimConnect_Open()
-    failed = false;
+static void setupConnection() {
+    RECORD(SubsystemConnection,
+           SimConnect_SubscribeToSystemEvent(hSimConnect, EventPause, "Pause"));
+    RECORD(SubsystemConnection,
+           SimConnect_SubscribeToSystemEvent(hSimConnect, EventFlightLoaded, "FlightLoaded"));
+}
 
-    // Most likely it is pointless to check the return values from these SimConnect calls. It seems that
-    // errors in parameters are reported asynchronously anyway as SIMCONNECT_RECV_ID_EXCEPTION.
+static void setupEvents() {
+    RECORD(SubsystemEvents,
+           SimConnect_MapClientEventToSimEvent(hSimConnect, EventFreezeAltSet, "FREEZE_ALTITUDE_SET"));
+    RECORD(SubsystemEvents,
+           SimConnect_MapClientEventToSimEvent(hSimConnect, EventFreezeAttSet, "FREEZE_ATTITUDE_SET"));
+    RECORD(SubsystemEvents,
+           SimConnect_MapClientEventToSimEvent(hSimConnect, EventFreezePosSet, "FREEZE_LATITUDE_LONGITUDE_SET"));
+    RECORD(SubsystemEvents,
+           SimConnect_MapClientEventToSimEvent(hSimConnect, EventParkingBrakeToggle, "PARKING_BRAKES"));
+
+    // A custom event that other SimConnect clients can send to have the trace written out
+    RECORD(SubsystemEvents,
+           SimConnect_MapClientEventToSimEvent(hSimConnect, EventWriteTrace, THISAIRCRAFT ".WriteTrace"));
+    RECORD(SubsystemEvents,
+           SimConnect_AddClientEventToNotificationGroup(hSimConnect, GroupCustom, EventWriteTrace));
+
+    // And one to start (data 1) and stop (data 0) recording, see Recorder
+    RECORD(SubsystemEvents,
+           SimConnect_MapClientEventToSimEvent(hSimConnect, EventRecord, THISAIRCRAFT ".Record"));
+    RECORD(SubsystemEvents,
+           SimConnect_AddClientEventToNotificationGroup(hSimConnect, GroupCustom, EventRecord));
+
+    RECORD(SubsystemEvents,
+           SimConnect_SetNotificationGroupPriority(hSimConnect, GroupCustom, SIMCONNECT_GROUP_PRIORITY_HIGHEST));
+}
 
-    RECORD(SimConnect_SubscribeToSystemEvent(hSimConnect, EventPause, "Pause"));
-
-    RECORD(SimConnect_MapClientEventToSimEvent(hSimConnect, EventFreezeAltSet, "FREEZE_ALTITUDE_SET"));
-    RECORD(SimConnect_MapClientEventToSimEvent(hSimConnect, EventFreezeAttSet, "FREEZE_ATTITUDE_SET"));
-    RECORD(SimConnect_MapClientEventToSimEvent(hSimConnect, EventFreezePosSet, "FREEZE_LATITUDE_LONGITUDE_SET"));
-    RECORD(SimConnect_MapClientEventToSimEvent(hSimConnect, EventParkingBrakeToggle, "PARKING_BRAKES"));
-
-    RECORD(SimConnect_AddToDataDefinition(hSimConnect, DataDefinitionAllState,
-                                          "RUDDER PEDAL POSITION", "position",
-                                          SIMCONNECT_DATATYPE_FLOAT64,
-                                          HUNDREDTH));
-    RECORD(SimConnect_AddToDataDefinition(hSimConnect, DataDefinitionAllState,
-                                          "AILERON POSITION", "position",
-                                          SIMCONNECT_DATATYPE_FLOAT64,
-                                          HUNDREDTH));
-    RECORD(SimConnect_AddToDataDefinition(hSimConnect, DataDefinitionAllState,
-                                          "ELEVATOR POSITION", "position",
-                                          SIMCONNECT_DATATYPE_FLOAT64,
-                                          HUNDREDTH));
-    RECORD(SimConnect_AddToDataDefinition(hSimConnect, DataDefinitionAllState,
-                                          "GENERAL ENG THROTTLE LEVER POSITION:1", "position",
-                                          SIMCONNECT_DATATYPE_FLOAT64,
-                                          HUNDREDTH));
-    RECORD(SimConnect_AddToDataDefinition(hSimConnect, DataDefinitionAllState,
-                                          "PLANE ALT ABOVE GROUND", "feet",
-                                          SIMCONNECT_DATATYPE_FLOAT64,
-                                          HUNDREDTH));
-
-    RECORD(SimConnect_AddToDataDefinition(hSimConnect, DataDefinitionAllState,
-                                          "RELATIVE WIND VELOCITY BODY X", "feet/second",
-                                          SIMCONNECT_DATATYPE_FLOAT64,
-                                          HUNDREDTH));
-    RECORD(SimConnect_AddToDataDefinition(hSimConnect, DataDefinitionAllState,
-                                          "RELATIVE WIND VELOCITY BODY Y", "feet/second",
-                                          SIMCONNECT_DATATYPE_FLOAT64,
-                                          HUNDREDTH));
-    RECORD(SimConnect_AddToDataDefinition(hSimConnect, DataDefinitionAllState,
-                                          "RELATIVE WIND VELOCITY BODY Z", "feet/second",
-                                          SIMCONNECT_DATATYPE_FLOAT64,
-                                          HUNDREDTH));
-
-    // Use only 64-bit types so that the sizes of the structs (without any packing pragmas) match what
-    // SimConnect wants.
-    RECORD(SimConnect_AddToDataDefinition(hSimConnect, DataDefinitionAllState,
-                                          "SIM ON GROUND", "boolean",
-                                          SIMCONNECT_DATATYPE_INT64));
-    RECORD(SimConnect_AddToDataDefinition(hSimConnect, DataDefinitionAllState,
-                                          "MASTER IGNITION SWITCH", "boolean",
-                                          SIMCONNECT_DATATYPE_INT64));
-    RECORD(SimConnect_AddToDataDefinition(hSimConnect, DataDefinitionAllState,
-                                          "BRAKE PARKING POSITION", "position",
-                                          SIMCONNECT_DATATYPE_FLOAT64,
-                                          0));
-    RECORD(SimConnect_AddToDataDefinition(hSimConnect, DataDefinitionAllState,
-                                          "IS ALTITUDE FREEZE ON", "boolean",
-                                          SIMCONNECT_DATATYPE_INT64));
-    RECORD(SimConnect_AddToDataDefinition(hSimConnect, DataDefinitionAllState,
-                                          "IS ATTITUDE FREEZE ON", "boolean",
-                                          SIMCONNECT_DATATYPE_INT64));
-    RECORD(SimConnect_AddToDataDefinition(hSimConnect, DataDefinitionAllState,
-                                          "IS LATITUDE LONGITUDE FREEZE ON", "boolean",
-                                          SIMCONNECT_DATATYPE_INT64));
-    RECORD(SimConnect_AddToDataDefinition(hSimConnect, DataDefinitionAllState,
-                                          "AMBIENT PRESSURE", "inHg",
-                                          SIMCONNECT_DATATYPE_FLOAT64));
-
-
-    for (auto definition: {DataDefinitionAllState, DataDefinitionMutableState}) {
-        RECORD(SimConnect_AddToDataDefinition(hSimConnect, definition,
-                                              "PLANE HEADING DEGREES TRUE", "radians",
-                                              SIMCONNECT_DATATYPE_FLOAT64,
-                                              0));
-        RECORD(SimConnect_AddToDataDefinition(hSimConnect, definition,
-                                              "PLANE BANK DEGREES", "radians",
-                                              SIMCONNECT_DATATYPE_FLOAT64,
-                                              10));
-        RECORD(SimConnect_AddToDataDefinition(hSimConnect, definition,
-                                              "PLANE PITCH DEGREES", "radians",
-                                              SIMCONNECT_DATATYPE_FLOAT64,
-                                              10));
-
-        RECORD(SimConnect_AddToDataDefinition(hSimConnect, definition,
-                                              "PLANE LATITUDE", "radians",
-                                              SIMCONNECT_DATATYPE_FLOAT64,
-                                              0));
-        RECORD(SimConnect_AddToDataDefinition(hSimConnect, definition,
-                                              "PLANE LONGITUDE", "radians",
-                                              SIMCONNECT_DATATYPE_FLOAT64,
-                                              0));
-        RECORD(SimConnect_AddToDataDefinition(hSimConnect, definition,
-                                              "PLANE ALTITUDE", "feet",
-                                              SIMCONNECT_DATATYPE_FLOAT64,
-                                              0));
-
-        RECORD(SimConnect_AddToDataDefinition(hSimConnect, definition,
-                                              "VELOCITY BODY X", "feet/second",
-                                              SIMCONNECT_DATATYPE_FLOAT64,
-                                              0));
-        RECORD(SimConnect_AddToDataDefinition(hSimConnect, definition,
-                                              "VELOCITY BODY Y", "feet/second",
-                                              SIMCONNECT_DATATYPE_FLOAT64,
-                                              0));
-        RECORD(SimConnect_AddToDataDefinition(hSimConnect, definition,
-                                              "VELOCITY BODY Z", "feet/second",
-                                              SIMCONNECT_DATATYPE_FLOAT64,
-                                              0));
-
-        RECORD(SimConnect_AddToDataDefinition(hSimConnect, definition,
-                                              "VELOCITY WORLD X", "feet/second",
-                                              SIMCONNECT_DATATYPE_FLOAT64,
-                                              0));
-        RECORD(SimConnect_AddToDataDefinition(hSimConnect, definition,
-                                              "VELOCITY WORLD Y", "feet/second",
-                                              SIMCONNECT_DATATYPE_FLOAT64,
-                                              0));
-        RECORD(SimConnect_AddToDataDefinition(hSimConnect, definition,
-                                              "VELOCITY WORLD Z", "feet/second",
-                                              SIMCONNECT_DATATYPE_FLOAT64,
-                                              0));
-
-        RECORD(SimConnect_AddToDataDefinition(hSimConnect, definition,
-                                              "AIRSPEED INDICATED", "knots",
-                                              SIMCONNECT_DATATYPE_FLOAT64,
-                                              10));
-        RECORD(SimConnect_AddToDataDefinition(hSimConnect, definition,
-                                              "AIRSPEED TRUE", "knots",
-                                              SIMCONNECT_DATATYPE_FLOAT64,
-                                              10));
-        RECORD(SimConnect_AddToDataDefinition(hSimConnect, definition,
-                                              "VERTICAL SPEED", "feet/minute",
-                                              SIMCONNECT_DATATYPE_FLOAT64,
-                                              10));
-    }
-
-    gotFirstState = false;
-    ignitionSwitch = false;
+static void setupAllState() {
+    addData(SubsystemAllState, DataDefinitionAllState, readonlyData, subscription.epsilons.data());
+    addData(SubsystemAllState, DataDefinitionAllState, mutableData,
+            subscription.epsilons.data() + sizeof(readonlyData) / sizeof(readonlyData[0]));
 
-    RECORD(SimConnect_RequestDataOnSimObject(hSimConnect,
+    RECORD(SubsystemAllState,
+           SimConnect_RequestDataOnSimObject(hSimConnect,
                                              RequestAllState, DataDefinitionAllState,
                                              SIMCONNECT_OBJECT_ID_USER, SIMCONNECT_PERIOD_SIM_FRAME,
                                              SIMCONNECT_DATA_REQUEST_FLAG_CHANGED, 0,
                                              0));
+}
 
-    RECORD(SimConnect_CallDispatch(hSimConnect, dispatchProc, NULL));
+// Ask for the state with other epsilons if the phase changed, or, less often, if the change rates did
+static void adaptSubscription(FlightPhase phase) {
+    const FrameClock::time_point now = FrameClock::now();
+    if (phase == PhaseCruising)
+        subscription.moved = now;
+    else if (phase == PhaseHovering && subscription.phase == PhaseCruising
+             && std::chrono::duration<double>(now - subscription.moved).count() < Subscription::CruisingSeconds)
+        phase = PhaseCruising;
+
+    std::array<float, AllStateFields> epsilons;
+    chooseEpsilons(phase, epsilons);
+
+    bool renegotiate = phase != subscription.phase;
+    if (!renegotiate
+        && std::chrono::duration<double>(now - subscription.renegotiated).count() >= Subscription::RetuneSeconds)
+        renegotiate = epsilons != subscription.epsilons;
+    if (!renegotiate || failed || hSimConnect == 0)
+        return;
+
+    subscription.phase = phase;
+    subscription.epsilons = epsilons;
+    subscription.renegotiated = now;
+    subscription.renegotiations++;
+    RECORD(SubsystemAllState,
+           SimConnect_ClearDataDefinition(hSimConnect, DataDefinitionAllState));
+    setupAllState();
+    if (verbose)
+        logSubscription();
 }
 
-static void deinitialize() {
+static void setupMutableState() {
+    addData(SubsystemMutableState, DataDefinitionMutableState, mutableData);
+
+    // A group is sent as the bytes from its first field on, so mutableFields must be in the order of the
+    // struct, which offsetof can not check at compile time for a member pointer
+    for (size_t i = 0; i < MutableFields; i++)
+        assert(reinterpret_cast<const char*>(&(outputEpsilons.*mutableFields[i]))
+               == reinterpret_cast<const char*>(&outputEpsilons) + i * sizeof(double));
+
+    for (const OutputGroup &group: outputGroups) {
+        for (size_t i = group.first; i < group.first + group.count; i++)
+            RECORD(SubsystemMutableState,
+                   SimConnect_AddToDataDefinition(hSimConnect, group.definition, mutableData[i].name,
+                                                  mutableData[i].unit, mutableData[i].type, mutableData[i].epsilon));
+    }
+
+    // New definitions, so send all of them before relying on what was sent
+    sentOutput.valid = false;
+}
+
+static void setupCommand() {
+    // The inbound command channel. We create the client data area, external clients write to it.
+    RECORD(SubsystemCommand,
+           SimConnect_MapClientDataNameToID(hSimConnect, THISAIRCRAFT ".Command", ClientDataCommand));
+    RECORD(SubsystemCommand,
+           SimConnect_CreateClientData(hSimConnect, ClientDataCommand, sizeof(CommandRecord),
+                                       SIMCONNECT_CREATE_CLIENT_DATA_FLAG_DEFAULT));
+    RECORD(SubsystemCommand,
+           SimConnect_AddToClientDataDefinition(hSimConnect, DataDefinitionCommand, 0, sizeof(CommandRecord)));
+
+    RECORD(SubsystemCommand,
+           SimConnect_RequestClientData(hSimConnect,
+                                        ClientDataCommand, RequestCommand, DataDefinitionCommand,
+                                        SIMCONNECT_CLIENT_DATA_PERIOD_ON_SET,
+                                        SIMCONNECT_CLIENT_DATA_REQUEST_FLAG_DEFAULT));
+}
+
+static void setupMetrics() {
+    // The outbound counters. We create the client data area and write it, external clients read it.
+    RECORD(SubsystemMetrics,
+           SimConnect_MapClientDataNameToID(hSimConnect, THISAIRCRAFT ".Metrics", ClientDataMetrics));
+    RECORD(SubsystemMetrics,
+           SimConnect_CreateClientData(hSimConnect, ClientDataMetrics, sizeof(MetricsRecord),
+                                       SIMCONNECT_CREATE_CLIENT_DATA_FLAG_READ_ONLY));
+    RECORD(SubsystemMetrics,
+           SimConnect_AddToClientDataDefinition(hSimConnect, DataDefinitionMetrics, 0, sizeof(MetricsRecord)));
+}
+
+// Re-create one subsystem on a connection that is otherwise fine
+static void resetSubsystem(Subsystem subsystem) {
+    switch (subsystem) {
+    case SubsystemConnection:
+        setupConnection();
+        break;
+    case SubsystemEvents:
+        setupEvents();
+        break;
+    case SubsystemAllState:
+        RECORD(SubsystemAllState,
+               SimConnect_ClearDataDefinition(hSimConnect, DataDefinitionAllState));
+        setupAllState();
+        break;
+    case SubsystemMutableState:
+        RECORD(SubsystemMutableState,
+               SimConnect_ClearDataDefinition(hSimConnect, DataDefinitionMutableState));
+        for (const OutputGroup &group: outputGroups)
+            RECORD(SubsystemMutableState,
+                   SimConnect_ClearDataDefinition(hSimConnect, group.definition));
+        setupMutableState();
+        break;
+    case SubsystemCommand:
+        RECORD(SubsystemCommand,
+               SimConnect_ClearClientDataDefinition(hSimConnect, DataDefinitionCommand));
+        setupCommand();
+        break;
+    case SubsystemMetrics:
+        RECORD(SubsystemMetrics,
+               SimConnect_ClearClientDataDefinition(hSimConnect, DataDefinitionMetrics));
+        setupMetrics();
+        break;
+    default:
+        assert(false);
+    }
+}
+
+static bool openConnection() {
+    if (!SUCCEEDED(SimConnect_Open(&hSimConnect, THISAIRCRAFT, nullptr, 0, 0, 0))) {
+        std::cerr << THISAIRCRAFT ": SimConnect_Open failed" << std::flush;
+        hSimConnect = 0;
+        return false;
+    }
+
+    // Packet IDs are per connection
+    calls.clear();
+    latestState.valid = false;
+    housekeeping.valid = false;
+
+    // Most likely it is pointless to check the return values from these SimConnect calls. It seems that
+    // errors in parameters are reported asynchronously anyway as SIMCONNECT_RECV_ID_EXCEPTION.
+
+    setupConnection();
+    setupEvents();
+    setupAllState();
+    setupMutableState();
+    setupCommand();
+    setupMetrics();
+
+    RECORD(SubsystemConnection,
+           SimConnect_CallDispatch(hSimConnect, controlPath->dispatch, NULL));
+
+    return true;
+}
+
+static void closeConnection() {
     if (hSimConnect == 0)
         return;
 
     // Effectively unsubscribe to this data by (re-)requesting it with a very high interval
-    RECORD(SimConnect_RequestDataOnSimObject(hSimConnect,
+    RECORD(SubsystemAllState,
+           SimConnect_RequestDataOnSimObject(hSimConnect,
                                              RequestAllState, DataDefinitionAllState,
                                              SIMCONNECT_OBJECT_ID_USER, SIMCONNECT_PERIOD_SIM_FRAME,
                                              SIMCONNECT_DATA_REQUEST_FLAG_CHANGED, 0,
                                              DWORD_MAX));
 
-    if (!SUCCEEDED(SimConnect_Close(hSimConnect))) {
+    RECORD(SubsystemCommand,
+           SimConnect_RequestClientData(hSimConnect,
+                                        ClientDataCommand, RequestCommand, DataDefinitionCommand,
+                                        SIMCONNECT_CLIENT_DATA_PERIOD_NEVER));
+
+    if (!SUCCEEDED(SimConnect_Close(hSimConnect)))
         std::cerr << THISAIRCRAFT ": SimConnect_Close failed" << std::flush;
+
+    hSimConnect = 0;
+}
+
+static void recover(RecoveryAction action, Subsystem subsystem) {
+    if (failed || action == RecoveryIgnore) {
+        recoveryStatistics.ignored++;
         return;
     }
 
-    hSimConnect = 0;
+    recoveryStarted();
+
+    if (action == RecoveryReset && ++recovery.resets > Recovery::MaxResets) {
+        if (verbose)
+            std::cout << THISAIRCRAFT ": Too many resets of the " << subsystem_name(subsystem) << " subsystem, re-opening" << std::flush;
+        action = RecoveryReopen;
+    }
+
+    switch (action) {
+    case RecoveryReset:
+        recoveryStatistics.resets++;
+        if (verbose)
+            std::cout << THISAIRCRAFT ": Re-creating the " << subsystem_name(subsystem) << " subsystem" << std::flush;
+        resetSubsystem(subsystem);
+        break;
+    case RecoveryReopen:
+        // Not here, we might be inside the dispatch procedure. See superviseConnection().
+        recovery.reopenPending = true;
+        break;
+    case RecoveryGiveUp:
+        std::cerr << THISAIRCRAFT ": Giving up, not controlling the aircraft any more" << std::flush;
+        failed = true;
+        break;
+    default:
+        assert(false);
+    }
+}
+
+// Called on each gauge update
+static void superviseConnection() {
+    if (recovery.framesSinceFailure >= 0)
+        recovery.framesSinceFailure++;
+
+    if (!recovery.reopenPending || failed)
+        return;
+
+    recovery.reopenPending = false;
+    if (++recovery.reopens > Recovery::MaxReopens) {
+        recover(RecoveryGiveUp, SubsystemConnection);
+        return;
+    }
+
+    const auto start = std::chrono::steady_clock::now();
+    closeConnection();
+    if (!openConnection()) {
+        // Try again next frame
+        recovery.reopenPending = true;
+        return;
+    }
+    const double milliSeconds = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+
+    recoveryStatistics.reopens++;
+    recoveryStatistics.lastReopenMilliSeconds = milliSeconds;
+    recoveryStatistics.maxReopenMilliSeconds = std::max(recoveryStatistics.maxReopenMilliSeconds, milliSeconds);
+    if (verbose)
+        std::cout << THISAIRCRAFT ": Re-opened the connection in " << std::fixed << std::setprecision(2) << milliSeconds << "ms"
+                  << ", reopens " << recoveryStatistics.reopens << " (max " << recoveryStatistics.maxReopenMilliSeconds << "ms)"
+                  << " resets " << recoveryStatistics.resets
+                  << " ignored " << recoveryStatistics.ignored << std::flush;
 }
 
-extern "C" MSFS_CALLBACK bool FlightModel_gauge_callback(FsContext ctx, int service_id, void* pData) {
+// Of the first gauge installed, as there is only one connection and one state for all of them
+static void initialize(const VariantConfiguration &variant, const ControlPath &variantPath) {
+    if (hSimConnect != 0)
+        return;
+
+    controlPath = loadConfiguration(variant) ? &controlPathOf<ConfiguredCurves> : &variantPath;
+
+    // Let's re-set this to false after each initialization
+    failed = false;
+    recovery = Recovery();
+
+    flight.stop();
+    ignitionSwitch = false;
+
+    readSnapshot();
+    startWarmUp();
+
+    subscription = Subscription();
+    chooseEpsilons(PhaseParked, subscription.epsilons);
+
+    // So that recordings say what is in the state records
+    std::string layout;
+    for (const auto &datum: readonlyData)
+        layout.append(datum.name).append(1, '\0').append(datum.unit).append(1, '\0');
+    for (const auto &datum: mutableData)
+        layout.append(datum.name).append(1, '\0').append(datum.unit).append(1, '\0');
+    Recorder::setLayout(layout);
+    if (FLYINGBRICK_RECORD)
+        Recorder::requestStart();
+
+    controlStart.reason = "gauge start";
+    controlStart.waiting = false;
+
+    // Periods in milliseconds, budgets in microseconds. Writing the trace and the recording are the slow
+    // ones, but only when there is something to write.
+    if (scheduler.tasksAdded() == 0) {
+        scheduler.add("parking brake", FrameWorkEssential, 250, 20, enforceParkingBrake);
+        scheduler.add("recorder", FrameWorkRecorder, 500, 300, Recorder::service);
+        scheduler.add("trace", FrameWorkDiagnostics, 100, 300, [] { Trace::writeIfRequested(); });
+        scheduler.add("traffic", FrameWorkStatistics, 10000, 400, logTraffic);
+        scheduler.add("statistics", FrameWorkStatistics, 30000, 200, logStatistics);
+        scheduler.add("metrics", FrameWorkStatistics, 1000, 50, publishMetrics);
+    }
+
+    openConnection();
+}
+
+static void deinitialize() {
+    closeConnection();
+
+    writeSnapshot();
+
+    Recorder::requestStop();
+    Recorder::service();
+
+    Trace::requestWrite("gauge killed");
+    Trace::writeIfRequested();
+}
+
+// One gauge per variant, see Variant.h. All that differs between them is the variant and its control path.
+static bool gaugeCallback(const VariantConfiguration &variant, const ControlPath &variantPath,
+                          int service_id) {
     switch (service_id) {
     case PANEL_SERVICE_PRE_INSTALL:
-        initialize();
+        initialize(variant, variantPath);
         break;
 
+    case PANEL_SERVICE_PRE_UPDATE: {
+        FrameSlice slice(frameBudget);
+        superviseConnection();
+        accountTraffic();
+        if (FLYINGBRICK_TICK)
+            controlPath->tick();
+        scheduler.run(frameBudget);
+        break;
+    }
+
     case PANEL_SERVICE_PRE_KILL:
         deinitialize();
         break;
@@ -994,3 +3167,18 @@ extern "C" MSFS_CALLBACK bool FlightModel_gauge_callback(FsContext ctx, int serv
 
     return true;
 }
+
+extern "C" MSFS_CALLBACK bool FlightModel_gauge_callback(FsContext /*ctx*/, int service_id, void* /*pData*/) {
+    return gaugeCallback(variantConfiguration<FlyingBrickVariant>,
+                         controlPathOf<VariantCurves<FlyingBrickVariant>>, service_id);
+}
+
+extern "C" MSFS_CALLBACK bool HeavyBrick_gauge_callback(FsContext /*ctx*/, int service_id, void* /*pData*/) {
+    return gaugeCallback(variantConfiguration<HeavyBrickVariant>,
+                         controlPathOf<VariantCurves<HeavyBrickVariant>>, service_id);
+}
+
+extern "C" MSFS_CALLBACK bool DemoBrick_gauge_callback(FsContext /*ctx*/, int service_id, void* /*pData*/) {
+    return gaugeCallback(variantConfiguration<DemoBrickVariant>,
+                         controlPathOf<VariantCurves<DemoBrickVariant>>, service_id);
+}
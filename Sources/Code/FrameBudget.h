@@ -0,0 +1,96 @@
+// -*- comment-column: 50; fill-column: 110; c-basic-offset: 4; tab-width: 4; indent-tabs-mode: nil -*-
+
+#pragma once
+
+#include <algorithm>
+#include <cstdint>
+
+#include "Trace.h"
+
+// A watchdog on how long the gauge takes each time the sim calls it, in the gauge update and in the dispatch
+// procedure. Each of those is a slice of the sim's own frame, and the control law's output has to get out
+// in it however much else there is to do. Call begin() on entry and end() on return, or have a FrameSlice.
+// Work that can wait asks allows() first, which says no once so much of the budget is used that the work
+// might push the slice over it. The kinds of work are shed in the order of FrameWork, the first one first:
+// diagnostic dumps are shed as soon as a slice is slow, telemetry only when it is nearly out of time.
+//
+// Shed work is resumed in a later slice. What the Scheduler runs stays due until there is time for it, and
+// what is per frame, like the StateBus snapshot, is simply done again with the next state. Dumps of a state
+// are not, as by then they would be about a state long gone.
+//
+// The timer is Trace::now(), the steady clock, two reads per slice and one per allows(). Slices that take
+// longer than the budget are counted, with the largest, as is each kind of work shed.
+
+enum FrameWork {
+    FrameWorkDiagnostics,                         // Dumps of the state, writing the trace
+    FrameWorkStatistics,                          // Logging counters and rates
+    FrameWorkRecorder,                            // Writing out the recording
+    FrameWorkTelemetry,                           // The StateBus snapshot for other gauges
+    FrameWorkEssential,                           // Never shed, like setting the state and the freezes
+    FrameWorkCount
+};
+
+class FrameBudget {
+public:
+    static constexpr int64_t BudgetNanoseconds = 1000000;
+
+    struct Statistics {
+        uint64_t slices;
+        uint64_t overruns;                        // Slices longer than the budget
+        int64_t maxNanoseconds;
+        uint64_t shed[FrameWorkCount];
+    };
+
+    FrameBudget() : start(0), depth(0), statistics_() {
+    }
+
+    // A call into the gauge by the sim. Nested ones, as when the dispatch procedure is called from within
+    // the gauge update, are part of the outer slice.
+    void begin() {
+        if (depth++ == 0)
+            start = Trace::now();
+    }
+
+    void end() {
+        if (--depth > 0)
+            return;
+        const int64_t nanoseconds = Trace::now() - start;
+        statistics_.slices++;
+        statistics_.overruns += nanoseconds > BudgetNanoseconds;
+        statistics_.maxNanoseconds = std::max(statistics_.maxNanoseconds, nanoseconds);
+    }
+
+    // Whether there is time for this kind of work in the slice. Outside begin() and end() there always is.
+    bool allows(FrameWork work) {
+        if (work == FrameWorkEssential || depth == 0)
+            return true;
+        if (Trace::now() - start < BudgetNanoseconds * (work + 1) / (FrameWorkEssential + 1))
+            return true;
+        statistics_.shed[work]++;
+        return false;
+    }
+
+    const Statistics &statistics() const {
+        return statistics_;
+    }
+
+private:
+    int64_t start;
+    int depth;
+    Statistics statistics_;
+};
+
+// begin() and end() for a scope
+class FrameSlice {
+public:
+    explicit FrameSlice(FrameBudget &budget) : budget(budget) {
+        budget.begin();
+    }
+
+    ~FrameSlice() {
+        budget.end();
+    }
+
+private:
+    FrameBudget &budget;
+};
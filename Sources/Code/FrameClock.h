@@ -0,0 +1,44 @@
+// -*- comment-column: 50; fill-column: 110; c-basic-offset: 4; tab-width: 4; indent-tabs-mode: nil -*-
+
+#pragma once
+
+#include <chrono>
+#include <cstdint>
+
+// The clock for everything that affects what we send to the sim, like the time between frames that the
+// control law integrates over. It is steady_clock, except in offline builds of the gauge (FLYINGBRICK_OFFLINE,
+// see Sources/Tools) where whoever drives the gauge sets it, so that replaying a recorded flight gives the
+// same output every time. Use Trace::now() for measuring how long our own code takes.
+
+#ifndef FLYINGBRICK_OFFLINE
+#define FLYINGBRICK_OFFLINE 0
+#endif
+
+class FrameClock {
+public:
+    typedef std::chrono::steady_clock::duration duration;
+    typedef std::chrono::steady_clock::time_point time_point;
+
+#if FLYINGBRICK_OFFLINE
+    static time_point now() {
+        return current;
+    }
+
+    static void set(int64_t nanoseconds) {
+        current = time_point(std::chrono::duration_cast<duration>(std::chrono::nanoseconds(nanoseconds)));
+    }
+
+private:
+    static time_point current;
+#else
+    static time_point now() {
+        return std::chrono::steady_clock::now();
+    }
+#endif
+
+public:
+    // For recordings
+    static int64_t nanoseconds(time_point time) {
+        return std::chrono::duration_cast<std::chrono::nanoseconds>(time.time_since_epoch()).count();
+    }
+};
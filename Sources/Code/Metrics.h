@@ -0,0 +1,39 @@
+// -*- comment-column: 50; fill-column: 110; c-basic-offset: 4; tab-width: 4; indent-tabs-mode: nil -*-
+
+#pragma once
+
+#include <cstdint>
+
+// Counters the gauge publishes about itself in the client data area named THISAIRCRAFT ".Metrics", once a
+// second whether or not it logs, so that an external client (a test driver, a dashboard) can read them
+// without the log. Like CommandRecord, the layout is the contract with those clients, so only append to it,
+// and use only 64-bit types.
+//
+// The gauge increments sequence for each record, and writes the same value in sequenceCheck after the
+// counters. A reader that sees the two differ has read a record in the middle of an update and should read
+// again. The counters are totals since the gauge was installed.
+
+struct MetricsRecord {
+    int64_t sequence;
+
+    // Recovery from SimConnect exceptions
+    int64_t exceptions;                           // Received
+    int64_t exceptionsIgnored;                    // Of those, harmless or not worth acting on
+    int64_t resets;                               // Subsystems re-created
+    int64_t reopens;                              // Connections closed and re-opened
+    int64_t recovered;                            // Times back in control after any of those
+    int64_t maxFramesToControl;                   // Gauge update frames that took, at most
+    double lastReopenMilliSeconds;
+    double maxReopenMilliSeconds;
+    int64_t failed;                               // Non-zero once the gauge gave up controlling the aircraft
+
+    // SimConnect traffic, from Accounting::totals()
+    int64_t calls;
+    int64_t callsFailed;
+    int64_t bytesSent;                            // Along with the calls, for SetDataOnSimObject and the like
+    int64_t packetsReceived;
+    int64_t bytesReceived;
+    int64_t otherRequests;                        // Data packets for a request that is not the gauge's
+
+    int64_t sequenceCheck;
+};
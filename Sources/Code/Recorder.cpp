@@ -0,0 +1,103 @@
+// -*- comment-column: 50; fill-column: 110; c-basic-offset: 4; tab-width: 4; indent-tabs-mode: nil -*-
+
+#include <cstring>
+#include <ctime>
+#include <iostream>
+
+#include "Recorder.h"
+
+#include "FrameClock.h"
+#include "ThisAircraft.h"
+
+std::string Recorder::layout;
+std::FILE *Recorder::file = nullptr;
+bool Recorder::startRequested = false;
+bool Recorder::stopRequested = false;
+
+char Recorder::buffer[BufferSize];
+size_t Recorder::used = 0;
+
+uint64_t Recorder::records = 0;
+uint64_t Recorder::dropped_ = 0;
+
+static size_t padded(size_t size) {
+    return (size + 7) & ~size_t(7);
+}
+
+void Recorder::setLayout(const std::string &layout_) {
+    layout = layout_;
+}
+
+void Recorder::requestStart() {
+    startRequested = true;
+    stopRequested = false;
+}
+
+void Recorder::requestStop() {
+    stopRequested = true;
+    startRequested = false;
+}
+
+void Recorder::add(RecordType type, const void *payload, uint32_t size) {
+    if (file == nullptr)
+        return;
+
+    const size_t needed = sizeof(RecordHeader) + padded(size);
+    if (used + needed > BufferSize) {
+        dropped_++;
+        return;
+    }
+
+    RecordHeader header = { type, size, FrameClock::nanoseconds(FrameClock::now()) };
+    std::memcpy(buffer + used, &header, sizeof(header));
+    std::memcpy(buffer + used + sizeof(header), payload, size);
+    std::memset(buffer + used + sizeof(header) + size, 0, padded(size) - size);
+    used += needed;
+    records++;
+}
+
+void Recorder::addEvent(const char *name, uint32_t data) {
+    RecordedEvent event = {};
+    event.data = data;
+    std::strncpy(event.name, name, sizeof(event.name) - 1);
+    add(RecordEvent, &event, sizeof(event));
+}
+
+void Recorder::write() {
+    if (used > 0 && std::fwrite(buffer, used, 1, file) != 1)
+        std::cerr << THISAIRCRAFT ": Could not write recording" << std::flush;
+    used = 0;
+}
+
+void Recorder::service() {
+    if (startRequested && file == nullptr) {
+        char fileName[100];
+        std::snprintf(fileName, sizeof(fileName), WORK_FOLDER "recording-%lld.bin", (long long)std::time(nullptr));
+
+        file = std::fopen(fileName, "wb");
+        if (file == nullptr) {
+            std::cerr << THISAIRCRAFT ": Could not create " << fileName << std::flush;
+        } else {
+            const RecordingHeader header = { RecordingHeader::Magic, RecordingHeader::CurrentVersion };
+            std::fwrite(&header, sizeof(header), 1, file);
+            used = 0;
+            records = dropped_ = 0;
+            add(RecordLayout, layout.data(), layout.size());
+            std::cout << THISAIRCRAFT ": Recording to " << fileName << std::flush;
+        }
+    }
+    startRequested = false;
+
+    if (file == nullptr)
+        return;
+
+    write();
+
+    if (stopRequested) {
+        std::fclose(file);
+        file = nullptr;
+        std::cout << THISAIRCRAFT ": Stopped recording, " << records << " records, " << dropped_ << " dropped"
+                  << std::flush;
+    }
+    stopRequested = false;
+}
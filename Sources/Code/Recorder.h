@@ -0,0 +1,96 @@
+// -*- comment-column: 50; fill-column: 110; c-basic-offset: 4; tab-width: 4; indent-tabs-mode: nil -*-
+
+#pragma once
+
+#include <cstdint>
+#include <cstdio>
+#include <string>
+
+// A recording of everything that drives the gauge: the state callbacks, the system events and the commands,
+// as received and with the time each was received, for replaying offline (see Sources/Tools), and of what
+// the gauge set in response, for analysing the flight. Recording is started and stopped with the custom event
+// THISAIRCRAFT ".Record" (data 1 to start, 0 to stop), or from the start if FLYINGBRICK_RECORD is defined
+// as 1. Each recording goes to a new file in the work folder.
+//
+// The file starts with a RecordingHeader, followed by records that each start with a RecordHeader. Payloads
+// are padded to a multiple of eight bytes, RecordHeader::size does not include the padding. All in the
+// byte order of the machine that wrote it, which for MSFS is little-endian.
+
+#ifndef FLYINGBRICK_RECORD
+#define FLYINGBRICK_RECORD 0
+#endif
+
+struct RecordingHeader {
+    static constexpr uint32_t Magic = 0x43524246;   // "FBRC"
+    static constexpr uint32_t CurrentVersion = 1;
+
+    uint32_t magic;
+    uint32_t version;
+};
+
+enum RecordType : uint32_t {
+    // The SimVars in the state records, in order. For each, the name and the unit, each NUL-terminated. All
+    // fields are eight bytes. Written first, so a recording can be read even after the state has changed.
+    RecordLayout = 1,
+
+    RecordState,                                  // The data of a state callback
+    RecordEvent,                                  // A RecordedEvent
+    RecordCommand,                                // A CommandRecord from the command channel
+
+    // What the gauge set in a frame, the MutableState. Its fields are the last ones of the state records. Not
+    // needed for replaying, but for comparing what we asked for with what the sim echoed back.
+    RecordOutput,
+};
+
+struct RecordHeader {
+    uint32_t type;
+    uint32_t size;                                // Of the payload
+    int64_t time;                                 // FrameClock, in nanoseconds
+};
+
+struct RecordedEvent {
+    uint32_t data;
+    char name[28];                                // The system event, like "Pause" or "FlightLoaded"
+};
+
+class Recorder {
+public:
+    // Records are collected here during frames and written out by service(). A second of state callbacks is
+    // around 15 kB.
+    static constexpr size_t BufferSize = 256 * 1024;
+
+    // The names and units of the state fields, see RecordLayout
+    static void setLayout(const std::string &layout);
+
+    static void requestStart();
+    static void requestStop();
+
+    static bool recording() {
+        return file != nullptr;
+    }
+
+    static void add(RecordType type, const void *payload, uint32_t size);
+    static void addEvent(const char *name, uint32_t data);
+
+    // Start, stop, or write out what was collected, as requested. Writing takes a while, so call this between
+    // frames, not in the middle of one.
+    static void service();
+
+    // Records lost because the buffer was full
+    static uint64_t dropped() {
+        return dropped_;
+    }
+
+private:
+    static std::string layout;
+    static std::FILE *file;
+    static bool startRequested, stopRequested;
+
+    static char buffer[BufferSize];
+    static size_t used;
+
+    static uint64_t records;
+    static uint64_t dropped_;
+
+    static void write();
+};
@@ -0,0 +1,215 @@
+// -*- comment-column: 50; fill-column: 110; c-basic-offset: 4; tab-width: 4; indent-tabs-mode: nil -*-
+
+#pragma once
+
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+
+#include "FrameBudget.h"
+#include "FrameClock.h"
+#include "Trace.h"
+
+// Runs housekeeping at rates of its own instead of on every frame, so that the frame's critical path has
+// only the control law in it. Each task has a period and a budget, the time it is expected to take. Call
+// run() once per frame; it runs the tasks that are due, as many as fit into the frame's budget, and leaves
+// the rest for the next frame. Tasks get phases of their own when added, so that tasks with the same period
+// do not all come due in the same frame.
+//
+// Due times are kept in a hierarchical timing wheel: Slots slots of Tick for the next Slots ticks, and Slots
+// slots of Slots ticks each for up to Slots * Slots ticks ahead. A task further out than that waits in the
+// last slot and is put back when it comes up. Both adding a due time and advancing by a tick take constant
+// time, there is no allocation, and the tasks live in a fixed-size array.
+//
+// What fits into a frame is decided on the declared budgets, not on how long tasks actually took, so that
+// offline replays (FLYINGBRICK_OFFLINE) run the same tasks in the same frames every time. How long they took
+// is kept in the statistics, to keep the budgets honest. On top of that, each task says what kind of work it
+// is, and one that the FrameBudget would shed waits for a later frame while the tasks behind it run.
+
+class Scheduler {
+public:
+    typedef void (*Function)();
+
+    static constexpr int MaxTasks = 16;
+    static constexpr int Slots = 64;
+    static constexpr int TickMilliSeconds = 10;   // About a frame
+    static constexpr int FrameBudgetMicroSeconds = 500;
+
+    struct Statistics {
+        const char *name;
+        FrameWork work;
+        double periodMilliSeconds;
+        double budgetMicroSeconds;
+        uint64_t runs;
+        uint64_t overruns;                        // Runs that took longer than the budget
+        uint64_t deferrals;                       // Frames it was due in but did not fit into
+        double maxMicroSeconds;
+    };
+
+    Scheduler() : tasks(), count(0), currentTick(-1), readyCount(0), readyFirst(0) {
+        std::fill(std::begin(wheel[0]), std::end(wheel[0]), -1);
+        std::fill(std::begin(wheel[1]), std::end(wheel[1]), -1);
+    }
+
+    // Returns false if there are MaxTasks tasks already. The name must be a string literal.
+    bool add(const char *name, FrameWork work, double periodMilliSeconds, double budgetMicroSeconds,
+             Function function) {
+        if (count == MaxTasks)
+            return false;
+        Task &task = tasks[count];
+        task = Task();
+        task.function = function;
+        task.periodTicks = std::max<int64_t>(1, int64_t(periodMilliSeconds / TickMilliSeconds + 0.5));
+        task.statistics.name = name;
+        task.statistics.work = work;
+        task.statistics.periodMilliSeconds = periodMilliSeconds;
+        task.statistics.budgetMicroSeconds = budgetMicroSeconds;
+
+        // Phases by the golden ratio spread any number of tasks evenly over the period
+        const double phase = count * 0.6180339887498949 - int(count * 0.6180339887498949);
+        task.dueTick = std::max<int64_t>(currentTick, 0) + 1 + int64_t(phase * task.periodTicks);
+        count++;
+        if (currentTick >= 0)
+            insert(count - 1);
+        return true;
+    }
+
+    // Run what is due, as much as fits into the frame
+    void run(FrameBudget &budget) {
+        const int64_t tick = ticks(FrameClock::now());
+        if (currentTick < 0) {
+            currentTick = tick;
+            for (int i = 0; i < count; i++) {
+                tasks[i].dueTick += tick;
+                insert(i);
+            }
+        }
+        // After a long pause, as when the gauge was not updated, there is no point in going through every
+        // tick missed
+        if (tick - currentTick > Slots * Slots)
+            rebuild(tick);
+        while (currentTick < tick)
+            advance();
+
+        double spent = 0;
+        int ran = 0;
+        for (int waiting = readyCount; waiting > 0; waiting--) {
+            const int index = ready[readyFirst];
+            Task &task = tasks[index];
+            readyFirst = (readyFirst + 1) % MaxTasks;
+            readyCount--;
+
+            // At least one task per frame, however large its budget. One that does not fit goes to the back,
+            // in the order they came due.
+            if ((ran > 0 && spent + task.statistics.budgetMicroSeconds > FrameBudgetMicroSeconds)
+                || !budget.allows(task.statistics.work)) {
+                ready[(readyFirst + readyCount++) % MaxTasks] = index;
+                continue;
+            }
+
+            const int64_t start = Trace::now();
+            {
+                TRACE_SCOPE(task.statistics.name);
+                task.function();
+            }
+            const double microSeconds = (Trace::now() - start) / 1000.0;
+            task.statistics.runs++;
+            task.statistics.overruns += microSeconds > task.statistics.budgetMicroSeconds;
+            task.statistics.maxMicroSeconds = std::max(task.statistics.maxMicroSeconds, microSeconds);
+            spent += task.statistics.budgetMicroSeconds;
+            ran++;
+
+            // On the period's grid, unless it fell behind by more than a period
+            task.dueTick += task.periodTicks;
+            if (task.dueTick <= currentTick)
+                task.dueTick = currentTick + task.periodTicks;
+            insert(index);
+        }
+        for (int i = 0; i < readyCount; i++)
+            tasks[ready[(readyFirst + i) % MaxTasks]].statistics.deferrals++;
+    }
+
+    int tasksAdded() const {
+        return count;
+    }
+
+    const Statistics &statistics(int task) const {
+        return tasks[task].statistics;
+    }
+
+private:
+    struct Task {
+        Function function;
+        int64_t periodTicks;
+        int64_t dueTick;
+        int next;                                 // In the same wheel slot, or -1
+        Statistics statistics;
+    };
+
+    Task tasks[MaxTasks];
+    int count;
+
+    int64_t currentTick;
+    int wheel[2][Slots];                          // The first task of each slot, or -1
+
+    int ready[MaxTasks];                          // A ring, in the order they came due
+    int readyCount, readyFirst;
+
+    static int64_t ticks(FrameClock::time_point time) {
+        return std::chrono::duration_cast<std::chrono::milliseconds>(time.time_since_epoch()).count()
+            / TickMilliSeconds;
+    }
+
+    void push(int slot[], int index, int position) {
+        tasks[index].next = slot[position];
+        slot[position] = index;
+    }
+
+    void insert(int index) {
+        Task &task = tasks[index];
+        const int64_t ahead = task.dueTick - currentTick;
+        if (ahead <= 0) {
+            ready[(readyFirst + readyCount++) % MaxTasks] = index;
+        } else if (ahead < Slots) {
+            push(wheel[0], index, int(task.dueTick % Slots));
+        } else {
+            // By the tick the slot of the second level comes up at, at most a whole turn of it ahead
+            const int64_t level1 = std::min(task.dueTick / Slots, currentTick / Slots + Slots - 1);
+            push(wheel[1], index, int(level1 % Slots));
+        }
+    }
+
+    void advance() {
+        currentTick++;
+
+        // Entering a new turn of the first level, bring down what is due in it
+        if (currentTick % Slots == 0) {
+            int index = wheel[1][(currentTick / Slots) % Slots];
+            wheel[1][(currentTick / Slots) % Slots] = -1;
+            while (index >= 0) {
+                const int next = tasks[index].next;
+                insert(index);
+                index = next;
+            }
+        }
+
+        int index = wheel[0][currentTick % Slots];
+        wheel[0][currentTick % Slots] = -1;
+        while (index >= 0) {
+            const int next = tasks[index].next;
+            insert(index);
+            index = next;
+        }
+    }
+
+    void rebuild(int64_t tick) {
+        std::fill(std::begin(wheel[0]), std::end(wheel[0]), -1);
+        std::fill(std::begin(wheel[1]), std::end(wheel[1]), -1);
+        readyCount = readyFirst = 0;
+        currentTick = tick;
+        for (int i = 0; i < count; i++) {
+            tasks[i].dueTick = std::max(tasks[i].dueTick, tick);
+            insert(i);
+        }
+    }
+};
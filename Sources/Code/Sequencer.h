@@ -0,0 +1,183 @@
+// -*- comment-column: 50; fill-column: 110; c-basic-offset: 4; tab-width: 4; indent-tabs-mode: nil -*-
+
+#pragma once
+
+#include <algorithm>
+#include <cstdint>
+
+// Resumable sequences that span frames, like taking off: freeze the sim, wait until the freeze flags read
+// back, set the aircraft motionless, climb until clear of the ground, then fly. Written as coroutines would
+// be in C++20, but as functions that switch on the step they are to resume at, as this is C++14.
+//
+// A sequence is a Body, indexed by its number in the table given to the Sequencer. Call resume() once per
+// frame. It runs the body of the active sequence from the step it is at, and the body returns what to do next:
+//
+// - yield(): done for this frame, resume at the same step next frame. This is how a sequence waits for a
+//   condition, checking it each frame. Frame::waited says for how many frames it has, for timeouts.
+// - yieldAt(step): done for this frame, resume at another step next frame.
+// - goTo(step): go on with another step in this frame.
+// - become(sequence): go on with another sequence in this frame, in place of this one, as from one phase of
+//   flight to the next.
+// - call(sequence, step): run another sequence, in this frame and as long as it takes, and then resume at
+//   step. Sequences can wait on each other this way.
+// - finish(): done, resume the caller, if any, in this frame.
+//
+// The frames of the sequences live in a fixed-size pool used as a stack, the active one on top, so a call
+// allocates nothing, and nothing is evaluated per frame but the steps of the active sequence. A call with
+// all frames in use is counted and skipped, as if the sequence called had finished at once. So are the steps
+// beyond MaxStepsPerFrame in a frame, which would be a sequence going in circles without ever yielding.
+
+template <typename Context>
+class Sequencer {
+public:
+    static constexpr int MaxFrames = 4;
+    static constexpr int MaxStepsPerFrame = 16;
+    static constexpr int None = -1;
+
+    enum Action {
+        ActionYield,
+        ActionContinue,
+        ActionCall,
+        ActionFinish
+    };
+
+    struct Frame {
+        int sequence;
+        int step;                                 // Where to resume, 0 when the sequence starts
+        int waited;                               // Frames that it yielded at this step so far
+        int64_t frames;                           // Frames since the sequence started
+        int callee;                               // For ActionCall
+
+        Action yield() {
+            return ActionYield;
+        }
+
+        Action yieldAt(int next) {
+            moveTo(next);
+            return ActionYield;
+        }
+
+        Action goTo(int next) {
+            moveTo(next);
+            return ActionContinue;
+        }
+
+        Action become(int next) {
+            sequence = next;
+            frames = 0;
+            moveTo(0);
+            return ActionContinue;
+        }
+
+        Action call(int next, int resumeAt) {
+            callee = next;
+            moveTo(resumeAt);
+            return ActionCall;
+        }
+
+        Action finish() {
+            return ActionFinish;
+        }
+
+    private:
+        friend class Sequencer;
+
+        bool moved;
+
+        void moveTo(int next) {
+            step = next;
+            waited = 0;
+            moved = true;
+        }
+    };
+
+    typedef Action (*Body)(Context &context, Frame &frame);
+
+    struct Statistics {
+        uint64_t started, stopped;                // Stopped with a sequence still active
+        uint64_t resumptions, steps;
+        int maxDepth;
+        uint64_t poolExhausted, runaways;
+    };
+
+    Sequencer(const Body *bodies, int count) : bodies(bodies), count(count), depth(0), statistics_() {
+    }
+
+    // Drop whatever is active and start the sequence
+    void start(int sequence) {
+        stop();
+        push(sequence);
+        statistics_.started++;
+    }
+
+    void stop() {
+        statistics_.stopped += depth > 0;
+        depth = 0;
+    }
+
+    void resume(Context &context) {
+        if (depth == 0)
+            return;
+        statistics_.resumptions++;
+        for (int steps = 0; depth > 0; steps++) {
+            Frame &frame = frames[depth - 1];
+            if (steps == MaxStepsPerFrame) {
+                statistics_.runaways++;
+                frame.frames++;
+                return;
+            }
+            statistics_.steps++;
+
+            frame.moved = false;
+            const Action action = bodies[frame.sequence](context, frame);
+            switch (action) {
+            case ActionYield:
+                frame.waited += !frame.moved;
+                for (int i = 0; i < depth; i++)
+                    frames[i].frames++;
+                return;
+            case ActionContinue:
+                break;
+            case ActionCall:
+                if (depth == MaxFrames)
+                    statistics_.poolExhausted++;
+                else
+                    push(frame.callee);
+                break;
+            case ActionFinish:
+                depth--;
+                break;
+            }
+        }
+    }
+
+    // The sequence at the bottom, the one that was started or what it became, or None
+    int sequence() const {
+        return depth > 0 ? frames[0].sequence : None;
+    }
+
+    // The one running, on top
+    int active() const {
+        return depth > 0 ? frames[depth - 1].sequence : None;
+    }
+
+    const Statistics &statistics() const {
+        return statistics_;
+    }
+
+private:
+    const Body *bodies;
+    int count;
+    Frame frames[MaxFrames];
+    int depth;
+    Statistics statistics_;
+
+    void push(int sequence) {
+        if (sequence < 0 || sequence >= count)
+            return;
+        Frame &frame = frames[depth++];
+        frame = Frame();
+        frame.sequence = sequence;
+        statistics_.maxDepth = std::max(statistics_.maxDepth, depth);
+    }
+};
@@ -0,0 +1,46 @@
+// -*- comment-column: 50; fill-column: 110; c-basic-offset: 4; tab-width: 4; indent-tabs-mode: nil -*-
+
+#include <cstring>
+
+#include "StateBus.h"
+
+std::atomic<uint32_t> StateBus::version(0);
+std::atomic<uint64_t> StateBus::snapshot[StateBus::Words];
+uint64_t StateBus::torn_ = 0;
+
+void StateBus::publish(const StateBusSnapshot &incoming) {
+    StateBusSnapshot stamped = incoming;
+    stamped.layoutVersion = StateBusSnapshot::LayoutVersion;
+    uint64_t words[Words];
+    std::memcpy(words, &stamped, sizeof(words));
+
+    // The version goes odd before any word changes, and even again after all of them have
+    version.fetch_add(1, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_release);
+    for (int i = 0; i < Words; i++)
+        snapshot[i].store(words[i], std::memory_order_relaxed);
+    version.fetch_add(1, std::memory_order_release);
+}
+
+bool StateBus::read(StateBusSnapshot &result) {
+    for (int attempt = 0; attempt < ReadAttempts; attempt++) {
+        const uint32_t before = version.load(std::memory_order_acquire);
+        if (before == 0)
+            return false;
+        if (before & 1)
+            continue;
+
+        uint64_t words[Words];
+        for (int i = 0; i < Words; i++)
+            words[i] = snapshot[i].load(std::memory_order_relaxed);
+
+        std::atomic_thread_fence(std::memory_order_acquire);
+        if (version.load(std::memory_order_relaxed) != before)
+            continue;
+
+        std::memcpy(&result, words, sizeof(result));
+        return true;
+    }
+    torn_++;
+    return false;
+}
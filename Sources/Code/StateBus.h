@@ -0,0 +1,83 @@
+// -*- comment-column: 50; fill-column: 110; c-basic-offset: 4; tab-width: 4; indent-tabs-mode: nil -*-
+
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <type_traits>
+
+// The controller's view of the aircraft, for other gauges in this module, so that an instrument can show
+// heading, speeds or vertical speed without SimConnect requests of its own for what the FlightModel gauge
+// already has. The FlightModel gauge publishes a snapshot once per frame; other gauges read it when they
+// draw, typically on PANEL_SERVICE_PRE_DRAW:
+//
+//     StateBusSnapshot snapshot;
+//     if (StateBus::read(snapshot) && snapshot.frame != lastFrame) ...
+//
+// There is one writer and any number of readers. It is a seqlock, so a reader never waits for the writer and
+// never gets a half-written snapshot: if it keeps catching the writer in the middle of an update, read()
+// fails and the reader keeps what it had. The snapshot is kept as words that are each copied with a relaxed
+// atomic load or store, so that a reader racing the writer is not a data race, only a read that fails.
+//
+// Only append to StateBusSnapshot, and bump LayoutVersion when doing so, so that a reader can check that it
+// was built against the same layout.
+
+struct StateBusSnapshot {
+    static constexpr uint32_t LayoutVersion = 1;
+
+    uint32_t layoutVersion;
+    uint32_t flags;                               // A bitmask of StateBusFlag
+    uint64_t frame;                               // Counts publishes, so readers can tell a new snapshot
+    int64_t time;                                 // FrameClock, in nanoseconds, when the state arrived
+
+    // As received from the sim in the frame
+    double heading, bank, pitch;                  // Radians
+    double lat, lon;                              // Radians
+    double msl, agl;                              // Feet
+    double kias, ktas;                            // Knots
+    double vs;                                    // Feet per minute
+    double rudder, aileron, elevator, throttle;   // The pilot's controls, as positions
+
+    // What the controller set in the frame, if it is in control
+    double outputHeading;
+    double outputMsl;
+    double outputVs;
+};
+
+enum StateBusFlag : uint32_t {
+    StateBusInControl = 1 << 0,                   // Ignition on, we set the state
+    StateBusOnGround = 1 << 1,
+    StateBusFrozen = 1 << 2,                      // We froze the sim
+    StateBusPaused = 1 << 3,
+    StateBusLanding = 1 << 4,
+    StateBusTakingOff = 1 << 5,
+};
+
+static_assert(sizeof(StateBusSnapshot) % sizeof(uint64_t) == 0, "the state bus copies snapshots as 64-bit words");
+static_assert(std::is_trivially_copyable<StateBusSnapshot>::value, "the state bus copies snapshots as bytes");
+
+class StateBus {
+public:
+    // Only the FlightModel gauge, once per frame
+    static void publish(const StateBusSnapshot &snapshot);
+
+    // Copy the latest snapshot into result if there is one and it could be read consistently. Returns false
+    // otherwise, in which case result is untouched.
+    static bool read(StateBusSnapshot &result);
+
+    // Reads that failed because the writer was in the middle of an update every time they tried
+    static uint64_t torn() {
+        return torn_;
+    }
+
+private:
+    static constexpr int ReadAttempts = 3;
+
+    static constexpr int Words = sizeof(StateBusSnapshot) / sizeof(uint64_t);
+
+    // Odd while the writer is updating the snapshot
+    static std::atomic<uint32_t> version;
+
+    static std::atomic<uint64_t> snapshot[Words];
+    static uint64_t torn_;
+};
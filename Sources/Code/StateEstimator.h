@@ -0,0 +1,171 @@
+// -*- comment-column: 50; fill-column: 110; c-basic-offset: 4; tab-width: 4; indent-tabs-mode: nil -*-
+
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <cmath>
+#include <cstdint>
+
+// Fuses the pose we command, position, altitude and heading, with the pose the sim echoes back in the state
+// callbacks. We set the pose every frame with the sim frozen, so the echo should be one of the last few poses
+// we sent, depending on how many frames the sim takes to apply them. When it is not, the sim has moved the
+// aircraft itself, by wind, a collision or the user repositioning it. Compared to the nearest of the poses
+// sent, on each axis:
+//
+// - A residual within the dead band is noise or a nudge, and the commanded pose stands.
+// - A residual beyond the snap limit on any axis means the aircraft was moved on purpose, and the commanded
+//   pose becomes the echo.
+// - In between the sim has overridden us. The commanded pose moves towards the echo by a fraction of the
+//   residual beyond the dead band per second, but no faster than a limit, so that it is never a hard snap.
+//
+// A complementary filter with a dead band, in other words: the commanded trajectory for the high frequencies
+// and the sim for the low ones. Everything is in fixed-size arrays, and each call takes constant time.
+
+struct EstimatorPose {
+    double lat, lon;                              // Radians
+    double msl;                                   // Feet
+    double heading;                               // Radians, true
+};
+
+class StateEstimator {
+public:
+    enum Axis { North, East, Up, Heading, Axes };
+
+    enum Result {
+        EstimatorNoHistory,                       // Nothing sent since reset(), nothing to compare with
+        EstimatorAgrees,
+        EstimatorCorrected,
+        EstimatorSnapped,
+    };
+
+    // The most poses sent to compare the echo with, so the most frames the sim may take to apply one
+    static constexpr int HistoryLength = 4;
+
+    // Per axis, in feet for North, East and Up and radians for Heading
+    struct Limits {
+        std::array<double, Axes> deadBand;
+        std::array<double, Axes> snap;
+        std::array<double, Axes> gain;            // Fraction of the residual beyond the dead band per second
+        std::array<double, Axes> maxRate;         // Per second
+    };
+
+    static Limits defaultLimits() {
+        return {
+            {{ 2, 2, 1, 0.01 }},
+            {{ 500, 500, 200, 0.5 }},
+            {{ 1, 1, 1, 1 }},
+            {{ 10, 10, 5, 0.1 }},
+        };
+    }
+
+    struct Statistics {
+        uint64_t frames;                          // fuse() calls with something to compare with
+        uint64_t corrected, snapped;
+        std::array<double, Axes> maxResidual;     // Beyond the dead band, of those not snapped
+        std::array<double, Axes> maxStep;         // Largest correction in a frame
+        std::array<double, Axes> maxStepChange;   // Largest change of the correction from one frame to the next
+    };
+
+    explicit StateEstimator(const Limits &limits = defaultLimits())
+        : limits(limits),
+          number(0),
+          current(0),
+          lastStep(),
+          statistics_()
+    {
+    }
+
+    // Forget what was sent, when we take control or stop controlling
+    void reset() {
+        number = 0;
+        lastStep.fill(0);
+    }
+
+    // Note the pose set into the sim in this frame
+    void sent(const EstimatorPose &pose) {
+        current = (current + 1) % HistoryLength;
+        history[current] = pose;
+        if (number < HistoryLength)
+            number++;
+    }
+
+    // Fuse the echo into the commanded pose, which is updated in place, before it is integrated further
+    Result fuse(EstimatorPose &commanded, const EstimatorPose &echo, double seconds) {
+        if (number == 0)
+            return EstimatorNoHistory;
+        statistics_.frames++;
+
+        // The sent pose nearest to the echo, and how far the echo is from it
+        std::array<double, Axes> residual;
+        double nearest = INFINITY;
+        for (int i = 0; i < number; i++) {
+            std::array<double, Axes> r;
+            difference(history[(current - i + HistoryLength) % HistoryLength], echo, r);
+            const double distance = r[North] * r[North] + r[East] * r[East] + r[Up] * r[Up];
+            if (distance < nearest) {
+                nearest = distance;
+                residual = r;
+            }
+        }
+
+        for (int axis = 0; axis < Axes; axis++) {
+            if (std::fabs(residual[axis]) > limits.snap[axis]) {
+                commanded = echo;
+                statistics_.snapped++;
+                reset();
+                return EstimatorSnapped;
+            }
+        }
+
+        std::array<double, Axes> step;
+        bool corrected = false;
+        for (int axis = 0; axis < Axes; axis++) {
+            const double beyond = std::fabs(residual[axis]) - limits.deadBand[axis];
+            step[axis] = 0;
+            if (beyond > 0) {
+                step[axis] = std::copysign(std::min(limits.gain[axis] * beyond, limits.maxRate[axis]) * seconds,
+                                           residual[axis]);
+                corrected = true;
+                statistics_.maxResidual[axis] = std::max(statistics_.maxResidual[axis], beyond);
+            }
+            statistics_.maxStep[axis] = std::max(statistics_.maxStep[axis], std::fabs(step[axis]));
+            statistics_.maxStepChange[axis] = std::max(statistics_.maxStepChange[axis],
+                                                       std::fabs(step[axis] - lastStep[axis]));
+        }
+        lastStep = step;
+        if (!corrected)
+            return EstimatorAgrees;
+
+        commanded.lat += step[North] / EarthRadiusFeet;
+        commanded.lon += step[East] / (EarthRadiusFeet * std::cos(commanded.lat));
+        commanded.msl += step[Up];
+        commanded.heading = std::fmod(commanded.heading + step[Heading] + 2 * M_PI, 2 * M_PI);
+        statistics_.corrected++;
+        return EstimatorCorrected;
+    }
+
+    const Statistics &statistics() const {
+        return statistics_;
+    }
+
+private:
+    static constexpr double EarthRadiusFeet = 20902231;
+
+    const Limits limits;
+
+    std::array<EstimatorPose, HistoryLength> history;
+    int number;
+    int current;
+
+    std::array<double, Axes> lastStep;
+    Statistics statistics_;
+
+    // From a to b, in feet and radians, with the heading difference in [-pi, pi)
+    static void difference(const EstimatorPose &a, const EstimatorPose &b, std::array<double, Axes> &result) {
+        result[North] = (b.lat - a.lat) * EarthRadiusFeet;
+        result[East] = (b.lon - a.lon) * std::cos(a.lat) * EarthRadiusFeet;
+        result[Up] = b.msl - a.msl;
+        result[Heading] = std::fmod(b.heading - a.heading + 3 * M_PI, 2 * M_PI) - M_PI;
+    }
+};
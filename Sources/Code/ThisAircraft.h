@@ -2,4 +2,21 @@
 
 #define THISAIRCRAFT "FlyingBrick"
 
+// Where the gauge reads the aircraft's own files from, and where it can write files that persist. Each
+// variant of the brick, see Variant.h, is an aircraft folder of its own in AIRPLANES_FOLDER. Offline builds
+// of the gauge (see Sources/Tools) point these to folders on the host, with "/" as the separator.
+#ifndef AIRPLANES_FOLDER
+#define AIRPLANES_FOLDER ".\\SimObjects\\Airplanes\\"
+#endif
+
+#ifndef FOLDER_SEPARATOR
+#define FOLDER_SEPARATOR "\\"
+#endif
+
+#define AIRCRAFT_FILE(aircraft, file) AIRPLANES_FOLDER aircraft FOLDER_SEPARATOR file
+
+#ifndef WORK_FOLDER
+#define WORK_FOLDER "\\work\\"
+#endif
+
 #include "FlyingBrick.h"
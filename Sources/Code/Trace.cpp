@@ -0,0 +1,78 @@
+// -*- comment-column: 50; fill-column: 110; c-basic-offset: 4; tab-width: 4; indent-tabs-mode: nil -*-
+
+#include <algorithm>
+#include <cstdio>
+#include <ctime>
+#include <iostream>
+
+#include "Trace.h"
+
+#include "ThisAircraft.h"
+
+std::array<TraceEvent, Trace::Capacity> Trace::events;
+uint64_t Trace::next = 0;
+
+const char *Trace::requestReason = nullptr;
+
+void Trace::requestWrite(const char *reason) {
+    if (requestReason == nullptr)
+        requestReason = reason;
+}
+
+bool Trace::writeIfRequested() {
+    // Don't flood the work folder if every frame is slow
+    static constexpr int64_t MinimumInterval = 10 * 1000000000LL;
+    static int64_t lastWritten = 0;
+    static int written = 0;
+
+    if (requestReason == nullptr)
+        return false;
+
+    const int64_t start = now();
+    if (written > 0 && start - lastWritten < MinimumInterval) {
+        requestReason = nullptr;
+        return false;
+    }
+
+    // Named by when the first one of this session was written, like the recordings, so that a new session
+    // does not overwrite the traces of the one before
+    static int64_t session = 0;
+    if (written == 0)
+        session = std::time(nullptr);
+
+    char fileName[100];
+    std::snprintf(fileName, sizeof(fileName), WORK_FOLDER "trace-%lld-%d.json", (long long)session, written);
+
+    std::FILE *file = std::fopen(fileName, "w");
+    if (file == nullptr) {
+        std::cerr << THISAIRCRAFT ": Could not create " << fileName << std::flush;
+        requestReason = nullptr;
+        return false;
+    }
+
+    // In the order they ended. Timestamps are in microseconds, relative to the earliest start, which is not
+    // necessarily that of the first event, as enclosing scopes end after the ones inside them.
+    const uint64_t count = next < Capacity ? next : Capacity;
+    const uint64_t first = next - count;
+    int64_t origin = count > 0 ? events[first & (Capacity - 1)].start : 0;
+    for (uint64_t i = first; i < next; i++)
+        origin = std::min(origin, events[i & (Capacity - 1)].start);
+
+    std::fprintf(file, "{\"displayTimeUnit\":\"ns\",\"otherData\":{\"reason\":\"%s\"},\"traceEvents\":[\n", requestReason);
+    for (uint64_t i = first; i < next; i++) {
+        const TraceEvent &event = events[i & (Capacity - 1)];
+        std::fprintf(file, "%s{\"name\":\"%s\",\"ph\":\"X\",\"pid\":1,\"tid\":1,\"ts\":%.3f,\"dur\":%.3f}\n",
+                     i == first ? "" : ",",
+                     event.name, (event.start - origin) / 1000.0, event.duration / 1000.0);
+    }
+    std::fprintf(file, "]}\n");
+    std::fclose(file);
+
+    std::cout << THISAIRCRAFT ": Wrote " << count << " trace events to " << fileName << " (" << requestReason << ") in "
+              << (now() - start) / 1000 << "us" << std::flush;
+
+    lastWritten = now();
+    written++;
+    requestReason = nullptr;
+    return true;
+}
@@ -0,0 +1,85 @@
+// -*- comment-column: 50; fill-column: 110; c-basic-offset: 4; tab-width: 4; indent-tabs-mode: nil -*-
+
+#pragma once
+
+#include <array>
+#include <chrono>
+#include <cstdint>
+
+// A timeline of what happens in each frame, for finding out why a specific frame was slow. Put
+// TRACE_SCOPE("name") at the start of a block to record how long the rest of the block takes. Events go into
+// a fixed-size ring that is written out in Chrome's trace event JSON format, which also the Perfetto UI reads,
+// when asked for with Trace::requestWrite().
+//
+// With FLYINGBRICK_TRACE defined as 0 the markers compile to nothing. Enabled, a marker costs two clock reads
+// and a store into the ring, so it is on by default and traces can be captured from normal flights.
+
+#ifndef FLYINGBRICK_TRACE
+#define FLYINGBRICK_TRACE 1
+#endif
+
+struct TraceEvent {
+    const char *name;                             // Must be a string literal or otherwise live forever
+    int64_t start;                                // Nanoseconds, steady_clock
+    int64_t duration;
+};
+
+class Trace {
+public:
+    // A power of two. A frame produces around ten events, so this covers several seconds.
+    static constexpr int Capacity = 8192;
+
+    static int64_t now() {
+        return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+    }
+
+    static void add(const char *name, int64_t start, int64_t end) {
+        TraceEvent &event = events[next++ & (Capacity - 1)];
+        event.name = name;
+        event.start = start;
+        event.duration = end - start;
+    }
+
+    // Ask for the ring to be written out the next time writeIfRequested() is called. Writing takes a while,
+    // so it should not be done in the middle of a frame we want to see in the trace.
+    static void requestWrite(const char *reason);
+
+    // Write the trace to a new file in the work folder if requested, and if the previous one was not written
+    // too recently. Returns whether a file was written.
+    static bool writeIfRequested();
+
+private:
+    static std::array<TraceEvent, Capacity> events;
+    static uint64_t next;
+
+    static const char *requestReason;
+};
+
+class TraceScope {
+private:
+    const char *name;
+    int64_t start;
+
+public:
+    explicit TraceScope(const char *name_)
+        : name(name_),
+          start(Trace::now())
+    {
+    }
+
+    ~TraceScope() {
+        Trace::add(name, start, Trace::now());
+    }
+
+    TraceScope(const TraceScope&) = delete;
+    TraceScope& operator=(const TraceScope&) = delete;
+};
+
+#define TRACE_CONCAT_(a, b) a##b
+#define TRACE_CONCAT(a, b) TRACE_CONCAT_(a, b)
+
+#if FLYINGBRICK_TRACE
+#define TRACE_SCOPE(name) TraceScope TRACE_CONCAT(traceScope, __LINE__)(name)
+#else
+#define TRACE_SCOPE(name) do { } while (0)
+#endif
@@ -0,0 +1,158 @@
+// -*- comment-column: 50; fill-column: 110; c-basic-offset: 4; tab-width: 4; indent-tabs-mode: nil -*-
+
+#pragma once
+
+#include <cmath>
+
+#include "ResponseCurve.h"
+#include "ThisAircraft.h"
+
+// The bricks one module can fly. Each is a traits struct with its name, the files its configuration is read
+// from, and how fast the pilot's axes make it go, and an aircraft of its own in PackageSources. The module
+// has a gauge for each, see the gauge callbacks at the end of FlyingBrick.cpp, and the panel.cfg of an
+// aircraft picks its brick by the gauge it installs:
+//
+//   htmlgauge00 = WasmInstrument/WasmInstrument.html?wasm_module=FlyingBrick.wasm&wasm_gauge=HeavyBrick, ...
+//
+// The gauges share the module's state, so a panel should have only one of them, which is what an aircraft
+// would have anyway. The other bricks have the FlyingBrick as the base_container in their aircraft.cfg, so
+// they have its body, and the sim and the gauge both read its flight_model.cfg.
+//
+// The response curves of each variant are built at compile time into tables of their own, see
+// VariantControl, and the gauge of the variant gets a control path of its own with them constant-folded in,
+// so that its control inputs come with no lookup of what variant it is. The [FLYING_BRICK_RESPONSE] section
+// of aircraft.cfg can still override them, and then the gauge uses tables built at run time instead.
+// Sources/Tools/Variants.cpp checks that both give the same inputs.
+
+struct FlyingBrickVariant {
+    static constexpr const char *name() {
+        return THISAIRCRAFT;
+    }
+
+    static constexpr const char *flightModelFile() {
+        return AIRCRAFT_FILE(THISAIRCRAFT, "flight_model.cfg");
+    }
+
+    static constexpr const char *aircraftFile() {
+        return AIRCRAFT_FILE(THISAIRCRAFT, "aircraft.cfg");
+    }
+
+    // Full deflection of each axis. Arbitrary choices.
+    static constexpr double YawDegreesPerSecond = 45;
+    static constexpr double ForwardKnots = 100;
+    static constexpr double BackwardKnots = 50;
+    static constexpr double SidewaysKnots = 50;
+    static constexpr double ClimbFeetPerMinute = 1000;
+
+    // Of the stick, as a fraction of its half range, and of the throttle around 50%, in the curve's -1..1
+    static constexpr double StickDeadZone = 0.01;
+    static constexpr double ThrottleDeadZone = 0.1;
+};
+
+// Slow and steady, for sightseeing and precise parking
+struct HeavyBrickVariant {
+    static constexpr const char *name() {
+        return "HeavyBrick";
+    }
+
+    static constexpr const char *flightModelFile() {
+        return AIRCRAFT_FILE(THISAIRCRAFT, "flight_model.cfg");
+    }
+
+    static constexpr const char *aircraftFile() {
+        return AIRCRAFT_FILE("HeavyBrick", "aircraft.cfg");
+    }
+
+    static constexpr double YawDegreesPerSecond = 20;
+    static constexpr double ForwardKnots = 60;
+    static constexpr double BackwardKnots = 30;
+    static constexpr double SidewaysKnots = 30;
+    static constexpr double ClimbFeetPerMinute = 500;
+    static constexpr double StickDeadZone = 0.02;
+    static constexpr double ThrottleDeadZone = 0.1;
+};
+
+// For showing off
+struct DemoBrickVariant {
+    static constexpr const char *name() {
+        return "DemoBrick";
+    }
+
+    static constexpr const char *flightModelFile() {
+        return AIRCRAFT_FILE(THISAIRCRAFT, "flight_model.cfg");
+    }
+
+    static constexpr const char *aircraftFile() {
+        return AIRCRAFT_FILE("DemoBrick", "aircraft.cfg");
+    }
+
+    static constexpr double YawDegreesPerSecond = 90;
+    static constexpr double ForwardKnots = 250;
+    static constexpr double BackwardKnots = 100;
+    static constexpr double SidewaysKnots = 100;
+    static constexpr double ClimbFeetPerMinute = 3000;
+    static constexpr double StickDeadZone = 0.01;
+    static constexpr double ThrottleDeadZone = 0.05;
+};
+
+// In the units of the control law, radians and feet per second, converted as FlyingBrick.cpp does
+template <typename Variant>
+constexpr ResponseCurveDefinitions variantResponseCurves() {
+    constexpr double yaw = Variant::YawDegreesPerSecond / 180 * M_PI;
+    constexpr double forward = Variant::ForwardKnots * 1.68781042021544;
+    constexpr double backward = Variant::BackwardKnots * 1.68781042021544;
+    constexpr double sideways = Variant::SidewaysKnots * 1.68781042021544;
+    constexpr double climb = Variant::ClimbFeetPerMinute / 60;
+    constexpr double dead = Variant::ThrottleDeadZone;
+
+    return {
+        // Rudder: yaw rate
+        { -1, 1, 0, 0, 2, { { -1, -yaw }, { 1, yaw } } },
+
+        // Stick tilted sideways: aileron input, set speed sideways
+        { -1, 1, Variant::StickDeadZone, 0, 2, { { -1, -sideways }, { 1, sideways } } },
+
+        // Stick pushed forward: negative elevator input, set speed forward. Stick pulled back: positive
+        // elevator input, set speed backward.
+        { -1, 1, Variant::StickDeadZone, 0, 3, { { -1, forward }, { 0, 0 }, { 1, -backward } } },
+
+        // Full throttle climbs, zero throttle descends, with a dead zone around 50% that is in the points so
+        // that the climb or descent starts from zero at its edges
+        { 0, 1, 0, 0, 4, { { -1, -climb }, { -dead, 0 }, { dead, 0 }, { 1, climb } } },
+    };
+}
+
+// The control inputs of a variant from the axes, with its curves as constant tables
+template <typename Variant>
+class VariantControl {
+public:
+    template <typename Inputs>
+    static void axes2inputs(double rudder, double aileron, double elevator, double throttle, Inputs &inputs) {
+        inputs.yawRate = rudderCurve(rudder);
+        inputs.velBodyX = aileronCurve(aileron);
+        inputs.velBodyZ = elevatorCurve(elevator);
+        inputs.verticalSpeed = throttleCurve(throttle);
+    }
+
+    static double verticalSpeed(double throttle) {
+        return throttleCurve(throttle);
+    }
+
+private:
+    static constexpr ResponseCurveDefinitions definitions = variantResponseCurves<Variant>();
+    static constexpr ResponseCurve rudderCurve = ResponseCurve(definitions.rudder);
+    static constexpr ResponseCurve aileronCurve = ResponseCurve(definitions.aileron);
+    static constexpr ResponseCurve elevatorCurve = ResponseCurve(definitions.elevator);
+    static constexpr ResponseCurve throttleCurve = ResponseCurve(definitions.throttle);
+};
+
+template <typename Variant>
+constexpr ResponseCurveDefinitions VariantControl<Variant>::definitions;
+template <typename Variant>
+constexpr ResponseCurve VariantControl<Variant>::rudderCurve;
+template <typename Variant>
+constexpr ResponseCurve VariantControl<Variant>::aileronCurve;
+template <typename Variant>
+constexpr ResponseCurve VariantControl<Variant>::elevatorCurve;
+template <typename Variant>
+constexpr ResponseCurve VariantControl<Variant>::throttleCurve;
@@ -0,0 +1,548 @@
+// -*- comment-column: 50; fill-column: 110; c-basic-offset: 4; tab-width: 4; indent-tabs-mode: nil -*-
+
+// Scans recordings (see Sources/Code/Recorder.h) for stutter and for how well the sim follows what the gauge
+// sets, to find out under which conditions the stutter near the ground happens in real flights. Build this,
+// from the top of the repository, with:
+//
+//   g++ -std=c++14 -O3 -march=native -ISources/Code Sources/Tools/Analyze.cpp -o analyze
+//
+// Usage: analyze [-j jobs] [-g near ground feet] [-p jump feet] recording...
+//
+// Each recording is scanned in a process of its own, up to jobs at a time (by default as many as there are
+// processors). Its state records are read into columns, one array per SimVar used, and each measure is a
+// plain loop over those arrays that the compiler can vectorize. For each recording, and for all of them
+// together, it reports:
+//
+// - The time between state callbacks, in milliseconds.
+// - The error: how far the echoed position is from the nearest of the last four positions the gauge set, in
+//   feet. Only recordings made with RecordOutput records have it.
+// - Jumps: how far the aircraft moved away from where its velocity in the frame before would have taken it,
+//   in feet, and how many times by more than the jump distance (1 ft by default).
+// - The change of heading from one frame to the next, in degrees.
+// - The vertical jerk, in ft/s³, from the altitude in each frame.
+// - How many times the freeze flags and SIM ON GROUND changed, and bursts: a freeze flag changing again
+//   within a second, which is the gauge going back and forth between controlling the aircraft and not.
+//
+// For all recordings together the distributions are given as percentiles, separately for the frames near
+// the ground (AGL below 20 ft by default) and the others. Each jump is also counted by what else went on
+// then: near the ground, after a callback that came late (more than one and a half times the median
+// interval), and within a second of a freeze flag changing. The percentiles come from histograms with 20
+// buckets per decade, so they are within about 12%; the largest values are exact.
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <vector>
+
+#include <poll.h>
+#include <sys/wait.h>
+
+#include "Recording.h"
+
+namespace {
+
+struct Options {
+    int jobs = 0;
+    double nearGroundFeet = 20;
+    double jumpFeet = 1;
+    std::vector<std::string> recordings;
+};
+
+Options options;
+
+static constexpr double EarthRadiusFeet = 20902231;
+
+// Values from 10^FirstDecade to 10^(FirstDecade + Decades), logarithmically, and those outside in the first
+// and last bucket. Mergeable across recordings by adding the counts.
+struct Histogram {
+    static constexpr int FirstDecade = -3;
+    static constexpr int Decades = 9;
+    static constexpr int PerDecade = 20;
+    static constexpr int Buckets = Decades * PerDecade + 2;
+
+    uint64_t counts[Buckets];
+    uint64_t total;
+    double max;
+
+    void add(double value) {
+        const double position = (std::log10(std::max(value, 1e-300)) - FirstDecade) * PerDecade;
+        const int bucket = position < 0 ? 0 : position >= Decades * PerDecade ? Buckets - 1 : 1 + int(position);
+        counts[bucket]++;
+        total++;
+        max = std::max(max, value);
+    }
+
+    void merge(const Histogram &other) {
+        for (int i = 0; i < Buckets; i++)
+            counts[i] += other.counts[i];
+        total += other.total;
+        max = std::max(max, other.max);
+    }
+
+    // The upper end of the bucket the fraction of values are in, or the largest value for 1
+    double percentile(double fraction) const {
+        if (total == 0)
+            return 0;
+        if (fraction >= 1)
+            return max;
+        const uint64_t rank = uint64_t(fraction * total);
+        uint64_t seen = 0;
+        for (int i = 0; i < Buckets; i++) {
+            seen += counts[i];
+            if (seen > rank)
+                return i == Buckets - 1 ? max : std::min(max, std::pow(10.0, FirstDecade + double(i) / PerDecade));
+        }
+        return max;
+    }
+};
+
+enum Measure {
+    MeasureInterval,                              // Milliseconds
+    MeasureError,                                 // Feet
+    MeasureJump,                                  // Feet
+    MeasureHeadingStep,                           // Degrees
+    MeasureJerk,                                  // ft/s³
+    Measures,
+};
+
+const char *const measureNames[] = { "interval ms", "error ft", "jump ft", "heading step deg", "jerk ft/s3" };
+
+enum Where { Airborne, NearGround, Places };
+
+const char *const toggledFlags[] = {
+    "IS ALTITUDE FREEZE ON",
+    "IS ATTITUDE FREEZE ON",
+    "IS LATITUDE LONGITUDE FREEZE ON",
+    "SIM ON GROUND",
+};
+
+static constexpr int ToggledFlags = sizeof(toggledFlags) / sizeof(toggledFlags[0]);
+static constexpr int FreezeFlags = 3;
+
+// What the scan of a recording sends back, so fixed-size
+struct Summary {
+    bool ok;
+    bool truncated;
+    bool hasOutput;
+    char error[200];
+
+    uint64_t bytes;
+    uint64_t states;
+    double seconds;
+
+    Histogram histograms[Measures][Places];
+
+    uint64_t toggles[ToggledFlags];
+    uint64_t bursts, burstsNearGround;
+
+    uint64_t jumps;
+    uint64_t jumpsNearGround, jumpsAfterLateCallback, jumpsNearToggle;
+    double worstJumpAt;                           // Seconds into the recording
+};
+
+// The state records in columns, with the fields used
+struct Columns {
+    std::vector<double> time;                     // Seconds since the first state
+    std::vector<double> lat, lon, msl, heading;   // Radians and feet
+    std::vector<double> velWorldX, velWorldY, velWorldZ;
+    std::vector<double> agl;
+    std::vector<double> flags[ToggledFlags];
+
+    // What the gauge set, at the time it did
+    std::vector<double> outputTime, outputLat, outputLon, outputMsl;
+};
+
+// All fields of the state are eight bytes, and the flags are integers
+double field(const char *payload, uint32_t size, int index, bool integer = false) {
+    if (index < 0 || uint32_t(index + 1) * 8 > size)
+        return NAN;
+    if (integer) {
+        int64_t value;
+        std::memcpy(&value, payload + index * 8, 8);
+        return double(value);
+    }
+    double value;
+    std::memcpy(&value, payload + index * 8, 8);
+    return value;
+}
+
+int fieldIndex(const Recording &recording, const char *name) {
+    for (size_t i = 0; i < recording.names.size(); i++) {
+        if (recording.names[i] == name)
+            return int(i);
+    }
+    return -1;
+}
+
+bool readColumns(Recording &recording, Columns &columns, std::string &error) {
+    const int lat = fieldIndex(recording, "PLANE LATITUDE"), lon = fieldIndex(recording, "PLANE LONGITUDE"),
+        msl = fieldIndex(recording, "PLANE ALTITUDE"), heading = fieldIndex(recording, "PLANE HEADING DEGREES TRUE"),
+        velWorldX = fieldIndex(recording, "VELOCITY WORLD X"), velWorldY = fieldIndex(recording, "VELOCITY WORLD Y"),
+        velWorldZ = fieldIndex(recording, "VELOCITY WORLD Z"), agl = fieldIndex(recording, "PLANE ALT ABOVE GROUND");
+    int flags[ToggledFlags];
+    for (int i = 0; i < ToggledFlags; i++)
+        flags[i] = fieldIndex(recording, toggledFlags[i]);
+    if (lat < 0 || lon < 0 || msl < 0 || heading < 0 || velWorldX < 0 || velWorldY < 0 || velWorldZ < 0 || agl < 0) {
+        error = "the recording has no pose";
+        return false;
+    }
+
+    Recording::Record record;
+    int64_t firstTime = 0;
+    bool first = true;
+    while (recording.next(record)) {
+        if (record.type == RecordState) {
+            if (first)
+                firstTime = record.time;
+            first = false;
+            columns.time.push_back((record.time - firstTime) / 1e9);
+            columns.lat.push_back(field(record.payload, record.size, lat));
+            columns.lon.push_back(field(record.payload, record.size, lon));
+            columns.msl.push_back(field(record.payload, record.size, msl));
+            columns.heading.push_back(field(record.payload, record.size, heading));
+            columns.velWorldX.push_back(field(record.payload, record.size, velWorldX));
+            columns.velWorldY.push_back(field(record.payload, record.size, velWorldY));
+            columns.velWorldZ.push_back(field(record.payload, record.size, velWorldZ));
+            columns.agl.push_back(field(record.payload, record.size, agl));
+            for (int i = 0; i < ToggledFlags; i++)
+                columns.flags[i].push_back(field(record.payload, record.size, flags[i], true));
+        } else if (record.type == RecordOutput && !first) {
+            // The last fields of the state
+            const int offset = int(recording.names.size()) - int(record.size / 8);
+            columns.outputTime.push_back((record.time - firstTime) / 1e9);
+            columns.outputLat.push_back(field(record.payload, record.size, lat - offset));
+            columns.outputLon.push_back(field(record.payload, record.size, lon - offset));
+            columns.outputMsl.push_back(field(record.payload, record.size, msl - offset));
+        }
+    }
+    return true;
+}
+
+double median(std::vector<double> values) {
+    if (values.empty())
+        return 0;
+    std::nth_element(values.begin(), values.begin() + values.size() / 2, values.end());
+    return values[values.size() / 2];
+}
+
+Summary analyze(const std::string &fileName) {
+    Summary summary = {};
+    Recording recording;
+    std::string error;
+    Columns columns;
+    if (!recording.open(fileName, error) || !readColumns(recording, columns, error)) {
+        std::snprintf(summary.error, sizeof(summary.error), "%s", error.c_str());
+        return summary;
+    }
+    summary.ok = true;
+    summary.truncated = recording.truncated();
+    summary.hasOutput = !columns.outputTime.empty();
+
+    const size_t n = columns.time.size();
+    summary.states = n;
+    summary.seconds = n > 0 ? columns.time.back() : 0;
+    if (n < 4)
+        return summary;
+
+    // Positions in feet, north, east and up, and the measures for each frame from the second on. Each loop
+    // only reads columns and writes one.
+    const double *lat = columns.lat.data(), *lon = columns.lon.data(), *msl = columns.msl.data();
+    const double *time = columns.time.data();
+    std::vector<double> north(n), east(n), interval(n), jump(n), headingStep(n), jerk(n, NAN);
+    for (size_t i = 0; i < n; i++) {
+        north[i] = lat[i] * EarthRadiusFeet;
+        east[i] = lon[i] * EarthRadiusFeet * std::cos(lat[i]);
+    }
+    interval[0] = 0;
+    for (size_t i = 1; i < n; i++)
+        interval[i] = time[i] - time[i - 1];
+    jump[0] = headingStep[0] = 0;
+    for (size_t i = 1; i < n; i++) {
+        const double dn = north[i] - (north[i - 1] + columns.velWorldZ[i - 1] * interval[i]);
+        const double de = east[i] - (east[i - 1] + columns.velWorldX[i - 1] * interval[i]);
+        const double du = msl[i] - (msl[i - 1] + columns.velWorldY[i - 1] * interval[i]);
+        jump[i] = std::sqrt(dn * dn + de * de + du * du);
+    }
+    for (size_t i = 1; i < n; i++) {
+        const double step = std::fabs(columns.heading[i] - columns.heading[i - 1]);
+        headingStep[i] = std::min(step, 2 * M_PI - step) * 180 / M_PI;
+    }
+    for (size_t i = 3; i < n; i++) {
+        if (interval[i] <= 0 || interval[i - 1] <= 0 || interval[i - 2] <= 0)
+            continue;
+        const double vs0 = (msl[i - 2] - msl[i - 3]) / interval[i - 2];
+        const double vs1 = (msl[i - 1] - msl[i - 2]) / interval[i - 1];
+        const double vs2 = (msl[i] - msl[i - 1]) / interval[i];
+        const double acceleration1 = (vs1 - vs0) / interval[i - 1], acceleration2 = (vs2 - vs1) / interval[i];
+        jerk[i] = (acceleration2 - acceleration1) / interval[i];
+    }
+
+    // The error, against the last four positions set before each state
+    std::vector<double> errors(n, NAN);
+    size_t output = 0;
+    for (size_t i = 0; i < n && summary.hasOutput; i++) {
+        while (output < columns.outputTime.size() && columns.outputTime[output] <= time[i])
+            output++;
+        double nearest = INFINITY;
+        for (size_t j = output; j > 0 && j + 4 > output; j--) {
+            const double dn = (columns.outputLat[j - 1] - lat[i]) * EarthRadiusFeet;
+            const double de = (columns.outputLon[j - 1] - lon[i]) * EarthRadiusFeet * std::cos(lat[i]);
+            const double du = columns.outputMsl[j - 1] - msl[i];
+            nearest = std::min(nearest, std::sqrt(dn * dn + de * de + du * du));
+        }
+        if (output > 0)
+            errors[i] = nearest;
+    }
+
+    // The times the freeze flags changed, for the bursts and the jumps near them
+    std::vector<double> freezeChanges;
+    double lastChange[FreezeFlags];
+    std::fill(lastChange, lastChange + FreezeFlags, -INFINITY);
+    for (size_t i = 1; i < n; i++) {
+        for (int f = 0; f < ToggledFlags; f++) {
+            if (columns.flags[f][i] == columns.flags[f][i - 1])
+                continue;
+            summary.toggles[f]++;
+            if (f >= FreezeFlags)
+                continue;
+            if (time[i] - lastChange[f] <= 1) {
+                summary.bursts++;
+                summary.burstsNearGround += columns.agl[i] < options.nearGroundFeet;
+            }
+            lastChange[f] = time[i];
+            freezeChanges.push_back(time[i]);
+        }
+    }
+
+    const double late = 1.5 * median(interval);
+    double worstJump = 0;
+    size_t change = 0;
+    for (size_t i = 1; i < n; i++) {
+        const Where where = columns.agl[i] < options.nearGroundFeet ? NearGround : Airborne;
+        summary.histograms[MeasureInterval][where].add(interval[i] * 1000);
+        if (!std::isnan(errors[i]))
+            summary.histograms[MeasureError][where].add(errors[i]);
+        summary.histograms[MeasureJump][where].add(jump[i]);
+        summary.histograms[MeasureHeadingStep][where].add(headingStep[i]);
+        if (!std::isnan(jerk[i]))
+            summary.histograms[MeasureJerk][where].add(std::fabs(jerk[i]));
+
+        while (change < freezeChanges.size() && freezeChanges[change] < time[i] - 1)
+            change++;
+        if (jump[i] > options.jumpFeet) {
+            summary.jumps++;
+            summary.jumpsNearGround += where == NearGround;
+            summary.jumpsAfterLateCallback += interval[i] > late;
+            summary.jumpsNearToggle += change < freezeChanges.size() && freezeChanges[change] <= time[i] + 1;
+            if (jump[i] > worstJump) {
+                worstJump = jump[i];
+                summary.worstJumpAt = time[i];
+            }
+        }
+    }
+    summary.bytes = recording.bytes();
+    return summary;
+}
+
+struct Job {
+    pid_t pid = 0;
+    int pipe = -1;
+    std::string result;
+    bool done = false;
+    Summary summary;
+};
+
+// Scan the recording in a child process that writes its Summary to the returned job's pipe
+Job start(const std::string &recording) {
+    Job job;
+    job.summary = {};
+    int fds[2];
+    if (::pipe(fds) != 0) {
+        std::snprintf(job.summary.error, sizeof(job.summary.error), "cannot create a pipe");
+        job.done = true;
+        return job;
+    }
+
+    std::fflush(stdout);
+    job.pid = fork();
+    if (job.pid == 0) {
+        close(fds[0]);
+        const Summary summary = analyze(recording);
+        const char *data = reinterpret_cast<const char*>(&summary);
+        for (size_t written = 0; written < sizeof(summary); ) {
+            const ssize_t n = write(fds[1], data + written, sizeof(summary) - written);
+            if (n <= 0)
+                break;
+            written += n;
+        }
+        _exit(0);
+    }
+
+    close(fds[1]);
+    if (job.pid < 0) {
+        close(fds[0]);
+        std::snprintf(job.summary.error, sizeof(job.summary.error), "cannot start a process");
+        job.done = true;
+    } else {
+        job.pipe = fds[0];
+    }
+    return job;
+}
+
+void print(const char *name, const Summary &summary) {
+    const Histogram *h[Measures];
+    Histogram all[Measures];
+    for (int m = 0; m < Measures; m++) {
+        all[m] = summary.histograms[m][Airborne];
+        all[m].merge(summary.histograms[m][NearGround]);
+        h[m] = &all[m];
+    }
+    char error[32] = "-";
+    if (summary.hasOutput)
+        std::snprintf(error, sizeof(error), "%.2f %.2f", h[MeasureError]->percentile(0.99), h[MeasureError]->max);
+    std::printf("%-24s %8llu %7.1f %6.1f %6.1f %6.1f %13s %6llu %8.2f %7.1f %6.2f %6.2f %8.0f %5llu %5llu %5llu %6llu %6llu\n",
+                name, (unsigned long long)summary.states, summary.seconds,
+                h[MeasureInterval]->percentile(0.5), h[MeasureInterval]->percentile(0.99), h[MeasureInterval]->max,
+                error, (unsigned long long)summary.jumps, h[MeasureJump]->max, summary.worstJumpAt,
+                h[MeasureHeadingStep]->percentile(0.99), h[MeasureHeadingStep]->max, h[MeasureJerk]->percentile(0.99),
+                (unsigned long long)summary.toggles[0], (unsigned long long)summary.toggles[1],
+                (unsigned long long)summary.toggles[2], (unsigned long long)summary.toggles[3],
+                (unsigned long long)summary.bursts);
+}
+
+void printFleet(const Summary &fleet, size_t recordings, double wallSeconds) {
+    const double fractions[] = { 0.5, 0.9, 0.99, 0.999, 1 };
+    std::printf("\nAll %zu recordings, %llu states, %.1f s, %.1f MB scanned at %.0f MB/s\n", recordings,
+                (unsigned long long)fleet.states, fleet.seconds, fleet.bytes / 1e6,
+                fleet.bytes / 1e6 / std::max(wallSeconds, 1e-9));
+    std::printf("%-20s %-8s %10s %10s %10s %10s %10s %10s\n", "", "", "frames", "p50", "p90", "p99", "p99.9", "max");
+    for (int m = 0; m < Measures; m++) {
+        for (int where = 0; where < Places; where++) {
+            const Histogram &histogram = fleet.histograms[m][where];
+            std::printf("%-20s %-8s %10llu", where == 0 ? measureNames[m] : "", where == Airborne ? "airborne" : "ground",
+                        (unsigned long long)histogram.total);
+            for (const double fraction: fractions)
+                std::printf(" %10.3g", histogram.percentile(fraction));
+            std::printf("\n");
+        }
+    }
+    std::printf("Jumps over %.1f ft: %llu, of those near the ground %llu, after a late callback %llu, within 1 s of"
+                " a freeze change %llu\n", options.jumpFeet, (unsigned long long)fleet.jumps,
+                (unsigned long long)fleet.jumpsNearGround, (unsigned long long)fleet.jumpsAfterLateCallback,
+                (unsigned long long)fleet.jumpsNearToggle);
+    std::printf("Freeze bursts: %llu, of those near the ground %llu\n", (unsigned long long)fleet.bursts,
+                (unsigned long long)fleet.burstsNearGround);
+}
+
+void merge(Summary &fleet, const Summary &summary) {
+    fleet.bytes += summary.bytes;
+    fleet.states += summary.states;
+    fleet.seconds += summary.seconds;
+    for (int m = 0; m < Measures; m++) {
+        for (int where = 0; where < Places; where++)
+            fleet.histograms[m][where].merge(summary.histograms[m][where]);
+    }
+    for (int f = 0; f < ToggledFlags; f++)
+        fleet.toggles[f] += summary.toggles[f];
+    fleet.bursts += summary.bursts;
+    fleet.burstsNearGround += summary.burstsNearGround;
+    fleet.jumps += summary.jumps;
+    fleet.jumpsNearGround += summary.jumpsNearGround;
+    fleet.jumpsAfterLateCallback += summary.jumpsAfterLateCallback;
+    fleet.jumpsNearToggle += summary.jumpsNearToggle;
+}
+
+int usage() {
+    std::fprintf(stderr, "usage: analyze [-j jobs] [-g near ground feet] [-p jump feet] recording...\n");
+    return 2;
+}
+
+} // namespace
+
+int main(int argc, char **argv) {
+    int opt;
+    while ((opt = getopt(argc, argv, "j:g:p:")) != -1) {
+        switch (opt) {
+        case 'j': options.jobs = std::atoi(optarg); break;
+        case 'g': options.nearGroundFeet = std::atof(optarg); break;
+        case 'p': options.jumpFeet = std::atof(optarg); break;
+        default: return usage();
+        }
+    }
+    if (optind == argc)
+        return usage();
+    while (optind < argc)
+        options.recordings.push_back(argv[optind++]);
+    if (options.jobs <= 0)
+        options.jobs = std::max(1L, sysconf(_SC_NPROCESSORS_ONLN));
+
+    std::printf("%-24s %8s %7s %6s %6s %6s %13s %6s %8s %7s %6s %6s %8s %5s %5s %5s %6s %6s\n", "recording",
+                "states", "s", "ms p50", "p99", "max", "error p99 max", "jumps", "max ft", "at s", "hdg99", "hdgmx",
+                "jerk p99", "alt", "att", "pos", "ground", "bursts");
+    const auto started = std::chrono::steady_clock::now();
+    std::vector<Job> jobs;
+    size_t next = 0, printed = 0;
+    int running = 0;
+    int status = 0;
+    Summary fleet = {};
+    while (printed < options.recordings.size()) {
+        while (running < options.jobs && next < options.recordings.size()) {
+            jobs.push_back(start(options.recordings[next++]));
+            running += jobs.back().pipe >= 0;
+        }
+
+        // Read the summaries as they come, so that no child blocks on a full pipe
+        std::vector<pollfd> fds;
+        std::vector<Job*> polled;
+        for (Job &job: jobs) {
+            if (job.pipe >= 0) {
+                fds.push_back({ job.pipe, POLLIN, 0 });
+                polled.push_back(&job);
+            }
+        }
+        if (!fds.empty() && poll(fds.data(), fds.size(), -1) > 0) {
+            for (size_t i = 0; i < fds.size(); i++) {
+                if (fds[i].revents == 0)
+                    continue;
+                Job &job = *polled[i];
+                char buffer[65536];
+                const ssize_t n = read(job.pipe, buffer, sizeof(buffer));
+                if (n > 0) {
+                    job.result.append(buffer, n);
+                    continue;
+                }
+                close(job.pipe);
+                job.pipe = -1;
+                running--;
+                waitpid(job.pid, nullptr, 0);
+                if (job.result.size() == sizeof(Summary))
+                    std::memcpy(&job.summary, job.result.data(), sizeof(Summary));
+                else
+                    std::snprintf(job.summary.error, sizeof(job.summary.error), "the scan crashed");
+                job.done = true;
+            }
+        }
+
+        // In the order given
+        for (; printed < jobs.size() && jobs[printed].done; printed++) {
+            const Summary &summary = jobs[printed].summary;
+            const std::string &name = options.recordings[printed];
+            if (!summary.ok) {
+                std::printf("%-24s %s\n", name.c_str(), summary.error);
+                status = 2;
+                continue;
+            }
+            print(name.substr(name.find_last_of('/') + 1).c_str(), summary);
+            merge(fleet, summary);
+        }
+        std::fflush(stdout);
+    }
+
+    const std::chrono::duration<double> took = std::chrono::steady_clock::now() - started;
+    printFleet(fleet, options.recordings.size(), took.count());
+    return status;
+}
@@ -0,0 +1,58 @@
+// -*- comment-column: 50; fill-column: 110; c-basic-offset: 4; tab-width: 4; indent-tabs-mode: nil -*-
+
+#pragma once
+
+#include <cstdint>
+#include <cstring>
+
+#include <linux/perf_event.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+// The last level cache misses of this thread, in user space, from the hardware counter through
+// perf_event_open(2), for telling how much of a frame goes to waiting for memory. The counter runs all the
+// time; read it before and after what to count, outside of any timing, as each read is a system call.
+//
+// Where there is no such counter, as in most virtual machines, or perf_event_paranoid does not allow it,
+// ok() is false and read() returns zero. Counting the whole run of a tool still works from the outside with
+//
+//   perf stat -e cache-misses,cache-references <tool> ...
+//
+// which then has the sim's side, and the tool's, in it too.
+
+class CacheMisses {
+public:
+    CacheMisses() {
+        perf_event_attr attributes;
+        std::memset(&attributes, 0, sizeof(attributes));
+        attributes.type = PERF_TYPE_HARDWARE;
+        attributes.size = sizeof(attributes);
+        attributes.config = PERF_COUNT_HW_CACHE_MISSES;
+        attributes.exclude_kernel = 1;
+        attributes.exclude_hv = 1;
+        fd = int(syscall(SYS_perf_event_open, &attributes, 0, -1, -1, 0));
+    }
+
+    ~CacheMisses() {
+        if (ok())
+            close(fd);
+    }
+
+    CacheMisses(const CacheMisses&) = delete;
+    CacheMisses &operator=(const CacheMisses&) = delete;
+
+    bool ok() const {
+        return fd >= 0;
+    }
+
+    // The misses so far
+    uint64_t read() const {
+        uint64_t count = 0;
+        if (!ok() || ::read(fd, &count, sizeof(count)) != sizeof(count))
+            return 0;
+        return count;
+    }
+
+private:
+    int fd;
+};
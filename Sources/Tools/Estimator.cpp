@@ -0,0 +1,209 @@
+// -*- comment-column: 50; fill-column: 110; c-basic-offset: 4; tab-width: 4; indent-tabs-mode: nil -*-
+
+// Runs the state estimator (see Sources/Code/StateEstimator.h) over recordings (see Sources/Code/Recorder.h)
+// and reports what it costs per frame and how smooth its corrections are. Build this, from the top of the
+// repository, with:
+//
+//   g++ -std=c++14 -O2 -ISources/Code Sources/Tools/Estimator.cpp -o estimator
+//
+// Usage: estimator [-r repeats] [-w nudge ft/s] [-s shift feet] recording...
+//
+// For each recording the commanded pose is dead reckoned from the velocities and the turn in the recorded
+// state, the way the controller integrates it, and the recorded pose is the echo, so the estimator sees how
+// the sim's echo drifts from an integrated trajectory. On top of that, -w has the sim nudge the aircraft
+// north by this speed between each set and its echo, like wind would, and -s has the sim move the aircraft
+// this far east halfway through and keep it there, like a collision would. The time is that of the whole
+// loop, run repeats times (100 by default), per frame.
+//
+// For each axis the report has the largest residual beyond the dead band, the largest correction in a frame,
+// and the largest change of the correction from one frame to the next, which is the measure of smoothness:
+// a hard snap would show as a change as large as the residual. The last column is how far the commanded pose
+// ended up from the echo.
+
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <vector>
+
+#include <unistd.h>
+
+#include "Recording.h"
+#include "StateEstimator.h"
+
+namespace {
+
+struct Options {
+    int repeats = 100;
+    double nudge = 0;                             // Feet per second
+    double shift = 0;                             // Feet
+};
+
+Options options;
+
+static constexpr double EarthRadiusFeet = 20902231;
+
+// The fields of the recorded state used, as indices into it
+struct Fields {
+    int lat, lon, msl, heading, velWorldX, velWorldY, velWorldZ;
+};
+
+struct Frame {
+    double seconds;                               // Since the frame before
+    EstimatorPose echo;
+    double velWorldX, velWorldY, velWorldZ;
+};
+
+struct Result {
+    StateEstimator::Statistics statistics;
+    uint64_t agreed;
+    double nanoSecondsPerFrame;
+    double distance;                              // Of the commanded pose from the echo at the end, in feet
+};
+
+bool findFields(const Recording &recording, Fields &fields) {
+    const char *const names[] = {
+        "PLANE LATITUDE", "PLANE LONGITUDE", "PLANE ALTITUDE", "PLANE HEADING DEGREES TRUE",
+        "VELOCITY WORLD X", "VELOCITY WORLD Y", "VELOCITY WORLD Z",
+    };
+    int *const indices[] = {
+        &fields.lat, &fields.lon, &fields.msl, &fields.heading,
+        &fields.velWorldX, &fields.velWorldY, &fields.velWorldZ,
+    };
+    for (size_t i = 0; i < sizeof(names) / sizeof(names[0]); i++) {
+        *indices[i] = -1;
+        for (size_t j = 0; j < recording.names.size(); j++) {
+            if (recording.names[j] == names[i])
+                *indices[i] = int(j);
+        }
+        if (*indices[i] < 0)
+            return false;
+    }
+    return true;
+}
+
+// All fields of the state are eight bytes
+double field(const Recording::Record &record, int index) {
+    double value = 0;
+    if ((index + 1) * 8 <= int(record.size))
+        std::memcpy(&value, record.payload + index * 8, 8);
+    return value;
+}
+
+// The state records as frames, with the disturbances of the options added to the echoes
+std::vector<Frame> readFrames(Recording &recording, const Fields &fields) {
+    std::vector<Frame> frames;
+    Recording::Record record;
+    int64_t previousTime = 0;
+    while (recording.next(record)) {
+        if (record.type != RecordState)
+            continue;
+        Frame frame;
+        frame.seconds = frames.empty() ? 0 : (record.time - previousTime) / 1e9;
+        frame.echo = { field(record, fields.lat), field(record, fields.lon), field(record, fields.msl),
+                       field(record, fields.heading) };
+        frame.velWorldX = field(record, fields.velWorldX);
+        frame.velWorldY = field(record, fields.velWorldY);
+        frame.velWorldZ = field(record, fields.velWorldZ);
+        frame.echo.lat += options.nudge * frame.seconds / EarthRadiusFeet;
+        frames.push_back(frame);
+        previousTime = record.time;
+    }
+    for (size_t i = frames.size() / 2; i < frames.size(); i++)
+        frames[i].echo.lon += options.shift / (EarthRadiusFeet * std::cos(frames[i].echo.lat));
+    return frames;
+}
+
+Result run(const std::vector<Frame> &frames) {
+    Result result = {};
+    const auto start = std::chrono::steady_clock::now();
+    for (int repeat = 0; repeat < options.repeats; repeat++) {
+        StateEstimator estimator;
+        EstimatorPose commanded = frames[0].echo;
+        uint64_t agreed = 0;
+        for (size_t i = 1; i < frames.size(); i++) {
+            const Frame &before = frames[i - 1], &frame = frames[i];
+            if (estimator.fuse(commanded, frame.echo, frame.seconds) == StateEstimator::EstimatorAgrees)
+                agreed++;
+
+            // The echo has the velocities set with the pose in it, which the controller integrated over the
+            // time since the frame before that, in whole milliseconds
+            const double seconds = std::floor(before.seconds * 1000) / 1000;
+            commanded.lat += frame.velWorldZ * seconds / EarthRadiusFeet;
+            commanded.lon += frame.velWorldX * seconds * std::cos(commanded.lat) / EarthRadiusFeet;
+            commanded.msl += frame.velWorldY * seconds;
+            commanded.heading = std::fmod(commanded.heading + frame.echo.heading - before.echo.heading + 4 * M_PI,
+                                          2 * M_PI);
+            estimator.sent(commanded);
+        }
+        result.statistics = estimator.statistics();
+        result.agreed = agreed;
+
+        const EstimatorPose &echo = frames.back().echo;
+        const double north = (echo.lat - commanded.lat) * EarthRadiusFeet;
+        const double east = (echo.lon - commanded.lon) * std::cos(commanded.lat) * EarthRadiusFeet;
+        result.distance = std::sqrt(north * north + east * east + std::pow(echo.msl - commanded.msl, 2));
+    }
+    const std::chrono::duration<double, std::nano> took = std::chrono::steady_clock::now() - start;
+    result.nanoSecondsPerFrame = took.count() / (double(options.repeats) * (frames.size() - 1));
+    return result;
+}
+
+void print(const std::array<double, StateEstimator::Axes> &values) {
+    std::printf(" %7.2f %7.2f %7.2f %7.3f", values[StateEstimator::North], values[StateEstimator::East],
+                values[StateEstimator::Up], values[StateEstimator::Heading] * 180 / M_PI);
+}
+
+int usage() {
+    std::fprintf(stderr, "usage: estimator [-r repeats] [-w nudge ft/s] [-s shift feet] recording...\n");
+    return 2;
+}
+
+} // namespace
+
+int main(int argc, char **argv) {
+    int opt;
+    while ((opt = getopt(argc, argv, "r:w:s:")) != -1) {
+        switch (opt) {
+        case 'r': options.repeats = std::atoi(optarg); break;
+        case 'w': options.nudge = std::atof(optarg); break;
+        case 's': options.shift = std::atof(optarg); break;
+        default: return usage();
+        }
+    }
+    if (optind == argc || options.repeats < 1)
+        return usage();
+
+    std::printf("%-24s %7s %6s %7s %7s %6s  %-31s  %-31s  %-31s %7s\n", "recording", "frames", "ns", "agreed",
+                "fixed", "snaps", "residual N/E/up ft, hdg deg", "largest step", "largest step change", "end ft");
+    int status = 0;
+    for (int i = optind; i < argc; i++) {
+        Recording recording;
+        std::string error;
+        Fields fields;
+        if (!recording.open(argv[i], error) || !findFields(recording, fields)) {
+            std::fprintf(stderr, "estimator: %s\n", error.empty() ? "the recording has no pose" : error.c_str());
+            status = 2;
+            continue;
+        }
+        const std::vector<Frame> frames = readFrames(recording, fields);
+        if (frames.size() < 2) {
+            std::fprintf(stderr, "estimator: %s has too few states\n", argv[i]);
+            status = 2;
+            continue;
+        }
+
+        const Result result = run(frames);
+        const std::string name = argv[i];
+        std::printf("%-24s %7zu %6.1f %7llu %7llu %6llu ", name.substr(name.find_last_of('/') + 1).c_str(),
+                    frames.size(), result.nanoSecondsPerFrame, (unsigned long long)result.agreed,
+                    (unsigned long long)result.statistics.corrected, (unsigned long long)result.statistics.snapped);
+        print(result.statistics.maxResidual);
+        print(result.statistics.maxStep);
+        print(result.statistics.maxStepChange);
+        std::printf(" %7.2f\n", result.distance);
+    }
+    return status;
+}
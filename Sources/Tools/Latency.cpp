@@ -0,0 +1,238 @@
+// -*- comment-column: 50; fill-column: 110; c-basic-offset: 4; tab-width: 4; indent-tabs-mode: nil -*-
+
+// Measures the latency of the command channel (see Sources/Code/CommandChannel.h) end to end: an offline
+// build of the gauge is flown closed loop against the stand-in's sim (see StandIn/SimModel.h), and commands
+// are written to the client data area the way an external client would. Build the gauge as described in
+// StandIn/StandIn.h, and this, from the top of the repository, with:
+//
+//   g++ -std=c++14 -O2 -ISources/Tools/StandIn -ISources/Code Sources/Tools/Latency.cpp -o latency -ldl
+//
+// Usage: latency [-n commands] [-s seed] [-r frame rate] [-j jitter ms] [-d drop %] [-a apply delay frames]
+//                [-i interval ms] [-k torn every] [-v] flyingbrick.so
+//
+// Once the gauge controls the aircraft, hovering 300 ft up, it sends a vertical speed command with the
+// command's priority every interval (500 ms by default), alternately up and down. For each, it measures the
+// time and frames from the command being written until:
+//
+// - output: the gauge sets the commanded VELOCITY BODY Y.
+// - in effect: the sim has it, which with -a can be some frames later.
+//
+// Every so many commands (10 by default, 0 for never) it also writes a torn record, one whose sequence and
+// sequenceCheck differ, after the command before it is in effect. The gauge must drop it and keep flying the
+// last good command. The exit status is 1 if a command did not reach the output within the interval, or if
+// a torn record did.
+
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <string>
+#include <vector>
+
+#include <dlfcn.h>
+#include <fcntl.h>
+#include <unistd.h>
+
+#include "CommandChannel.h"
+#include "SimModel.h"
+#include "ThisAircraft.h"
+#include "WorkFolder.h"
+
+namespace {
+
+struct Options {
+    int commands = 100;
+    double intervalSeconds = 0.5;
+    int tornEvery = 10;
+    bool verbose = false;
+    TimingModel timing;
+};
+
+Options options;
+
+// Time for the gauge to warm up and take control before the first command
+constexpr double SettleSeconds = 3;
+
+// Commanded vertical speed, feet/second, and what a torn record carries instead
+constexpr double CommandFeetPerSecond = 5;
+constexpr double TornFeetPerSecond = 20;
+
+struct Latency {
+    std::vector<double> milliSeconds;
+    std::vector<int64_t> frames;
+
+    void add(double seconds, int64_t count) {
+        milliSeconds.push_back(seconds * 1000);
+        frames.push_back(count);
+    }
+
+    void print(const char *label) {
+        if (milliSeconds.empty()) {
+            std::printf("%-10s none\n", label);
+            return;
+        }
+        std::sort(milliSeconds.begin(), milliSeconds.end());
+        std::sort(frames.begin(), frames.end());
+        double sum = 0;
+        for (double ms: milliSeconds)
+            sum += ms;
+        const size_t n = milliSeconds.size();
+        std::printf("%-10s %8zu %8.2f %8.2f %8.2f %8.2f %8.2f %8lld %8lld\n", label, n, milliSeconds[0],
+                    sum / n, milliSeconds[n / 2], milliSeconds[std::min(n - 1, n * 99 / 100)],
+                    milliSeconds[n - 1], (long long)frames[n / 2], (long long)frames[n - 1]);
+    }
+};
+
+struct Result {
+    Latency outputs, effects;
+    int missed = 0, tornSent = 0, tornLeaked = 0;
+};
+
+bool matches(double value, double expected) {
+    return std::fabs(value - expected) < 1e-9;
+}
+
+// Whether the gauge set VELOCITY BODY Y to the value in the frame just stepped
+bool output(const StandInApi &api, double value) {
+    const StandInFrame &frame = *api.frame();
+    for (uint32_t i = 0; i < frame.writeCount; i++) {
+        if (std::string(frame.writes[i].name) == "VELOCITY BODY Y" && matches(frame.writes[i].value, value))
+            return true;
+    }
+    return false;
+}
+
+bool send(const StandInApi &api, int64_t sequence, double feetPerSecond, bool torn) {
+    CommandRecord record = {};
+    record.sequence = sequence;
+    record.mode = CommandModeVerticalSpeed;
+    record.priority = CommandPriorityCommand;
+    record.validMilliseconds = int64_t(options.intervalSeconds * 2000);
+    record.verticalSpeed = feetPerSecond;
+    record.sequenceCheck = torn ? sequence - 1 : sequence;
+    return api.deliverClientData(THISAIRCRAFT ".Command", &record, sizeof(record));
+}
+
+// Returns false, having said why, if the gauge could not be flown
+bool fly(const std::string &library, Result &result) {
+    void *handle = dlopen(library.c_str(), RTLD_NOW | RTLD_LOCAL);
+    const StandInApiFunction function = handle != nullptr ? (StandInApiFunction)dlsym(handle, "standInApi") : nullptr;
+    if (function == nullptr || function()->version != StandInApi::CurrentVersion) {
+        std::fprintf(stderr, "latency: %s is not a gauge built with this version of the stand-in\n", library.c_str());
+        return false;
+    }
+    const StandInApi &api = *function();
+
+    SimModel sim(api, options.timing);
+    api.setTime(int64_t(sim.time() * 1e9));
+    api.install();
+    if (!sim.start()) {
+        std::fprintf(stderr, "latency: the gauge did not ask for the state\n");
+        return false;
+    }
+    sim.place(300);
+
+    const double start = sim.time();
+    while (sim.time() - start < SettleSeconds)
+        sim.step();
+
+    int64_t sequence = 0;
+    for (int i = 0; i < options.commands; i++) {
+        const double value = (i % 2 == 0 ? 1 : -1) * CommandFeetPerSecond;
+        if (!send(api, ++sequence, value, false)) {
+            std::fprintf(stderr, "latency: the gauge did not ask for the client data\n");
+            return false;
+        }
+
+        const double sent = sim.time();
+        const int64_t sentFrame = sim.frames();
+        const bool tear = options.tornEvery > 0 && (i + 1) % options.tornEvery == 0;
+        bool isOutput = false, inEffect = false, tornPending = tear;
+        while (sim.time() - sent < options.intervalSeconds) {
+            sim.step();
+            if (tornPending && inEffect) {
+                send(api, ++sequence, TornFeetPerSecond, true);
+                result.tornSent++;
+                tornPending = false;
+            }
+            if (!isOutput && output(api, value)) {
+                isOutput = true;
+                result.outputs.add(sim.time() - sent, sim.frames() - sentFrame);
+            }
+            if (isOutput && !inEffect && matches(sim.get("VELOCITY BODY Y"), value)) {
+                inEffect = true;
+                result.effects.add(sim.time() - sent, sim.frames() - sentFrame);
+            }
+            if (output(api, TornFeetPerSecond))
+                result.tornLeaked++;
+        }
+        if (!isOutput)
+            result.missed++;
+        if (options.verbose)
+            std::printf("%4d %6.1f ft/s %s\n", i, value,
+                        isOutput ? (inEffect ? "in effect" : "output") : "missed");
+    }
+    api.kill();
+    return true;
+}
+
+int usage() {
+    std::fprintf(stderr, "usage: latency [-n commands] [-s seed] [-r frame rate] [-j jitter ms] [-d drop %%]"
+                 " [-a apply delay frames] [-i interval ms] [-k torn every] [-v] flyingbrick.so\n");
+    return 2;
+}
+
+} // namespace
+
+int main(int argc, char **argv) {
+    int opt;
+    while ((opt = getopt(argc, argv, "n:s:r:j:d:a:i:k:v")) != -1) {
+        switch (opt) {
+        case 'n': options.commands = std::atoi(optarg); break;
+        case 's': options.timing.seed = std::strtoull(optarg, nullptr, 10); break;
+        case 'r': options.timing.frameSeconds = 1 / std::atof(optarg); break;
+        case 'j': options.timing.jitterSeconds = std::atof(optarg) / 1000; break;
+        case 'd': options.timing.dropProbability = std::atof(optarg) / 100; break;
+        case 'a': options.timing.applyDelayFrames = std::atoi(optarg); break;
+        case 'i': options.intervalSeconds = std::atof(optarg) / 1000; break;
+        case 'k': options.tornEvery = std::atoi(optarg); break;
+        case 'v': options.verbose = true; break;
+        default: return usage();
+        }
+    }
+    if (argc - optind != 1 || options.commands < 1 || !(options.timing.frameSeconds > 0)
+        || !(options.intervalSeconds > 0))
+        return usage();
+
+    // The gauge is loaded after chdir() into the work folder
+    char *library = realpath(argv[optind], nullptr);
+    if (library == nullptr) {
+        std::fprintf(stderr, "latency: cannot find %s\n", argv[optind]);
+        return 2;
+    }
+
+    // The gauge's own output only with -v
+    std::fflush(stdout);
+    const int console = dup(STDOUT_FILENO);
+    if (!options.verbose)
+        dup2(open("/dev/null", O_WRONLY), STDOUT_FILENO);
+    Result result;
+    bool flown = false;
+    {
+        WorkFolder folder;
+        flown = folder.ok() && fly(library, result);
+    }
+    std::fflush(stdout);
+    dup2(console, STDOUT_FILENO);
+    std::free(library);
+    if (!flown)
+        return 2;
+
+    std::printf("%-10s %8s %8s %8s %8s %8s %8s %8s %8s\n", "ms", "count", "min", "mean", "median", "99%",
+                "max", "frames", "max");
+    result.outputs.print("output");
+    result.effects.print("in effect");
+    std::printf("%d of %d commands missed, %d of %d torn records reached the output\n", result.missed,
+                options.commands, result.tornLeaked, result.tornSent);
+    return result.missed == 0 && result.tornLeaked == 0 ? 0 : 1;
+}
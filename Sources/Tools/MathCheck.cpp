@@ -0,0 +1,316 @@
+// -*- comment-column: 50; fill-column: 110; c-basic-offset: 4; tab-width: 4; indent-tabs-mode: nil -*-
+
+// Checks the error bounds claimed in Sources/Code/FastMath.h, and measures how much faster than libm its
+// functions and the control law's use of them are. Also checks ContactPoints::lowest() (see
+// Sources/Code/ContactPoints.h) at known attitudes, and measures it. Build this, from the top of the repository, with:
+//
+//   g++ -std=c++14 -O2 -ISources/Code Sources/Tools/MathCheck.cpp -o mathcheck
+//
+// and for WebAssembly, where it matters, with the clang of the MSFS SDK or of the WASI SDK, and run it with
+// a WASI runtime like wasmtime:
+//
+//   clang++ --target=wasm32-wasi -std=c++14 -O2 -ISources/Code Sources/Tools/MathCheck.cpp -o mathcheck.wasm
+//
+// Usage: mathcheck [-n random samples] [-s seed] [-b benchmark iterations]
+//
+// The errors are against long double, over a dense grid of the angles the controller uses and the points
+// where the range reduction switches, and over random arguments up to where FastMath falls back to libm. The
+// exit status is 1 if any error is beyond the bound in FastMath.h, or if lowest() is off at any of the known
+// attitudes, so this doubles as the validation.
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <random>
+
+#include <unistd.h>
+
+#include "ContactPoints.h"
+#include "FastMath.h"
+
+namespace {
+
+struct Options {
+    long samples = 2000000;
+    unsigned long seed = 1;
+    long iterations = 10000000;
+};
+
+Options options;
+
+// As claimed in FastMath.h
+static constexpr double SinCosBound = 4.5e-16;
+static constexpr double Atan2Bound = 1e-15;
+static constexpr double WrapBound = 0;
+
+static constexpr long double PiLong = 3.141592653589793238462643383279502884L;
+
+struct Error {
+    const char *name;
+    double bound;
+    double fast, lib;                             // The largest seen, for FastMath and for LibMath
+    double at;                                    // Where the one of FastMath was
+    long samples;
+};
+
+void note(Error &error, double fast, double lib, double at) {
+    if (fast > error.fast) {
+        error.fast = fast;
+        error.at = at;
+    }
+    if (lib > error.lib)
+        error.lib = lib;
+    error.samples++;
+}
+
+void checkSinCos(Error &error, double x) {
+    const long double sine = std::sin(static_cast<long double>(x));
+    const long double cosine = std::cos(static_cast<long double>(x));
+    double s, c, ls, lc;
+    FastMath::sinCos(x, s, c);
+    LibMath::sinCos(x, ls, lc);
+    note(error,
+         std::max(double(std::abs(s - sine)), double(std::abs(c - cosine))),
+         std::max(double(std::abs(ls - sine)), double(std::abs(lc - cosine))),
+         x);
+}
+
+void checkAtan2(Error &error, double y, double x) {
+    const long double exact = std::atan2(static_cast<long double>(y), static_cast<long double>(x));
+    note(error,
+         double(std::abs(FastMath::atan2(y, x) - exact)),
+         double(std::abs(LibMath::atan2(y, x) - exact)),
+         std::atan2(y, x));
+}
+
+// The distance between two angles, where 0 and 2 pi are the same. The loop of LibMath can give 2 pi for a
+// tiny negative angle, where FastMath gives 0.
+double around(long double a, long double b, long double period) {
+    const long double difference = std::abs(a - b);
+    return double(std::min(difference, std::abs(difference - period)));
+}
+
+// Against the loop of LibMath, which the controller used, for up to a couple of turns, as that is what it
+// does per frame. Far out the loop itself drifts by a rounding per turn.
+void checkWrap(Error &error, double x) {
+    const double fast = FastMath::wrap(x), lib = LibMath::wrap(x);
+    long double exact = std::fmod(static_cast<long double>(x), 2 * PiLong);
+    if (exact < 0)
+        exact += 2 * PiLong;
+    const bool inRange = fast >= 0 && fast < 2 * M_PI;
+    note(error, !inRange ? 1 : std::abs(x) < 4 * M_PI ? around(fast, lib, 2 * M_PI) : 0,
+         around(lib, exact, 2 * PiLong), x);
+}
+
+double uniform(std::mt19937_64 &random, double from, double to) {
+    return from + (to - from) * ((random() >> 11) * (1.0 / 9007199254740992.0));
+}
+
+void validate(Error &sinCos, Error &atan2, Error &wrap) {
+    std::mt19937_64 random(options.seed);
+
+    // Every angle a heading, a track or a latitude can be, and then some, on a grid finer than any epsilon,
+    // and a few ulps around each multiple of pi/4, where the reduction changes quadrant or the atan2
+    // reduction switches
+    const long grid = options.samples;
+    for (long i = 0; i <= grid; i++) {
+        const double x = -4 * M_PI + 8 * M_PI * i / grid;
+        checkSinCos(sinCos, x);
+        checkAtan2(atan2, std::sin(x), std::cos(x));
+        checkWrap(wrap, x);
+    }
+    for (int k = -16; k <= 16; k++) {
+        double x = k * M_PI / 4;
+        for (int ulp = 0; ulp < 64; ulp++)
+            x = std::nextafter(x, -HUGE_VAL);
+        for (int ulp = 0; ulp < 128; ulp++) {
+            checkSinCos(sinCos, x);
+            checkAtan2(atan2, std::sin(x), std::cos(x));
+            checkWrap(wrap, x);
+            x = std::nextafter(x, HUGE_VAL);
+        }
+    }
+
+    // Random arguments: far out for sinCos, any magnitudes and signs for atan2, including zeros
+    for (long i = 0; i < options.samples; i++) {
+        checkSinCos(sinCos, uniform(random, -1e5, 1e5));
+        const double y = std::ldexp(uniform(random, -1, 1), int(uniform(random, -60, 60)));
+        const double x = std::ldexp(uniform(random, -1, 1), int(uniform(random, -60, 60)));
+        checkAtan2(atan2, y, x);
+        checkWrap(wrap, uniform(random, -1e5, 1e5));
+    }
+    const double zeros[] = { 0.0, -0.0, 1.0, -1.0 };
+    for (double y: zeros) {
+        for (double x: zeros)
+            checkAtan2(atan2, y, x);
+    }
+}
+
+volatile double sink;
+
+// The best of ten rounds, as other processes get in the way more than the differences measured
+template <typename Function>
+double nanosecondsPer(Function function) {
+    static constexpr int Rounds = 10;
+    const long iterations = std::max(1L, options.iterations / Rounds);
+    double best = HUGE_VAL;
+    for (int round = 0; round < Rounds; round++) {
+        const auto start = std::chrono::steady_clock::now();
+        double sum = 0;
+        for (long i = 0; i < iterations; i++)
+            sum += function(i);
+        sink = sum;
+        const std::chrono::duration<double, std::nano> elapsed = std::chrono::steady_clock::now() - start;
+        best = std::min(best, elapsed.count() / iterations);
+    }
+    return best;
+}
+
+// What the control law does with one frame: wrap the heading, find the track, turn the velocity into world
+// axes and move the longitude
+template <typename Math>
+double frame(long i) {
+    const double heading = Math::wrap(0.001 * (i & 8191) - 1);
+    const double velBodyZ = 100 + (i & 63), velBodyX = 5 - (i & 15);
+    const double speed = Math::hypot(velBodyZ, velBodyX);
+    const double track = heading + M_PI / 2 - Math::atan2(velBodyZ, velBodyX);
+    double sine, cosine;
+    Math::sinCos(track, sine, cosine);
+    return cosine * speed + sine * speed + Math::cos(0.8 + 1e-6 * (i & 255));
+}
+
+template <typename Math>
+void benchmark(const char *name) {
+    const double sinCos = nanosecondsPer([](long i) {
+        double sine, cosine;
+        Math::sinCos(0.001 * (i & 8191) - 4, sine, cosine);
+        return sine + cosine;
+    });
+    const double atan2 = nanosecondsPer([](long i) {
+        return Math::atan2(0.01 * (i & 1023) - 5, 1.0 - 0.01 * (i & 255));
+    });
+    const double wrap = nanosecondsPer([](long i) { return Math::wrap(0.001 * (i & 8191) - 1); });
+    const double control = nanosecondsPer(frame<Math>);
+    std::printf("%-9s %9.2f %9.2f %9.2f %9.2f\n", name, sinCos, atan2, wrap, control);
+}
+
+// The contact points of the FlyingBrick's flight_model.cfg: four wheels and eight scrape points
+const double flyingBrickPoints[][3] = {
+    { 11.4, -4.4, -9.68 }, { 11.4, 4.4, -9.68 }, { -8.0, -4.4, -9.68 }, { -8.0, 4.4, -9.68 },
+    { 13.2, 4.9, -4.9 }, { 13.2, -4.9, -4.9 }, { -13.2, 4.9, -4.9 }, { -13.2, -4.9, -4.9 },
+    { 14.8, 4.9, 4.9 }, { 14.8, -4.9, 4.9 }, { -13.2, 4.9, 4.9 }, { -13.2, -4.9, 4.9 },
+};
+
+// Attitudes as in the simvars: PLANE PITCH DEGREES is negative nose up, PLANE BANK DEGREES negative right
+// wing down. A single point tells which way each goes, the FlyingBrick's wheels that it is the lowest one.
+struct Attitude {
+    const char *name;
+    double point[3];                              // Longitudinal, lateral, vertical; none for all of the above
+    bool flyingBrick;
+    double pitch, bank;                           // Degrees
+    double expected;
+};
+
+const Attitude attitudes[] = {
+    { "level", {}, true, 0, 0, -9.68 },
+    { "right wing tip, right wing down 30", { 0, 10, 0 }, false, 0, -30, -5 },
+    { "right wing tip, left wing down 30", { 0, 10, 0 }, false, 0, 30, 5 },
+    { "nose, nose up 30", { 10, 0, 0 }, false, -30, 0, 5 },
+    { "nose, nose down 30", { 10, 0, 0 }, false, 30, 0, -5 },
+    { "floor, nose up 60 and banked 60", { 0, 0, -2 }, false, -60, 60, -0.5 },
+    { "FlyingBrick, nose up 10", {}, true, -10, 0, -8.0 * std::sin(10 * M_PI / 180) - 9.68 * std::cos(10 * M_PI / 180) },
+    { "FlyingBrick, right wing down 10", {}, true, 0, -10,
+      -4.4 * std::sin(10 * M_PI / 180) - 9.68 * std::cos(10 * M_PI / 180) },
+};
+
+bool checkContactPoints() {
+    ContactPoints flyingBrick;
+    for (const auto &point: flyingBrickPoints)
+        flyingBrick.add(point[0], point[1], point[2]);
+
+    bool ok = true;
+    std::printf("\n%-40s %11s %10s\n", "contact points", "lowest", "expected");
+    for (const Attitude &attitude: attitudes) {
+        ContactPoints single;
+        single.add(attitude.point[0], attitude.point[1], attitude.point[2]);
+        const ContactPoints &points = attitude.flyingBrick ? flyingBrick : single;
+        const double lowest = points.lowest(attitude.pitch * M_PI / 180, attitude.bank * M_PI / 180);
+        const bool off = std::abs(lowest - attitude.expected) > 1e-12;
+        std::printf("%-40s %11.6f %10.6f%s\n", attitude.name, lowest, attitude.expected, off ? "  OFF" : "");
+        ok &= !off;
+    }
+    return ok;
+}
+
+// What lowest() replaces a loop like: each point rotated on its own, an array of structures
+double lowestPerPoint(const double (&points)[12][3], double pitch, double bank) {
+    const double noseUp = -pitch, rightWingDown = -bank;
+    double result = HUGE_VAL;
+    for (const auto &point: points) {
+        const double up = point[0] * std::sin(noseUp)
+            + std::cos(noseUp) * (point[2] * std::cos(rightWingDown) - point[1] * std::sin(rightWingDown));
+        result = std::min(result, up);
+    }
+    return result;
+}
+
+void benchmarkContactPoints() {
+    static ContactPoints flyingBrick;
+    for (const auto &point: flyingBrickPoints)
+        flyingBrick.add(point[0], point[1], point[2]);
+
+    const double lowest = nanosecondsPer([](long i) {
+        return flyingBrick.lowest(0.0001 * (i & 1023) - 0.05, 0.0002 * (i & 511) - 0.05);
+    });
+    const double perPoint = nanosecondsPer([](long i) {
+        return lowestPerPoint(flyingBrickPoints, 0.0001 * (i & 1023) - 0.05, 0.0002 * (i & 511) - 0.05);
+    });
+    std::printf("\nns per call  lowest  per point\n");
+    std::printf("%-9s %8.2f %10.2f\n", "12 points", lowest, perPoint);
+}
+
+int usage() {
+    std::fprintf(stderr, "usage: mathcheck [-n random samples] [-s seed] [-b benchmark iterations]\n");
+    return 2;
+}
+
+}
+
+int main(int argc, char **argv) {
+    int option;
+    while ((option = getopt(argc, argv, "n:s:b:")) != -1) {
+        switch (option) {
+        case 'n': options.samples = std::atol(optarg); break;
+        case 's': options.seed = std::strtoul(optarg, nullptr, 10); break;
+        case 'b': options.iterations = std::atol(optarg); break;
+        default: return usage();
+        }
+    }
+    if (optind != argc || options.samples <= 0 || options.iterations <= 0)
+        return usage();
+
+    Error sinCos = { "sinCos", SinCosBound, 0, 0, 0, 0 };
+    Error atan2 = { "atan2", Atan2Bound, 0, 0, 0, 0 };
+    Error wrap = { "wrap", WrapBound, 0, 0, 0, 0 };
+    validate(sinCos, atan2, wrap);
+
+    bool failed = false;
+    std::printf("function     samples  max error      libm      bound  at\n");
+    for (const Error *error: { &sinCos, &atan2, &wrap }) {
+        const bool over = error->fast > error->bound;
+        std::printf("%-8s %11ld %10.3g %9.3g %10.3g  %.17g%s\n", error->name, error->samples, error->fast,
+                    error->lib, error->bound, error->at, over ? "  OVER THE BOUND" : "");
+        failed |= over;
+    }
+
+    std::printf("\nns per call  sinCos     atan2      wrap   control\n");
+    benchmark<LibMath>("libm");
+    benchmark<FastMath>("FastMath");
+
+    failed |= !checkContactPoints();
+    benchmarkContactPoints();
+    return failed ? 1 : 0;
+}
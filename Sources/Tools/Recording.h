@@ -0,0 +1,125 @@
+// -*- comment-column: 50; fill-column: 110; c-basic-offset: 4; tab-width: 4; indent-tabs-mode: nil -*-
+
+#pragma once
+
+#include <cerrno>
+#include <cstring>
+#include <string>
+#include <vector>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "Recorder.h"
+
+// A recording made by the gauge (see Sources/Code/Recorder.h), mapped into memory for reading it record by
+// record.
+
+class Recording {
+public:
+    struct Record {
+        uint32_t type;                            // A RecordType
+        uint32_t size;
+        int64_t time;                             // FrameClock, in nanoseconds
+        const char *payload;
+    };
+
+    ~Recording() {
+        if (data != nullptr)
+            munmap(const_cast<char*>(data), size);
+    }
+
+    // Returns false, with the reason in error, if the file is not a recording we can read
+    bool open(const std::string &fileName, std::string &error) {
+        const int fd = ::open(fileName.c_str(), O_RDONLY);
+        if (fd < 0) {
+            error = "cannot open " + fileName + ": " + std::strerror(errno);
+            return false;
+        }
+        struct stat st;
+        if (fstat(fd, &st) == 0 && st.st_size > 0) {
+            void *mapped = mmap(nullptr, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+            if (mapped != MAP_FAILED) {
+                data = static_cast<const char*>(mapped);
+                size = st.st_size;
+                madvise(mapped, size, MADV_SEQUENTIAL);
+            }
+        }
+        close(fd);
+
+        RecordingHeader header;
+        if (data == nullptr || size < sizeof(header)) {
+            error = fileName + " is empty";
+            return false;
+        }
+        std::memcpy(&header, data, sizeof(header));
+        if (header.magic != RecordingHeader::Magic || header.version != RecordingHeader::CurrentVersion) {
+            error = fileName + " is not a recording of this version";
+            return false;
+        }
+
+        rewind();
+        Record record;
+        if (!next(record) || record.type != RecordLayout) {
+            error = fileName + " has no layout";
+            return false;
+        }
+        for (const char *p = record.payload; p < record.payload + record.size; ) {
+            const std::string name = p;
+            p += name.size() + 1;
+            const std::string unit = p < record.payload + record.size ? p : "";
+            p += unit.size() + 1;
+            names.push_back(name);
+            units.push_back(unit);
+        }
+        rewind();
+        return true;
+    }
+
+    // The fields of the state records, see RecordLayout
+    std::vector<std::string> names, units;
+
+    void rewind() {
+        position = sizeof(RecordingHeader);
+        truncated_ = false;
+    }
+
+    // The next record, if there is one
+    bool next(Record &record) {
+        RecordHeader header;
+        if (position + sizeof(header) > size) {
+            truncated_ = position != size;
+            return false;
+        }
+        std::memcpy(&header, data + position, sizeof(header));
+        const size_t padded = (size_t(header.size) + 7) & ~size_t(7);
+        if (position + sizeof(header) + padded > size) {
+            truncated_ = true;
+            return false;
+        }
+        record.type = header.type;
+        record.size = header.size;
+        record.time = header.time;
+        record.payload = data + position + sizeof(header);
+        position += sizeof(header) + padded;
+        return true;
+    }
+
+    // Of the file
+    size_t bytes() const {
+        return size;
+    }
+
+    // Whether reading stopped at an incomplete record, as when the gauge did not get to stop recording
+    bool truncated() const {
+        return truncated_;
+    }
+
+private:
+    const char *data = nullptr;
+    size_t size = 0;
+    size_t position = 0;
+    bool truncated_ = false;
+};
@@ -0,0 +1,503 @@
+// -*- comment-column: 50; fill-column: 110; c-basic-offset: 4; tab-width: 4; indent-tabs-mode: nil -*-
+
+// Feeds the same recordings (see Sources/Code/Recorder.h) to two builds of the gauge and reports where what
+// they do differs, so that a change can be checked against a collection of recorded flights before flying it.
+// Build the two gauges as described in StandIn/StandIn.h, and this, from the top of the repository, with:
+//
+//   g++ -std=c++14 -O2 -ISources/Tools/StandIn -ISources/Code Sources/Tools/Replay.cpp -o replay -ldl
+//
+// Usage: replay [-j jobs] [-t tolerance] [-v] a.so b.so recording...
+//
+// Each recording is replayed in a process of its own, up to jobs at a time (by default as many as there are
+// processors), in a new temporary folder that both gauges use as their work folder. The gauges' own output
+// is discarded unless -v is given. Values set that differ by no more than the tolerance (0 by default) count
+// as the same. The exit status is 0 if the two builds did the same with all recordings, 1 if not, and 2 if
+// some recording could not be replayed.
+//
+// For each recording the report has the first frame where the builds differ, and over all frames, for each
+// SimVar set the largest and the RMS difference, the number of each event sent, like the freezes, the
+// number of SetDataOnSimObject calls, and per frame, the bytes of the messages delivered to the gauge and of
+// the state it set, the time the gauge took and its cache misses. The cache misses are only there where the
+// machine can count them, see CacheMisses.h.
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <map>
+#include <sstream>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include <dlfcn.h>
+#include <poll.h>
+#include <sys/wait.h>
+
+#include "CacheMisses.h"
+#include "Recording.h"
+#include "StandIn.h"
+#include "ThisAircraft.h"
+#include "WorkFolder.h"
+
+namespace {
+
+struct Options {
+    int jobs = 0;
+    double tolerance = 0;
+    bool verbose = false;
+    std::string builds[2];
+    std::vector<std::string> recordings;
+};
+
+Options options;
+
+enum Status {
+    StatusSame = 0,
+    StatusDifferent = 1,
+    StatusError = 2,
+};
+
+// The SimVars set by either build, in the order first set
+std::vector<std::string> fields;
+std::unordered_map<std::string, size_t> fieldIndices;
+
+struct FieldDifference {
+    double max = 0;
+    double sumOfSquares = 0;
+    uint64_t frames = 0;                          // Frames in which it differed
+};
+
+std::vector<FieldDifference> fieldDifferences;
+
+class Build {
+public:
+    explicit Build(const char *label) : label(label) {
+    }
+
+    const char *label;
+    const StandInApi *api = nullptr;
+
+    // The latest value set of each field, NaN until set
+    std::vector<double> values;
+
+    std::map<std::string, uint64_t> eventCounts;  // By "name data"
+    uint64_t sets = 0, bytes = 0, received = 0, calls = 0;
+    std::vector<double> frameMicroSeconds, frameCacheMisses;
+
+    // Load a copy of the library, so that even two copies of the same build share nothing
+    bool load(const std::string &fileName, const std::string &copy, std::string &error) {
+        const std::string command = "cp '" + fileName + "' '" + copy + "'";
+        if (std::system(command.c_str()) != 0) {
+            error = "cannot copy " + fileName;
+            return false;
+        }
+        void *library = dlopen(copy.c_str(), RTLD_NOW | RTLD_LOCAL);
+        if (library == nullptr) {
+            error = dlerror();
+            return false;
+        }
+        const StandInApiFunction function = (StandInApiFunction)dlsym(library, "standInApi");
+        if (function == nullptr || (api = function())->version != StandInApi::CurrentVersion) {
+            error = fileName + " is not a gauge built with this version of the stand-in";
+            return false;
+        }
+        return true;
+    }
+
+    // Take in what the gauge did in the frame
+    void collect() {
+        const StandInFrame &frame = *api->frame();
+        for (uint32_t i = 0; i < frame.writeCount; i++) {
+            const size_t index = fieldIndex(frame.writes[i].name);
+            if (index >= values.size())
+                values.resize(fields.size(), NAN);
+            values[index] = frame.writes[i].value;
+        }
+        for (uint32_t i = 0; i < frame.eventCount; i++)
+            eventCounts[std::string(frame.events[i].name) + " " + std::to_string(frame.events[i].data)]++;
+        sets += frame.sets;
+        bytes += frame.bytes;
+        received += frame.received;
+        calls += frame.calls;
+    }
+
+    bool sameEvents(const Build &other) const {
+        const StandInFrame &frame = *api->frame(), &otherFrame = *other.api->frame();
+        if (frame.eventCount != otherFrame.eventCount)
+            return false;
+        for (uint32_t i = 0; i < frame.eventCount; i++) {
+            if (std::strcmp(frame.events[i].name, otherFrame.events[i].name) != 0
+                || frame.events[i].data != otherFrame.events[i].data)
+                return false;
+        }
+        return true;
+    }
+
+private:
+    // The names are interned by each library, so look them up by pointer first
+    std::unordered_map<const char*, size_t> indicesByPointer;
+
+    size_t fieldIndex(const char *name) {
+        const auto found = indicesByPointer.find(name);
+        if (found != indicesByPointer.end())
+            return found->second;
+
+        const auto inserted = fieldIndices.emplace(name, fields.size());
+        if (inserted.second) {
+            fields.push_back(name);
+            fieldDifferences.emplace_back();
+        }
+        const size_t index = inserted.first->second;
+        indicesByPointer[name] = index;
+        return index;
+    }
+};
+
+Build builds[2] = { Build("A"), Build("B") };
+
+struct Divergence {
+    bool found = false;
+    uint64_t frame;
+    double seconds;
+    std::string what;
+};
+
+double percentile(std::vector<double> values, double fraction) {
+    if (values.empty())
+        return 0;
+    const size_t n = std::min(values.size() - 1, size_t(fraction * values.size()));
+    std::nth_element(values.begin(), values.begin() + n, values.end());
+    return values[n];
+}
+
+// Replay one recording, in a process of its own. Returns a Status and the report.
+Status replay(const std::string &fileName, std::ostream &report) {
+    report << fileName << ": ";
+
+    Recording recording;
+    std::string error;
+    if (!recording.open(fileName, error)) {
+        report << error << "\n";
+        return StatusError;
+    }
+
+    WorkFolder folder;
+    if (!folder.ok()) {
+        report << "cannot create a work folder\n";
+        return StatusError;
+    }
+
+    for (int b = 0; b < 2; b++) {
+        if (!builds[b].load(options.builds[b], std::string(folder.path()) + "/" + builds[b].label + ".so", error)) {
+            report << error << "\n";
+            return StatusError;
+        }
+    }
+
+    for (Build &build: builds) {
+        build.api->install();
+        build.api->beginFrame();
+    }
+
+    const CacheMisses cacheMisses;
+    Divergence divergence;
+    uint64_t frames = 0;
+    int64_t firstTime = 0, lastTime = 0;
+    Recording::Record record;
+    while (recording.next(record)) {
+        if (frames == 0 && record.type != RecordLayout)
+            firstTime = record.time;
+        lastTime = record.time;
+
+        for (Build &build: builds)
+            build.api->setTime(record.time);
+
+        switch (record.type) {
+        case RecordState: {
+            // Alternate which build goes first, so neither always has the other's effect on the caches
+            for (int i = 0; i < 2; i++) {
+                Build &build = builds[(frames + i) % 2];
+                const uint64_t missed = cacheMisses.read();
+                const auto start = std::chrono::steady_clock::now();
+                build.api->update();
+                build.api->deliverState(record.payload, record.size);
+                const std::chrono::duration<double, std::micro> took = std::chrono::steady_clock::now() - start;
+                build.frameMicroSeconds.push_back(took.count());
+                if (cacheMisses.ok())
+                    build.frameCacheMisses.push_back(double(cacheMisses.read() - missed));
+            }
+            for (Build &build: builds) {
+                build.collect();
+                build.values.resize(fields.size(), NAN);
+            }
+
+            for (size_t i = 0; i < fields.size(); i++) {
+                const double a = builds[0].values[i], b = builds[1].values[i];
+                if (std::isnan(a) && std::isnan(b))
+                    continue;
+                const double difference = std::isnan(a) || std::isnan(b) ? INFINITY : std::fabs(a - b);
+                if (difference <= options.tolerance)
+                    continue;
+                FieldDifference &field = fieldDifferences[i];
+                field.max = std::max(field.max, difference);
+                field.sumOfSquares += difference * difference;
+                field.frames++;
+                if (!divergence.found)
+                    divergence = { true, frames, (record.time - firstTime) / 1e9, fields[i] };
+            }
+            if (!builds[0].sameEvents(builds[1]) && !divergence.found)
+                divergence = { true, frames, (record.time - firstTime) / 1e9, "events sent" };
+
+            for (Build &build: builds)
+                build.api->beginFrame();
+            frames++;
+            break;
+        }
+        case RecordEvent: {
+            RecordedEvent event;
+            std::memcpy(&event, record.payload, std::min<size_t>(record.size, sizeof(event)));
+            event.name[sizeof(event.name) - 1] = 0;
+            for (Build &build: builds)
+                build.api->deliverSystemEvent(event.name, event.data);
+            break;
+        }
+        case RecordCommand:
+            for (Build &build: builds)
+                build.api->deliverClientData(THISAIRCRAFT ".Command", record.payload, record.size);
+            break;
+        }
+    }
+
+    for (Build &build: builds) {
+        build.api->kill();
+        build.collect();
+    }
+
+    char line[200];
+    report << frames << " frames, " << (lastTime - firstTime) / 1e9 << " s"
+           << (recording.truncated() ? ", truncated" : "") << ", ";
+    if (divergence.found) {
+        std::snprintf(line, sizeof(line), "first differs in frame %llu at %.3f s: %s\n",
+                      (unsigned long long)divergence.frame, divergence.seconds, divergence.what.c_str());
+        report << line;
+    } else {
+        report << "same\n";
+    }
+
+    if (divergence.found) {
+        std::snprintf(line, sizeof(line), "  %-40s %12s %12s %8s\n", "SimVar", "max", "RMS", "frames");
+        report << line;
+        for (size_t i = 0; i < fields.size(); i++) {
+            const FieldDifference &field = fieldDifferences[i];
+            if (field.frames == 0)
+                continue;
+            std::snprintf(line, sizeof(line), "  %-40s %12.6g %12.6g %8llu\n", fields[i].c_str(), field.max,
+                          std::sqrt(field.sumOfSquares / frames), (unsigned long long)field.frames);
+            report << line;
+        }
+    }
+
+    std::map<std::string, std::pair<uint64_t, uint64_t>> events;
+    for (const auto &event: builds[0].eventCounts)
+        events[event.first].first = event.second;
+    for (const auto &event: builds[1].eventCounts)
+        events[event.first].second = event.second;
+    std::snprintf(line, sizeof(line), "  %-40s %12s %12s\n", "", builds[0].label, builds[1].label);
+    report << line;
+    for (const auto &event: events) {
+        std::snprintf(line, sizeof(line), "  %-40s %12llu %12llu\n", event.first.c_str(),
+                      (unsigned long long)event.second.first, (unsigned long long)event.second.second);
+        report << line;
+    }
+    std::snprintf(line, sizeof(line), "  %-40s %12llu %12llu\n", "SetDataOnSimObject calls",
+                  (unsigned long long)builds[0].sets, (unsigned long long)builds[1].sets);
+    report << line;
+    std::snprintf(line, sizeof(line), "  %-40s %12llu %12llu\n", "SetDataOnSimObject bytes",
+                  (unsigned long long)builds[0].bytes, (unsigned long long)builds[1].bytes);
+    report << line;
+    std::snprintf(line, sizeof(line), "  %-40s %12llu %12llu\n", "SimConnect calls",
+                  (unsigned long long)builds[0].calls, (unsigned long long)builds[1].calls);
+    report << line;
+    std::snprintf(line, sizeof(line), "  %-40s %12.1f %12.1f\n", "Bytes delivered and set per frame",
+                  double(builds[0].received + builds[0].bytes) / std::max<uint64_t>(1, frames),
+                  double(builds[1].received + builds[1].bytes) / std::max<uint64_t>(1, frames));
+    report << line;
+
+    double means[2] = {}, missMeans[2] = {};
+    for (int b = 0; b < 2; b++) {
+        for (const double time: builds[b].frameMicroSeconds)
+            means[b] += time;
+        means[b] /= std::max<size_t>(1, builds[b].frameMicroSeconds.size());
+        for (const double misses: builds[b].frameCacheMisses)
+            missMeans[b] += misses;
+        missMeans[b] /= std::max<size_t>(1, builds[b].frameCacheMisses.size());
+    }
+    std::snprintf(line, sizeof(line), "  %-40s %12.2f %12.2f\n", "Frame time mean (us)", means[0], means[1]);
+    report << line;
+    std::snprintf(line, sizeof(line), "  %-40s %12.2f %12.2f\n", "Frame time 99th percentile (us)",
+                  percentile(builds[0].frameMicroSeconds, 0.99), percentile(builds[1].frameMicroSeconds, 0.99));
+    report << line;
+    std::snprintf(line, sizeof(line), "  %-40s %12.2f %12.2f\n", "Frame time max (us)",
+                  percentile(builds[0].frameMicroSeconds, 1), percentile(builds[1].frameMicroSeconds, 1));
+    report << line;
+    if (cacheMisses.ok()) {
+        std::snprintf(line, sizeof(line), "  %-40s %12.1f %12.1f\n", "Cache misses per frame mean",
+                      missMeans[0], missMeans[1]);
+        report << line;
+        std::snprintf(line, sizeof(line), "  %-40s %12.0f %12.0f\n", "Cache misses per frame max",
+                      percentile(builds[0].frameCacheMisses, 1), percentile(builds[1].frameCacheMisses, 1));
+        report << line;
+    } else {
+        report << "  Cache misses not counted here\n";
+    }
+
+    return divergence.found ? StatusDifferent : StatusSame;
+}
+
+struct Job {
+    pid_t pid = 0;
+    int pipe = -1;
+    std::string report;
+    int status = -1;
+};
+
+// Run the replay of recording in a child process that writes its report to the returned job's pipe
+Job start(const std::string &recording) {
+    Job job;
+    int fds[2];
+    if (::pipe(fds) != 0) {
+        job.report = recording + ": cannot create a pipe\n";
+        job.status = StatusError;
+        return job;
+    }
+
+    std::fflush(stdout);
+    job.pid = fork();
+    if (job.pid == 0) {
+        close(fds[0]);
+        if (!options.verbose) {
+            const int null = ::open("/dev/null", O_WRONLY);
+            dup2(null, STDOUT_FILENO);
+            dup2(null, STDERR_FILENO);
+        }
+        std::ostringstream report;
+        const Status status = replay(recording, report);
+        const std::string text = report.str();
+        for (size_t written = 0; written < text.size(); ) {
+            const ssize_t n = write(fds[1], text.data() + written, text.size() - written);
+            if (n <= 0)
+                break;
+            written += n;
+        }
+        std::fflush(stdout);
+        _exit(status);
+    }
+
+    close(fds[1]);
+    if (job.pid < 0) {
+        close(fds[0]);
+        job.report = recording + ": cannot start a process\n";
+        job.status = StatusError;
+    } else {
+        job.pipe = fds[0];
+    }
+    return job;
+}
+
+int usage() {
+    std::fprintf(stderr, "usage: replay [-j jobs] [-t tolerance] [-v] a.so b.so recording...\n");
+    return StatusError;
+}
+
+} // namespace
+
+int main(int argc, char **argv) {
+    int opt;
+    while ((opt = getopt(argc, argv, "j:t:v")) != -1) {
+        switch (opt) {
+        case 'j':
+            options.jobs = std::atoi(optarg);
+            break;
+        case 't':
+            options.tolerance = std::atof(optarg);
+            break;
+        case 'v':
+            options.verbose = true;
+            break;
+        default:
+            return usage();
+        }
+    }
+    if (argc - optind < 3)
+        return usage();
+    options.builds[0] = argv[optind++];
+    options.builds[1] = argv[optind++];
+    while (optind < argc)
+        options.recordings.push_back(argv[optind++]);
+
+    // The gauges are loaded after chdir() into the work folder
+    for (std::string &build: options.builds) {
+        char *path = realpath(build.c_str(), nullptr);
+        if (path == nullptr) {
+            std::fprintf(stderr, "replay: cannot find %s\n", build.c_str());
+            return StatusError;
+        }
+        build = path;
+        std::free(path);
+    }
+    if (options.jobs <= 0)
+        options.jobs = std::max(1L, sysconf(_SC_NPROCESSORS_ONLN));
+
+    std::vector<Job> jobs;
+    size_t next = 0, printed = 0;
+    int running = 0;
+    int result = StatusSame;
+    while (printed < options.recordings.size()) {
+        while (running < options.jobs && next < options.recordings.size()) {
+            jobs.push_back(start(options.recordings[next++]));
+            running += jobs.back().pipe >= 0;
+        }
+
+        // Read the reports as they come, so that no child blocks on a full pipe
+        std::vector<pollfd> fds;
+        std::vector<Job*> polled;
+        for (Job &job: jobs) {
+            if (job.pipe >= 0) {
+                fds.push_back({ job.pipe, POLLIN, 0 });
+                polled.push_back(&job);
+            }
+        }
+        if (!fds.empty() && poll(fds.data(), fds.size(), -1) > 0) {
+            for (size_t i = 0; i < fds.size(); i++) {
+                if (fds[i].revents == 0)
+                    continue;
+                Job &job = *polled[i];
+                char buffer[4096];
+                const ssize_t n = read(job.pipe, buffer, sizeof(buffer));
+                if (n > 0) {
+                    job.report.append(buffer, n);
+                    continue;
+                }
+                close(job.pipe);
+                job.pipe = -1;
+                running--;
+
+                int status;
+                waitpid(job.pid, &status, 0);
+                job.status = WIFEXITED(status) ? WEXITSTATUS(status) : StatusError;
+                if (job.status == StatusError && job.report.empty())
+                    job.report = options.recordings[&job - jobs.data()] + ": the replay crashed\n";
+            }
+        }
+
+        // In the order given
+        for (; printed < jobs.size() && jobs[printed].status >= 0; printed++) {
+            std::fputs(jobs[printed].report.c_str(), stdout);
+            result = std::max(result, jobs[printed].status);
+        }
+        std::fflush(stdout);
+    }
+    return result;
+}
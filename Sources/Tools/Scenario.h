@@ -0,0 +1,418 @@
+// -*- comment-column: 50; fill-column: 110; c-basic-offset: 4; tab-width: 4; indent-tabs-mode: nil -*-
+
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <dirent.h>
+#include <strings.h>
+
+// Initial conditions for offline runs of the gauge, from the .flt files that the aircraft ships for each
+// flight phase (PackageSources/SimObjects/Airplanes/FlyingBrick), so that a run can start from any of them
+// without a fixture written by hand. What a .flt says about the user aircraft becomes values of the SimVars
+// in the state:
+//
+// - [SimVars.0]: Latitude and Longitude (like N47° 25' 53.22" or in degrees), Altitude (feet MSL), Heading,
+//   Pitch and Bank (degrees), the body velocities (feet per second) and SimOnGround.
+// - [SimVarForSpawningInTheAir.0]: that the flight starts in the air, at IAS knots.
+// - [Engine Parameters.1.0]: ThrottleLeverPct and IgnitionSwitch.
+// - [Controls.0]: ParkingBrake, YokeX, YokeY and Rudder, which are 0 to 100 with 50 centred.
+// - [Gauges.0]: KollsmanSetting, as the ambient pressure.
+//
+// The shipped files leave the position to where the user starts the flight, so without one a scenario has
+// an AGL instead: on the ground, resting on it, and in the air, a height for the phase its name suggests.
+//
+// A whole folder of them is parsed on as many threads as there are processors, and the results are cached
+// in a file of fixed-size records, each with a hash of its source file, so that only changed files are
+// parsed again.
+
+struct ScenarioValue {
+    char name[48];                                // A SimVar of the state, as in the state layout
+    double value;                                 // In the unit of the state layout
+};
+
+struct Scenario {
+    static constexpr int MaxValues = 24;
+
+    char path[256];
+    uint64_t sourceHash;
+    char name[32];                                // The file name without .flt, like "approach"
+
+    bool airborne;
+    bool hasMsl;                                  // If not, agl places the aircraft
+    double agl;
+
+    uint32_t count;
+    ScenarioValue values[MaxValues];
+
+    // NaN if the scenario does not set it
+    double get(const char *simVar) const {
+        for (uint32_t i = 0; i < count; i++) {
+            if (std::strcmp(values[i].name, simVar) == 0)
+                return values[i].value;
+        }
+        return NAN;
+    }
+
+    void set(const char *simVar, double value) {
+        for (uint32_t i = 0; i < count; i++) {
+            if (std::strcmp(values[i].name, simVar) == 0) {
+                values[i].value = value;
+                return;
+            }
+        }
+        if (count < MaxValues) {
+            std::snprintf(values[count].name, sizeof(values[count].name), "%s", simVar);
+            values[count++].value = value;
+        }
+    }
+};
+
+struct ScenarioCacheHeader {
+    static constexpr uint32_t Magic = 0x4e434246;   // "FBCN"
+
+    // Bump this when what is cached changes meaning without changing size
+    static constexpr uint32_t Version = 1;
+
+    uint32_t magic;
+    uint32_t version;
+    uint32_t size;                                // sizeof(Scenario)
+    uint32_t count;
+    uint64_t checksum;                            // Of the scenarios that follow
+};
+
+struct ScenarioLoadStatistics {
+    size_t files, parsed, cached;
+    double milliSeconds;
+};
+
+// FNV-1a, eight bytes at a time, as for the gauge's compiled configuration
+inline uint64_t scenarioHash(const void *data, size_t size, uint64_t hash = 0xcbf29ce484222325ULL) {
+    static constexpr uint64_t Prime = 0x100000001b3ULL;
+    const unsigned char *bytes = static_cast<const unsigned char*>(data);
+    for (; size >= 8; bytes += 8, size -= 8) {
+        uint64_t word;
+        std::memcpy(&word, bytes, 8);
+        hash = (hash ^ word) * Prime;
+    }
+    for (; size > 0; bytes++, size--)
+        hash = (hash ^ *bytes) * Prime;
+    return hash;
+}
+
+inline bool readScenarioFile(const std::string &path, std::string &text) {
+    std::FILE *file = std::fopen(path.c_str(), "rb");
+    if (file == nullptr)
+        return false;
+    char buffer[8192];
+    size_t read;
+    text.clear();
+    while ((read = std::fread(buffer, 1, sizeof(buffer), file)) > 0)
+        text.append(buffer, read);
+    std::fclose(file);
+    return true;
+}
+
+// Degrees, from a number or from the .flt form N47° 25' 53.22", to radians
+inline double parseScenarioAngle(const char *text) {
+    while (*text == ' ')
+        text++;
+    double sign = 1;
+    if (*text == 'N' || *text == 'E' || *text == 'S' || *text == 'W') {
+        sign = *text == 'S' || *text == 'W' ? -1 : 1;
+        text++;
+    }
+    double degrees = 0, scale = 1;
+    for (int part = 0; part < 3 && *text != 0; part++, scale /= 60) {
+        char *end;
+        const double value = std::strtod(text, &end);
+        if (end == text)
+            break;
+        degrees += value * scale;
+        text = end;
+        while (*text != 0 && (*text < '0' || *text > '9') && *text != '-' && *text != '+' && *text != '.')
+            text++;
+    }
+    return sign * degrees * M_PI / 180;
+}
+
+// Parse the text of a .flt file into scenario, which should have its name set
+inline void parseScenario(const std::string &text, Scenario &scenario) {
+    static constexpr double KnotsInFeetPerSecond = 1.68781042021544;
+
+    scenario.airborne = false;
+    scenario.hasMsl = false;
+    scenario.agl = 0;
+    scenario.count = 0;
+    double ias = 0, heading = 0;
+    bool haveVelocity = false;
+
+    char section[64] = "";
+    for (size_t start = 0; start < text.size(); ) {
+        size_t end = text.find('\n', start);
+        if (end == std::string::npos)
+            end = text.size();
+        char line[256];
+        const size_t length = std::min(end - start, sizeof(line) - 1);
+        std::memcpy(line, text.data() + start, length);
+        line[length] = 0;
+        start = end + 1;
+
+        char *p = line;
+        while (*p == ' ' || *p == '\t')
+            p++;
+        char *last = p + std::strlen(p);
+        while (last > p && (last[-1] == '\r' || last[-1] == ' ' || last[-1] == '\t'))
+            *--last = 0;
+        if (*p == 0 || *p == ';')
+            continue;
+        if (*p == '[') {
+            char *close = std::strchr(p, ']');
+            if (close != nullptr)
+                *close = 0;
+            std::snprintf(section, sizeof(section), "%s", p + 1);
+            if (strcasecmp(section, "SimVarForSpawningInTheAir.0") == 0)
+                scenario.airborne = true;
+            continue;
+        }
+
+        char *equals = std::strchr(p, '=');
+        if (equals == nullptr)
+            continue;
+        char *keyEnd = equals;
+        while (keyEnd > p && (keyEnd[-1] == ' ' || keyEnd[-1] == '\t'))
+            keyEnd--;
+        *keyEnd = 0;
+        const char *key = p, *value = equals + 1;
+        while (*value == ' ' || *value == '\t')
+            value++;
+        const double number = strcasecmp(value, "True") == 0 ? 1 : strcasecmp(value, "False") == 0 ? 0 : std::atof(value);
+
+        if (strcasecmp(section, "SimVars.0") == 0) {
+            if (strcasecmp(key, "Latitude") == 0) {
+                scenario.set("PLANE LATITUDE", parseScenarioAngle(value));
+            } else if (strcasecmp(key, "Longitude") == 0) {
+                scenario.set("PLANE LONGITUDE", parseScenarioAngle(value));
+            } else if (strcasecmp(key, "Altitude") == 0) {
+                scenario.set("PLANE ALTITUDE", number);
+                scenario.hasMsl = true;
+            } else if (strcasecmp(key, "Heading") == 0) {
+                heading = number * M_PI / 180;
+                scenario.set("PLANE HEADING DEGREES TRUE", heading);
+            } else if (strcasecmp(key, "Pitch") == 0) {
+                scenario.set("PLANE PITCH DEGREES", number * M_PI / 180);
+            } else if (strcasecmp(key, "Bank") == 0) {
+                scenario.set("PLANE BANK DEGREES", number * M_PI / 180);
+            } else if (strcasecmp(key, "XVelBodyAxis") == 0) {
+                scenario.set("VELOCITY BODY X", number);
+                haveVelocity = true;
+            } else if (strcasecmp(key, "YVelBodyAxis") == 0) {
+                scenario.set("VELOCITY BODY Y", number);
+                haveVelocity = true;
+            } else if (strcasecmp(key, "ZVelBodyAxis") == 0) {
+                scenario.set("VELOCITY BODY Z", number);
+                haveVelocity = true;
+            } else if (strcasecmp(key, "SimOnGround") == 0) {
+                scenario.set("SIM ON GROUND", number);
+                scenario.airborne = scenario.airborne && number == 0;
+            }
+        } else if (strcasecmp(section, "SimVarForSpawningInTheAir.0") == 0) {
+            if (strcasecmp(key, "IAS") == 0)
+                ias = number;
+        } else if (strcasecmp(section, "Engine Parameters.1.0") == 0) {
+            if (strcasecmp(key, "ThrottleLeverPct") == 0)
+                scenario.set("GENERAL ENG THROTTLE LEVER POSITION:1", number);
+            else if (strcasecmp(key, "IgnitionSwitch") == 0)
+                scenario.set("MASTER IGNITION SWITCH", number != 0);
+        } else if (strcasecmp(section, "Controls.0") == 0) {
+            if (strcasecmp(key, "ParkingBrake") == 0)
+                scenario.set("BRAKE PARKING POSITION", number / 100);
+            else if (strcasecmp(key, "YokeX") == 0)
+                scenario.set("AILERON POSITION", (number - 50) / 50);
+            else if (strcasecmp(key, "YokeY") == 0)
+                scenario.set("ELEVATOR POSITION", (number - 50) / 50);
+            else if (strcasecmp(key, "Rudder") == 0)
+                scenario.set("RUDDER PEDAL POSITION", (number - 50) / 50);
+        } else if (strcasecmp(section, "Gauges.0") == 0) {
+            if (strcasecmp(key, "KollsmanSetting") == 0)
+                scenario.set("AMBIENT PRESSURE", number);
+        }
+    }
+
+    if (scenario.airborne) {
+        scenario.set("SIM ON GROUND", 0);
+        scenario.set("AIRSPEED INDICATED", ias);
+        if (!haveVelocity && ias > 0) {
+            scenario.set("VELOCITY BODY Z", ias * KnotsInFeetPerSecond);
+            scenario.set("VELOCITY WORLD X", ias * KnotsInFeetPerSecond * std::sin(heading));
+            scenario.set("VELOCITY WORLD Z", ias * KnotsInFeetPerSecond * std::cos(heading));
+        }
+    }
+    if (!scenario.hasMsl && scenario.airborne) {
+        static const struct {
+            const char *name;
+            double agl;
+        } phases[] = {
+            { "climb", 1000 },
+            { "cruise", 3000 },
+            { "approach", 1500 },
+            { "final", 300 },
+        };
+        scenario.agl = 1000;
+        for (const auto &phase: phases) {
+            if (strcasecmp(scenario.name, phase.name) == 0)
+                scenario.agl = phase.agl;
+        }
+    }
+}
+
+// The scenario of the .flt file at path, with text
+inline void parseScenario(const std::string &path, const std::string &text, uint64_t hash, Scenario &scenario) {
+    scenario = Scenario();
+    std::snprintf(scenario.path, sizeof(scenario.path), "%s", path.c_str());
+    std::string name = path.substr(path.find_last_of('/') + 1);
+    name = name.substr(0, name.size() - 4);
+    std::snprintf(scenario.name, sizeof(scenario.name), "%s", name.c_str());
+    scenario.sourceHash = hash;
+    parseScenario(text, scenario);
+}
+
+// Put the stand-in's sim (see StandIn/SimModel.h) in the initial conditions of the scenario
+template <typename Sim>
+void placeInScenario(Sim &sim, const Scenario &scenario) {
+    for (uint32_t i = 0; i < scenario.count; i++)
+        sim.set(scenario.values[i].name, scenario.values[i].value);
+    if (scenario.hasMsl)
+        sim.place(scenario.get("PLANE ALTITUDE") - sim.groundMsl);
+    else
+        sim.place(scenario.airborne ? scenario.agl : 0);
+}
+
+inline uint64_t scenarioChecksum(const std::vector<Scenario> &scenarios) {
+    return scenarioHash(scenarios.data(), scenarios.size() * sizeof(Scenario));
+}
+
+inline void readScenarioCache(const std::string &cacheFile, std::vector<Scenario> &cached) {
+    cached.clear();
+    std::FILE *file = std::fopen(cacheFile.c_str(), "rb");
+    if (file == nullptr)
+        return;
+    ScenarioCacheHeader header;
+    if (std::fread(&header, sizeof(header), 1, file) == 1
+        && header.magic == ScenarioCacheHeader::Magic
+        && header.version == ScenarioCacheHeader::Version
+        && header.size == sizeof(Scenario)
+        && header.count < 100000) {
+        cached.resize(header.count);
+        if (std::fread(cached.data(), sizeof(Scenario), header.count, file) != header.count
+            || scenarioChecksum(cached) != header.checksum)
+            cached.clear();
+    }
+    std::fclose(file);
+}
+
+inline void writeScenarioCache(const std::string &cacheFile, const std::vector<Scenario> &scenarios) {
+    ScenarioCacheHeader header = {
+        ScenarioCacheHeader::Magic, ScenarioCacheHeader::Version, uint32_t(sizeof(Scenario)),
+        uint32_t(scenarios.size()), scenarioChecksum(scenarios),
+    };
+    const std::string temporary = cacheFile + ".new";
+    std::FILE *file = std::fopen(temporary.c_str(), "wb");
+    if (file == nullptr)
+        return;
+    const bool written = (std::fwrite(&header, sizeof(header), 1, file) == 1
+                          && std::fwrite(scenarios.data(), sizeof(Scenario), scenarios.size(), file) == scenarios.size());
+    if (std::fclose(file) == 0 && written)
+        std::rename(temporary.c_str(), cacheFile.c_str());
+    else
+        std::remove(temporary.c_str());
+}
+
+// All .flt files in folder, in the order of their names. Files whose hash matches the cache are taken from
+// it, the others are parsed, on as many threads as there are processors, and the cache is rewritten with
+// the scenarios of this folder if anything was parsed. An empty cacheFile means no cache. Returns false, with the reason in
+// error, if the folder cannot be read or a file in it cannot.
+inline bool loadScenarios(const std::string &folder, const std::string &cacheFile, std::vector<Scenario> &scenarios,
+                          std::string &error, ScenarioLoadStatistics *statistics = nullptr) {
+    const auto start = std::chrono::steady_clock::now();
+    scenarios.clear();
+
+    std::vector<std::string> paths;
+    DIR *directory = opendir(folder.c_str());
+    if (directory == nullptr) {
+        error = "cannot read " + folder;
+        return false;
+    }
+    while (const dirent *entry = readdir(directory)) {
+        const size_t length = std::strlen(entry->d_name);
+        if (length > 4 && strcasecmp(entry->d_name + length - 4, ".flt") == 0)
+            paths.push_back(folder + "/" + entry->d_name);
+    }
+    closedir(directory);
+    std::sort(paths.begin(), paths.end());
+
+    std::vector<Scenario> cached;
+    if (!cacheFile.empty())
+        readScenarioCache(cacheFile, cached);
+
+    // Hashing a file costs as much as reading it, so that is done on the threads too
+    scenarios.resize(paths.size());
+    std::vector<char> ok(paths.size(), 0), fromCache(paths.size(), 0);
+    std::atomic<size_t> next(0);
+    const auto work = [&]() {
+        std::string text;
+        for (size_t i; (i = next++) < paths.size(); ) {
+            if (!readScenarioFile(paths[i], text))
+                continue;
+            const uint64_t hash = scenarioHash(text.data(), text.size());
+            for (const Scenario &scenario: cached) {
+                if (scenario.sourceHash == hash && paths[i] == scenario.path) {
+                    scenarios[i] = scenario;
+                    fromCache[i] = ok[i] = 1;
+                    break;
+                }
+            }
+            if (!fromCache[i]) {
+                parseScenario(paths[i], text, hash, scenarios[i]);
+                ok[i] = 1;
+            }
+        }
+    };
+    const size_t threads = std::min<size_t>(paths.size(), std::max(1u, std::thread::hardware_concurrency()));
+    std::vector<std::thread> pool;
+    for (size_t t = 1; t < threads; t++)
+        pool.emplace_back(work);
+    work();
+    for (std::thread &thread: pool)
+        thread.join();
+
+    size_t parsed = 0;
+    for (size_t i = 0; i < paths.size(); i++) {
+        if (!ok[i]) {
+            error = "cannot read " + paths[i];
+            scenarios.clear();
+            return false;
+        }
+        parsed += !fromCache[i];
+    }
+    if (parsed > 0 && !cacheFile.empty())
+        writeScenarioCache(cacheFile, scenarios);
+
+    if (statistics != nullptr) {
+        statistics->files = paths.size();
+        statistics->parsed = parsed;
+        statistics->cached = paths.size() - parsed;
+        statistics->milliSeconds = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+    }
+    return true;
+}
@@ -0,0 +1,33 @@
+// -*- comment-column: 50; fill-column: 110; c-basic-offset: 4; tab-width: 4; indent-tabs-mode: nil -*-
+
+#pragma once
+
+// The part of the MSFS SDK's MSFS.h that the gauge uses, for building it natively against the SimConnect
+// stand-in. See StandIn.h.
+
+#include <cstdint>
+
+typedef uint64_t FsContext;
+
+#define MSFS_CALLBACK __attribute__((visibility("default")))
+
+enum {
+    PANEL_SERVICE_PRE_QUERY = 0,
+    PANEL_SERVICE_POST_QUERY,
+    PANEL_SERVICE_PRE_INSTALL,
+    PANEL_SERVICE_POST_INSTALL,
+    PANEL_SERVICE_PRE_INITIALIZE,
+    PANEL_SERVICE_POST_INITIALIZE,
+    PANEL_SERVICE_PRE_UPDATE,
+    PANEL_SERVICE_POST_UPDATE,
+    PANEL_SERVICE_PRE_GENERATE,
+    PANEL_SERVICE_POST_GENERATE,
+    PANEL_SERVICE_PRE_DRAW,
+    PANEL_SERVICE_POST_DRAW,
+    PANEL_SERVICE_PRE_KILL,
+    PANEL_SERVICE_POST_KILL,
+    PANEL_SERVICE_CONNECT_TO_WINDOW,
+    PANEL_SERVICE_DISCONNECT,
+    PANEL_SERVICE_PANEL_OPEN,
+    PANEL_SERVICE_PANEL_CLOSE,
+};
@@ -0,0 +1,19 @@
+// -*- comment-column: 50; fill-column: 110; c-basic-offset: 4; tab-width: 4; indent-tabs-mode: nil -*-
+
+#pragma once
+
+// The part of the MSFS SDK's MSFS_Render.h that the gauge uses, for building it natively against the
+// SimConnect stand-in. See StandIn.h.
+
+struct sGaugeDrawData {
+    double mx, my;
+    double t;
+    double dt;
+    int winWidth, winHeight;
+    int fbWidth, fbHeight;
+};
+
+struct sGaugeInstallData {
+    int iSizeX, iSizeY;
+    char *strParameters;
+};
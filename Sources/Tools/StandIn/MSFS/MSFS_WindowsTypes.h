@@ -0,0 +1,30 @@
+// -*- comment-column: 50; fill-column: 110; c-basic-offset: 4; tab-width: 4; indent-tabs-mode: nil -*-
+
+#pragma once
+
+// The part of the MSFS SDK's MSFS_WindowsTypes.h that the gauge uses, for building it natively against the
+// SimConnect stand-in. See StandIn.h.
+
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+#include <strings.h>
+
+// 32 bits, as in wasm32 and on Windows, so that the messages have the same layout
+typedef uint32_t DWORD;
+typedef int32_t HRESULT;
+typedef int BOOL;
+typedef void *HANDLE;
+typedef void *HWND;
+typedef const char *LPCSTR;
+
+#define S_OK ((HRESULT)0)
+#define E_FAIL ((HRESULT)0x80004005)
+#define SUCCEEDED(hr) (((HRESULT)(hr)) >= 0)
+#define FAILED(hr) (((HRESULT)(hr)) < 0)
+
+#define TRUE 1
+#define FALSE 0
+
+#define MAX_PATH 260
+#define DWORD_MAX 0xffffffffU
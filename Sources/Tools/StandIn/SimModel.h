@@ -0,0 +1,345 @@
+// -*- comment-column: 50; fill-column: 110; c-basic-offset: 4; tab-width: 4; indent-tabs-mode: nil -*-
+
+#pragma once
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+#include <deque>
+#include <string>
+#include <vector>
+
+#include "StandIn.h"
+
+// The sim's side of the stand-in: a crude sim that an offline build of the gauge can fly closed loop, with
+// the sim's timing as a deterministic model. What the gauge sets takes effect in the sim, the freeze events
+// set the IS ... FREEZE ON flags, and what is not frozen the sim moves itself: it falls, it stops on the
+// ground, and on the ground it slows down. The timing model can make the time between frames vary, drop
+// state callbacks, and delay when what the gauge sets and the freezes take effect, the way the real sim
+// seems to at times.
+
+// Fast, and the same sequence for a seed on any platform, unlike the standard library's distributions
+class Random {
+public:
+    explicit Random(uint64_t seed) : state(seed) {
+    }
+
+    uint64_t next() {                             // splitmix64
+        uint64_t z = (state += 0x9e3779b97f4a7c15ULL);
+        z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ULL;
+        z = (z ^ (z >> 27)) * 0x94d049bb133111ebULL;
+        return z ^ (z >> 31);
+    }
+
+    // In [0, 1)
+    double uniform() {
+        return (next() >> 11) * (1.0 / 9007199254740992.0);
+    }
+
+    // In [-1, 1)
+    double symmetric() {
+        return 2 * uniform() - 1;
+    }
+
+    // In [0, n]
+    int upTo(int n) {
+        return n > 0 ? int(next() % uint64_t(n + 1)) : 0;
+    }
+
+private:
+    uint64_t state;
+};
+
+struct TimingModel {
+    double frameSeconds = 1 / 30.0;
+    double jitterSeconds = 0;                     // Each frame is up to this much shorter or longer
+    double dropProbability = 0;                   // Of a frame having no state callback
+    int applyDelayFrames = 0;                     // Most frames before what the gauge sets takes effect
+    int freezeDelayFrames = 0;                    // Most frames before the freeze flags follow the events
+    uint64_t seed = 1;
+};
+
+class SimModel {
+public:
+    // Where the sim puts the ground, and the AGL of the aircraft resting on it, which should match
+    // static_cg_height in flight_model.cfg
+    double groundMsl = 100;
+    double restingAgl = 9.18;
+
+    SimModel(const StandInApi &api, const TimingModel &timing) : api(api), timing(timing), random(timing.seed) {
+    }
+
+    // Call after the gauge is installed, when it has asked for the state
+    bool start() {
+        StandInDatum data[64];
+        const uint32_t count = api.stateLayout(data, 64);
+        if (count == 0 || count > 64)
+            return false;
+        size_t offset = 0;
+        for (uint32_t i = 0; i < count; i++) {
+            fields.push_back({ data[i].name, offset, data[i].size, data[i].integer });
+            offset += data[i].size;
+        }
+        state.assign(offset, 0);
+
+        set("MASTER IGNITION SWITCH", 1);
+        set("AMBIENT PRESSURE", 29.92);
+        set("PLANE LATITUDE", 0.8);
+        set("PLANE LONGITUDE", 0.4);
+        return true;
+    }
+
+    double get(const char *name) const {
+        const Field *field = find(name);
+        return field != nullptr ? read(*field) : 0;
+    }
+
+    void set(const char *name, double value) {
+        const Field *field = find(name);
+        if (field != nullptr)
+            write(*field, value);
+    }
+
+    // Deliver the SimVar with this value instead in the next frame only, leaving the sim's own state as it
+    // is, as for the zombie states the sim reports at times
+    void overrideOnce(const char *name, double value) {
+        const Field *field = find(name);
+        if (field != nullptr)
+            overrides.push_back({ 0, field, value });
+    }
+
+    // Put the aircraft this high above the ground, as if the gauge had not started yet
+    void place(double agl) {
+        set("PLANE ALTITUDE", groundMsl + agl);
+        updateGround();
+    }
+
+    // Seconds since start of the sim
+    double time() const {
+        return nanoseconds / 1e9;
+    }
+
+    int64_t frames() const {
+        return frame;
+    }
+
+    int64_t callbacks() const {
+        return callbacks_;
+    }
+
+    // SetDataOnSimObject calls and their bytes
+    int64_t sets() const {
+        return sets_;
+    }
+
+    int64_t bytes() const {
+        return bytes_;
+    }
+
+    // Frames in which the gauge set anything, and the seconds between those
+    int64_t outputFrames() const {
+        return outputFrames_;
+    }
+
+    double meanOutputGap() const {
+        return outputGaps > 0 ? outputGapSum / outputGaps : 0;
+    }
+
+    double outputGapDeviation() const {
+        const double mean = meanOutputGap();
+        return outputGaps > 0 ? std::sqrt(std::max(0.0, outputGapSquares / outputGaps - mean * mean)) : 0;
+    }
+
+    double maxOutputGap() const {
+        return maxOutputGap_;
+    }
+
+    // One frame of the sim: time passes, what is due takes effect, the sim moves what is not frozen, the
+    // gauge is updated, and unless the frame is dropped, or nothing changed enough for the gauge to want it,
+    // the gauge gets the state. Returns whether it did.
+    bool step() {
+        const double seconds = std::max(0.001, timing.frameSeconds + timing.jitterSeconds * random.symmetric());
+        nanoseconds += int64_t(seconds * 1e9);
+        frame++;
+
+        while (!pending.empty() && pending.front().frame <= frame) {
+            write(*pending.front().field, pending.front().value);
+            pending.pop_front();
+        }
+        move(seconds);
+
+        api.setTime(nanoseconds);
+        api.beginFrame();
+        api.update();
+        const bool delivered = random.uniform() >= timing.dropProbability && deliver();
+        overrides.clear();
+        if (delivered)
+            callbacks_++;
+
+        // What the gauge did in the update and in response to the state, to take effect later. The sim
+        // applies things in order.
+        const StandInFrame &result = *api.frame();
+        sets_ += result.sets;
+        bytes_ += result.bytes;
+        if (result.sets > 0) {
+            if (outputFrames_ > 0) {
+                const double gap = time() - lastOutput;
+                outputGaps++;
+                outputGapSum += gap;
+                outputGapSquares += gap * gap;
+                maxOutputGap_ = std::max(maxOutputGap_, gap);
+            }
+            outputFrames_++;
+            lastOutput = time();
+        }
+        if (result.writeCount > 0) {
+            lastApply = std::max(lastApply, frame + random.upTo(timing.applyDelayFrames));
+            for (uint32_t i = 0; i < result.writeCount; i++) {
+                const Field *field = find(result.writes[i].name);
+                if (field != nullptr)
+                    later(lastApply, *field, result.writes[i].value);
+            }
+        }
+        for (uint32_t i = 0; i < result.eventCount; i++)
+            event(result.events[i].name, result.events[i].data);
+        return delivered;
+    }
+
+private:
+    struct Field {
+        std::string name;
+        size_t offset, size;
+        bool integer;
+    };
+
+    struct Pending {
+        int64_t frame;
+        const Field *field;
+        double value;
+    };
+
+    const StandInApi &api;
+    const TimingModel timing;
+    Random random;
+
+    std::vector<Field> fields;
+    std::vector<char> state;                      // As delivered to the gauge
+    std::deque<Pending> pending;
+    std::vector<Pending> overrides;               // For the next frame only, see overrideOnce()
+    std::vector<char> overridden;
+    int64_t lastApply = 0, lastFreeze = 0;
+
+    int64_t nanoseconds = 1000000000;
+    int64_t frame = 0, callbacks_ = 0, sets_ = 0, bytes_ = 0;
+    int64_t outputFrames_ = 0, outputGaps = 0;
+    double lastOutput = 0, outputGapSum = 0, outputGapSquares = 0, maxOutputGap_ = 0;
+
+    const Field *find(const char *name) const {
+        for (const Field &field: fields) {
+            if (field.name == name)
+                return &field;
+        }
+        return nullptr;
+    }
+
+    double read(const Field &field) const {
+        const char *p = state.data() + field.offset;
+        if (field.integer) {
+            if (field.size == 8) { int64_t v; std::memcpy(&v, p, 8); return v; }
+            int32_t v; std::memcpy(&v, p, 4); return v;
+        }
+        if (field.size == 8) { double v; std::memcpy(&v, p, 8); return v; }
+        float v; std::memcpy(&v, p, 4); return v;
+    }
+
+    void write(const Field &field, double value) {
+        write(state.data(), field, value);
+    }
+
+    void write(char *data, const Field &field, double value) {
+        char *p = data + field.offset;
+        if (field.integer) {
+            if (field.size == 8) { int64_t v = int64_t(value); std::memcpy(p, &v, 8); }
+            else { int32_t v = int32_t(value); std::memcpy(p, &v, 4); }
+        } else {
+            if (field.size == 8) std::memcpy(p, &value, 8);
+            else { float v = float(value); std::memcpy(p, &v, 4); }
+        }
+    }
+
+    bool deliver() {
+        if (overrides.empty())
+            return api.deliverState(state.data(), state.size());
+        overridden = state;
+        for (const Pending &override: overrides)
+            write(overridden.data(), *override.field, override.value);
+        return api.deliverState(overridden.data(), overridden.size());
+    }
+
+    // Things take effect in the order the gauge did them, so one that is due waits for those before it
+    void later(int64_t due, const Field &field, double value) {
+        pending.push_back({ due, &field, value });
+    }
+
+    void event(const std::string &name, uint32_t data) {
+        static const struct {
+            const char *event, *flag;
+        } freezes[] = {
+            { "FREEZE_ALTITUDE_SET", "IS ALTITUDE FREEZE ON" },
+            { "FREEZE_ATTITUDE_SET", "IS ATTITUDE FREEZE ON" },
+            { "FREEZE_LATITUDE_LONGITUDE_SET", "IS LATITUDE LONGITUDE FREEZE ON" },
+        };
+        for (const auto &freeze: freezes) {
+            const Field *field = find(freeze.flag);
+            if (name == freeze.event && field != nullptr) {
+                lastFreeze = std::max(lastFreeze, frame + random.upTo(timing.freezeDelayFrames));
+                later(lastFreeze, *field, data != 0);
+            }
+        }
+        if (name == "PARKING_BRAKES")
+            set("BRAKE PARKING POSITION", get("BRAKE PARKING POSITION") > 0.5 ? 0 : 1);
+    }
+
+    // What the sim does by itself with what is not frozen
+    void move(double seconds) {
+        const bool onGround = get("SIM ON GROUND") != 0;
+        if (get("IS ALTITUDE FREEZE ON") == 0) {
+            double vy = onGround ? 0 : get("VELOCITY WORLD Y") - 32.174 * seconds;
+            set("VELOCITY WORLD Y", vy);
+            set("VELOCITY BODY Y", vy);
+            set("VERTICAL SPEED", vy * 60);
+            set("PLANE ALTITUDE", get("PLANE ALTITUDE") + vy * seconds);
+        }
+        if (get("IS LATITUDE LONGITUDE FREEZE ON") == 0) {
+            static constexpr double EarthRadiusFeet = 20902231;
+            double vx = get("VELOCITY WORLD X"), vz = get("VELOCITY WORLD Z");
+            if (onGround) {
+                const double slowDown = std::max(0.0, 1 - 2 * seconds);
+                vx *= slowDown;
+                vz *= slowDown;
+            }
+            const double lat = get("PLANE LATITUDE");
+            set("PLANE LATITUDE", lat + vz * seconds / EarthRadiusFeet);
+            set("PLANE LONGITUDE", get("PLANE LONGITUDE") + vx * seconds / (EarthRadiusFeet * std::cos(lat)));
+            set("VELOCITY WORLD X", vx);
+            set("VELOCITY WORLD Z", vz);
+        }
+        updateGround();
+    }
+
+    void updateGround() {
+        double agl = get("PLANE ALTITUDE") - groundMsl;
+        if (agl <= restingAgl) {
+            agl = restingAgl;
+            set("PLANE ALTITUDE", groundMsl + agl);
+            if (get("VELOCITY WORLD Y") < 0) {
+                set("VELOCITY WORLD Y", 0);
+                set("VELOCITY BODY Y", 0);
+                set("VERTICAL SPEED", 0);
+            }
+        }
+        set("PLANE ALT ABOVE GROUND", agl);
+        set("SIM ON GROUND", agl <= restingAgl + 0.1);
+    }
+};
@@ -0,0 +1,485 @@
+// -*- comment-column: 50; fill-column: 110; c-basic-offset: 4; tab-width: 4; indent-tabs-mode: nil -*-
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <map>
+#include <set>
+#include <string>
+#include <vector>
+
+#include "MSFS/MSFS.h"
+#include "SimConnect.h"
+
+#include "FrameClock.h"
+#include "StandIn.h"
+
+// The gauges of the module, one per variant, see Variant.h
+extern "C" MSFS_CALLBACK bool FlightModel_gauge_callback(FsContext ctx, int service_id, void* pData);
+extern "C" MSFS_CALLBACK bool HeavyBrick_gauge_callback(FsContext ctx, int service_id, void* pData);
+extern "C" MSFS_CALLBACK bool DemoBrick_gauge_callback(FsContext ctx, int service_id, void* pData);
+
+FrameClock::time_point FrameClock::current;
+
+namespace {
+
+// Names of SimVars and events, interned so that pointers to them stay valid
+std::set<std::string> names;
+
+const char *intern(const char *name) {
+    return names.insert(name).first->c_str();
+}
+
+struct Datum {
+    const char *name;
+    SIMCONNECT_DATATYPE type;
+    float epsilon;
+};
+
+struct DataRequest {
+    SIMCONNECT_DATA_DEFINITION_ID definition;
+    SIMCONNECT_PERIOD period;
+    SIMCONNECT_DATA_REQUEST_FLAG flags;
+    std::vector<char> delivered;                  // For SIMCONNECT_DATA_REQUEST_FLAG_CHANGED, empty until then
+};
+
+struct ClientDataRequest {
+    SIMCONNECT_CLIENT_DATA_ID clientData;
+    SIMCONNECT_CLIENT_DATA_DEFINITION_ID definition;
+};
+
+struct Connection {
+    bool open = false;
+    DispatchProc dispatch = nullptr;
+    void *context = nullptr;
+    DWORD lastSentPacket = 0;
+
+    std::map<SIMCONNECT_DATA_DEFINITION_ID, std::vector<Datum>> definitions;
+    std::map<SIMCONNECT_DATA_REQUEST_ID, DataRequest> dataRequests;
+    std::map<SIMCONNECT_CLIENT_EVENT_ID, const char*> systemEvents;
+    std::map<SIMCONNECT_CLIENT_EVENT_ID, const char*> clientEvents;
+    std::map<SIMCONNECT_CLIENT_DATA_ID, const char*> clientData;
+    std::map<SIMCONNECT_DATA_REQUEST_ID, ClientDataRequest> clientDataRequests;
+};
+
+Connection connection;
+
+// What the gauge last wrote to each client data area, by name. Like in the sim, this outlives the connection.
+std::map<std::string, std::vector<char>> clientDataAreas;
+
+StandInFrame frame;
+std::vector<StandInWrite> writes;
+std::vector<StandInEvent> events;
+
+// Messages are built here. Eight-byte aligned, like the sim's receive buffer.
+std::vector<uint64_t> message;
+
+HRESULT call() {
+    frame.calls++;
+    if (!connection.open)
+        return E_FAIL;
+    connection.lastSentPacket++;
+    return S_OK;
+}
+
+// The size of a message without its data, which starts at the trailing dwData
+template <typename Message>
+constexpr size_t withoutData() {
+    return sizeof(Message) - sizeof(DWORD);
+}
+
+template <typename Message>
+Message &newMessage(SIMCONNECT_RECV_ID id, size_t size) {
+    message.assign((size + 7) / 8, 0);
+    Message &result = *reinterpret_cast<Message*>(message.data());
+    result.dwSize = size;
+    result.dwVersion = 1;
+    result.dwID = id;
+    return result;
+}
+
+void dispatch(size_t size) {
+    frame.received += uint32_t(size);
+    connection.dispatch(reinterpret_cast<SIMCONNECT_RECV*>(message.data()), size, connection.context);
+}
+
+size_t datumSize(const Datum &datum) {
+    return datum.type == SIMCONNECT_DATATYPE_INT32 || datum.type == SIMCONNECT_DATATYPE_FLOAT32 ? 4 : 8;
+}
+
+// The value of a datum at the start of data, which has at least datumSize() bytes
+double datumValue(const Datum &datum, const char *data) {
+    switch (datum.type) {
+    case SIMCONNECT_DATATYPE_INT32: { int32_t v; std::memcpy(&v, data, sizeof(v)); return v; }
+    case SIMCONNECT_DATATYPE_INT64: { int64_t v; std::memcpy(&v, data, sizeof(v)); return v; }
+    case SIMCONNECT_DATATYPE_FLOAT32: { float v; std::memcpy(&v, data, sizeof(v)); return v; }
+    default: { double v; std::memcpy(&v, data, sizeof(v)); return v; }
+    }
+}
+
+const char *findName(const std::map<SIMCONNECT_CLIENT_EVENT_ID, const char*> &map, const char *name,
+                     SIMCONNECT_CLIENT_EVENT_ID &id) {
+    for (const auto &entry: map) {
+        if (strcasecmp(entry.second, name) == 0) {
+            id = entry.first;
+            return entry.second;
+        }
+    }
+    return nullptr;
+}
+
+} // namespace
+
+HRESULT SimConnect_Open(HANDLE *phSimConnect, LPCSTR, HWND, DWORD, HANDLE, DWORD) {
+    frame.calls++;
+    connection = Connection();
+    connection.open = true;
+    *phSimConnect = &connection;
+    return S_OK;
+}
+
+HRESULT SimConnect_Close(HANDLE) {
+    frame.calls++;
+    connection = Connection();
+    return S_OK;
+}
+
+HRESULT SimConnect_CallDispatch(HANDLE, DispatchProc pfcnDispatch, void *pContext) {
+    connection.dispatch = pfcnDispatch;
+    connection.context = pContext;
+    return call();
+}
+
+HRESULT SimConnect_GetLastSentPacketID(HANDLE, DWORD *pdwError) {
+    *pdwError = connection.lastSentPacket;
+    return S_OK;
+}
+
+HRESULT SimConnect_SubscribeToSystemEvent(HANDLE, SIMCONNECT_CLIENT_EVENT_ID EventID, const char *SystemEventName) {
+    connection.systemEvents[EventID] = intern(SystemEventName);
+    return call();
+}
+
+HRESULT SimConnect_MapClientEventToSimEvent(HANDLE, SIMCONNECT_CLIENT_EVENT_ID EventID, const char *EventName) {
+    connection.clientEvents[EventID] = intern(EventName);
+    return call();
+}
+
+HRESULT SimConnect_AddClientEventToNotificationGroup(HANDLE, SIMCONNECT_NOTIFICATION_GROUP_ID, SIMCONNECT_CLIENT_EVENT_ID,
+                                                     BOOL) {
+    return call();
+}
+
+HRESULT SimConnect_SetNotificationGroupPriority(HANDLE, SIMCONNECT_NOTIFICATION_GROUP_ID, DWORD) {
+    return call();
+}
+
+HRESULT SimConnect_TransmitClientEvent(HANDLE, SIMCONNECT_OBJECT_ID, SIMCONNECT_CLIENT_EVENT_ID EventID, DWORD dwData,
+                                       SIMCONNECT_NOTIFICATION_GROUP_ID, SIMCONNECT_EVENT_FLAG) {
+    const auto event = connection.clientEvents.find(EventID);
+    events.push_back({ event != connection.clientEvents.end() ? event->second : "(unmapped)", (uint32_t)dwData });
+    frame.events = events.data();
+    frame.eventCount = events.size();
+    return call();
+}
+
+HRESULT SimConnect_AddToDataDefinition(HANDLE, SIMCONNECT_DATA_DEFINITION_ID DefineID, const char *DatumName,
+                                       const char *, SIMCONNECT_DATATYPE DatumType, float fEpsilon, DWORD) {
+    connection.definitions[DefineID].push_back({ intern(DatumName), DatumType, fEpsilon });
+    return call();
+}
+
+HRESULT SimConnect_ClearDataDefinition(HANDLE, SIMCONNECT_DATA_DEFINITION_ID DefineID) {
+    connection.definitions.erase(DefineID);
+    return call();
+}
+
+HRESULT SimConnect_RequestDataOnSimObject(HANDLE, SIMCONNECT_DATA_REQUEST_ID RequestID,
+                                          SIMCONNECT_DATA_DEFINITION_ID DefineID, SIMCONNECT_OBJECT_ID,
+                                          SIMCONNECT_PERIOD Period, SIMCONNECT_DATA_REQUEST_FLAG Flags, DWORD, DWORD,
+                                          DWORD) {
+    connection.dataRequests[RequestID] = { DefineID, Period, Flags, {} };
+    return call();
+}
+
+HRESULT SimConnect_SetDataOnSimObject(HANDLE, SIMCONNECT_DATA_DEFINITION_ID DefineID, SIMCONNECT_OBJECT_ID,
+                                      SIMCONNECT_DATA_SET_FLAG, DWORD, DWORD cbUnitSize, void *pDataSet) {
+    frame.sets++;
+    frame.bytes += cbUnitSize;
+
+    const auto definition = connection.definitions.find(DefineID);
+    if (definition == connection.definitions.end())
+        return call();
+
+    const char *data = static_cast<const char*>(pDataSet);
+    const char *const end = data + cbUnitSize;
+    for (const Datum &datum: definition->second) {
+        const size_t size = datumSize(datum);
+        if (data + size > end)
+            break;
+        const double value = datumValue(datum, data);
+        writes.push_back({ datum.name, value });
+        data += size;
+    }
+    frame.writes = writes.data();
+    frame.writeCount = writes.size();
+    return call();
+}
+
+HRESULT SimConnect_MapClientDataNameToID(HANDLE, const char *szClientDataName, SIMCONNECT_CLIENT_DATA_ID ClientDataID) {
+    connection.clientData[ClientDataID] = intern(szClientDataName);
+    return call();
+}
+
+HRESULT SimConnect_CreateClientData(HANDLE, SIMCONNECT_CLIENT_DATA_ID, DWORD, SIMCONNECT_CREATE_CLIENT_DATA_FLAG) {
+    return call();
+}
+
+HRESULT SimConnect_AddToClientDataDefinition(HANDLE, SIMCONNECT_CLIENT_DATA_DEFINITION_ID, DWORD, DWORD, float, DWORD) {
+    return call();
+}
+
+HRESULT SimConnect_ClearClientDataDefinition(HANDLE, SIMCONNECT_CLIENT_DATA_DEFINITION_ID) {
+    return call();
+}
+
+HRESULT SimConnect_RequestClientData(HANDLE, SIMCONNECT_CLIENT_DATA_ID ClientDataID, SIMCONNECT_DATA_REQUEST_ID RequestID,
+                                     SIMCONNECT_CLIENT_DATA_DEFINITION_ID DefineID, SIMCONNECT_CLIENT_DATA_PERIOD,
+                                     SIMCONNECT_CLIENT_DATA_REQUEST_FLAG, DWORD, DWORD, DWORD) {
+    connection.clientDataRequests[RequestID] = { ClientDataID, DefineID };
+    return call();
+}
+
+HRESULT SimConnect_SetClientData(HANDLE, SIMCONNECT_CLIENT_DATA_ID ClientDataID, SIMCONNECT_CLIENT_DATA_DEFINITION_ID,
+                                 SIMCONNECT_CLIENT_DATA_SET_FLAG, DWORD, DWORD cbUnitSize, void *pDataSet) {
+    const auto name = connection.clientData.find(ClientDataID);
+    if (connection.open && name != connection.clientData.end()) {
+        const char *data = static_cast<const char*>(pDataSet);
+        clientDataAreas[name->second].assign(data, data + cbUnitSize);
+    }
+    return call();
+}
+
+namespace {
+
+typedef bool (*GaugeCallback)(FsContext ctx, int service_id, void* pData);
+
+// By the name panel.cfg gives as wasm_gauge
+const struct {
+    const char *name;
+    GaugeCallback callback;
+} gauges[] = {
+    { "FlightModel", FlightModel_gauge_callback },
+    { "HeavyBrick", HeavyBrick_gauge_callback },
+    { "DemoBrick", DemoBrick_gauge_callback },
+};
+
+GaugeCallback gauge = FlightModel_gauge_callback;
+
+bool selectGauge(const char *name) {
+    for (const auto &candidate: gauges) {
+        if (std::strcmp(candidate.name, name) == 0) {
+            gauge = candidate.callback;
+            return true;
+        }
+    }
+    return false;
+}
+
+void install() {
+    gauge(0, PANEL_SERVICE_PRE_INSTALL, nullptr);
+}
+
+void update() {
+    gauge(0, PANEL_SERVICE_PRE_UPDATE, nullptr);
+}
+
+void kill() {
+    gauge(0, PANEL_SERVICE_PRE_KILL, nullptr);
+}
+
+void setTime(int64_t nanoseconds) {
+    FrameClock::set(nanoseconds);
+}
+
+void beginFrame() {
+    writes.clear();
+    events.clear();
+    frame = StandInFrame();
+    frame.writes = writes.data();
+    frame.events = events.data();
+}
+
+const StandInFrame *currentFrame() {
+    return &frame;
+}
+
+DataRequest *periodicRequest(SIMCONNECT_DATA_REQUEST_ID &id) {
+    for (auto &request: connection.dataRequests) {
+        if (request.second.period != SIMCONNECT_PERIOD_NEVER && request.second.period != SIMCONNECT_PERIOD_ONCE) {
+            id = request.first;
+            return &request.second;
+        }
+    }
+    return nullptr;
+}
+
+// Like the sim, with SIMCONNECT_DATA_REQUEST_FLAG_CHANGED only what differs by more than the epsilon of some
+// datum from what was last delivered is delivered
+bool changed(DataRequest &request, const char *data, uint32_t size) {
+    if (!(request.flags & SIMCONNECT_DATA_REQUEST_FLAG_CHANGED))
+        return true;
+
+    bool result = request.delivered.size() != size;
+    size_t offset = 0;
+    for (const Datum &datum: connection.definitions[request.definition]) {
+        if (result || offset + datumSize(datum) > size)
+            break;
+        result = std::fabs(datumValue(datum, data + offset) - datumValue(datum, request.delivered.data() + offset))
+            > datum.epsilon;
+        offset += datumSize(datum);
+    }
+    if (result)
+        request.delivered.assign(data, data + size);
+    return result;
+}
+
+bool deliverState(const void *data, uint32_t size) {
+    SIMCONNECT_DATA_REQUEST_ID id;
+    DataRequest *request = periodicRequest(id);
+    if (connection.dispatch == nullptr || request == nullptr || !changed(*request, static_cast<const char*>(data), size))
+        return false;
+
+    const size_t total = withoutData<SIMCONNECT_RECV_SIMOBJECT_DATA>() + size;
+    SIMCONNECT_RECV_SIMOBJECT_DATA &received = newMessage<SIMCONNECT_RECV_SIMOBJECT_DATA>(SIMCONNECT_RECV_ID_SIMOBJECT_DATA, total);
+    received.dwRequestID = id;
+    received.dwObjectID = SIMCONNECT_OBJECT_ID_USER;
+    received.dwDefineID = request->definition;
+    received.dwentrynumber = received.dwoutof = 1;
+    received.dwDefineCount = connection.definitions[request->definition].size();
+    std::memcpy(&received.dwData, data, size);
+    dispatch(total);
+    return true;
+}
+
+bool deliverSystemEvent(const char *name, uint32_t data) {
+    SIMCONNECT_CLIENT_EVENT_ID id;
+    if (connection.dispatch == nullptr || findName(connection.systemEvents, name, id) == nullptr)
+        return false;
+
+    // These come with the name of a file
+    static const char *const fileNameEvents[] = { "AircraftLoaded", "FlightLoaded", "FlightSaved", "FlightPlanActivated" };
+    bool withFileName = false;
+    for (const char *fileNameEvent: fileNameEvents)
+        withFileName |= strcasecmp(fileNameEvent, name) == 0;
+
+    const size_t total = withFileName ? sizeof(SIMCONNECT_RECV_EVENT_FILENAME) : sizeof(SIMCONNECT_RECV_EVENT);
+    SIMCONNECT_RECV_EVENT &received = newMessage<SIMCONNECT_RECV_EVENT>(withFileName ? SIMCONNECT_RECV_ID_EVENT_FILENAME : SIMCONNECT_RECV_ID_EVENT,
+                                                                         total);
+    received.uGroupID = DWORD_MAX;
+    received.uEventID = id;
+    received.dwData = data;
+    dispatch(total);
+    return true;
+}
+
+bool deliverClientEvent(const char *name, uint32_t data) {
+    SIMCONNECT_CLIENT_EVENT_ID id;
+    if (connection.dispatch == nullptr || findName(connection.clientEvents, name, id) == nullptr)
+        return false;
+
+    SIMCONNECT_RECV_EVENT &received = newMessage<SIMCONNECT_RECV_EVENT>(SIMCONNECT_RECV_ID_EVENT, sizeof(SIMCONNECT_RECV_EVENT));
+    received.uGroupID = DWORD_MAX;
+    received.uEventID = id;
+    received.dwData = data;
+    dispatch(sizeof(SIMCONNECT_RECV_EVENT));
+    return true;
+}
+
+bool deliverClientData(const char *name, const void *data, uint32_t size) {
+    SIMCONNECT_CLIENT_EVENT_ID clientData;
+    if (connection.dispatch == nullptr || findName(connection.clientData, name, clientData) == nullptr)
+        return false;
+
+    bool delivered = false;
+    for (const auto &request: connection.clientDataRequests) {
+        if (request.second.clientData != clientData)
+            continue;
+
+        const size_t total = withoutData<SIMCONNECT_RECV_CLIENT_DATA>() + size;
+        SIMCONNECT_RECV_CLIENT_DATA &received = newMessage<SIMCONNECT_RECV_CLIENT_DATA>(SIMCONNECT_RECV_ID_CLIENT_DATA, total);
+        received.dwRequestID = request.first;
+        received.dwDefineID = request.second.definition;
+        received.dwentrynumber = received.dwoutof = 1;
+        std::memcpy(&received.dwData, data, size);
+        dispatch(total);
+        delivered = true;
+
+        // The dispatch procedure may have re-created the requests
+        break;
+    }
+    return delivered;
+}
+
+// As if the latest call had failed
+bool deliverException(uint32_t exception) {
+    if (connection.dispatch == nullptr)
+        return false;
+
+    SIMCONNECT_RECV_EXCEPTION &received = newMessage<SIMCONNECT_RECV_EXCEPTION>(SIMCONNECT_RECV_ID_EXCEPTION, sizeof(SIMCONNECT_RECV_EXCEPTION));
+    received.dwException = exception;
+    received.dwSendID = connection.lastSentPacket;
+    received.dwIndex = DWORD_MAX;
+    dispatch(sizeof(SIMCONNECT_RECV_EXCEPTION));
+    return true;
+}
+
+uint32_t clientData(const char *name, void *data, uint32_t size) {
+    const auto area = clientDataAreas.find(name);
+    if (area == clientDataAreas.end())
+        return 0;
+
+    const uint32_t written = uint32_t(area->second.size());
+    std::memcpy(data, area->second.data(), std::min(size, written));
+    return written;
+}
+
+uint32_t stateLayout(StandInDatum *result, uint32_t size) {
+    SIMCONNECT_DATA_REQUEST_ID id;
+    const DataRequest *request = periodicRequest(id);
+    if (request == nullptr)
+        return 0;
+
+    const std::vector<Datum> &data = connection.definitions[request->definition];
+    for (uint32_t i = 0; i < data.size() && i < size; i++) {
+        const SIMCONNECT_DATATYPE type = data[i].type;
+        result[i].name = data[i].name;
+        result[i].size = datumSize(data[i]);
+        result[i].integer = type == SIMCONNECT_DATATYPE_INT32 || type == SIMCONNECT_DATATYPE_INT64;
+    }
+    return data.size();
+}
+
+const StandInApi api = {
+    StandInApi::CurrentVersion,
+    selectGauge,
+    install,
+    update,
+    kill,
+    setTime,
+    beginFrame,
+    currentFrame,
+    deliverState,
+    deliverSystemEvent,
+    deliverClientEvent,
+    deliverClientData,
+    deliverException,
+    stateLayout,
+    clientData,
+};
+
+} // namespace
+
+const StandInApi *standInApi() {
+    return &api;
+}
@@ -0,0 +1,99 @@
+// -*- comment-column: 50; fill-column: 110; c-basic-offset: 4; tab-width: 4; indent-tabs-mode: nil -*-
+
+#pragma once
+
+#include <cstdint>
+
+// A stand-in for SimConnect and for the sim calling the gauge, so that the gauge can be built natively and
+// driven by tools without the sim. The headers in this folder declare the part of the MSFS SDK that the gauge
+// uses. Build the gauge as a shared library with them, from the top of the repository, with g++ or clang++:
+//
+//   -std=c++14 -O2 -shared -fPIC -fvisibility=hidden -Wl,-Bsymbolic
+//   -DFLYINGBRICK_OFFLINE=1 -DWORK_FOLDER='"./"' -DFOLDER_SEPARATOR='"/"'
+//   -DAIRPLANES_FOLDER='"<repository>/PackageSources/SimObjects/Airplanes/"'
+//   -ISources/Tools/StandIn -ISources/Code
+//   Sources/Code/*.cpp Sources/Tools/StandIn/StandIn.cpp -o flyingbrick.so
+//
+//
+// The library exports only standInApi(), so that several builds, or several copies of the same build, can
+// be loaded into one process side by side without sharing anything.
+//
+// The stand-in does not simulate anything by itself. What the gauge sets is collected per frame, see
+// StandInFrame, and what the gauge receives is whatever the tool delivers. For flying the gauge closed loop,
+// SimModel.h is a crude sim on top of this.
+
+struct StandInWrite {
+    const char *name;                             // The SimVar, stays valid as long as the library is loaded
+    double value;
+};
+
+struct StandInEvent {
+    const char *name;                             // The sim event, or the custom event name
+    uint32_t data;
+};
+
+struct StandInDatum {
+    const char *name;
+    uint32_t size;                                // In bytes
+    bool integer;
+};
+
+// What the gauge did since beginFrame()
+struct StandInFrame {
+    uint32_t calls;                               // SimConnect API calls of any kind
+    uint32_t sets;                                // SetDataOnSimObject calls
+    uint32_t bytes;                               // Payload bytes in them
+    uint32_t received;                            // Bytes of the messages delivered to the gauge
+
+    uint32_t writeCount;                          // The SimVars set, in the order set
+    const StandInWrite *writes;
+
+    uint32_t eventCount;                          // The events transmitted, in order
+    const StandInEvent *events;
+};
+
+struct StandInApi {
+    static constexpr uint32_t CurrentVersion = 5;
+
+    uint32_t version;
+
+    // The gauge the services below go to, by the name a panel.cfg gives as wasm_gauge, like HeavyBrick (see
+    // Variant.h). FlightModel, the FlyingBrick's, until another one is selected. Returns false, and selects
+    // nothing, if the module has no such gauge.
+    bool (*selectGauge)(const char *name);
+
+    // The gauge services the sim calls
+    void (*install)();
+    void (*update)();
+    void (*kill)();
+
+    // The FrameClock time in nanoseconds for what happens next
+    void (*setTime)(int64_t nanoseconds);
+
+    // Start collecting a new StandInFrame. The returned pointer stays valid, with contents that change.
+    void (*beginFrame)();
+    const StandInFrame *(*frame)();
+
+    // Call the gauge's dispatch procedure as the sim would. Each returns false, and does nothing, if the gauge
+    // has not asked for what is delivered, or, for state asked for only when it changes, if no SimVar in it
+    // differs from what was last delivered by more than its epsilon.
+    bool (*deliverState)(const void *data, uint32_t size);
+    bool (*deliverSystemEvent)(const char *name, uint32_t data);
+    bool (*deliverClientEvent)(const char *name, uint32_t data);
+    bool (*deliverClientData)(const char *name, const void *data, uint32_t size);
+    bool (*deliverException)(uint32_t exception);
+
+    // The SimVars in the data definition of the periodic data request, for composing what to deliver. Returns
+    // the number of them, and fills in at most size.
+    uint32_t (*stateLayout)(StandInDatum *data, uint32_t size);
+
+    // What the gauge last wrote to the named client data area, like THISAIRCRAFT ".Metrics". Returns the size
+    // of that, zero if nothing yet, and copies at most size bytes of it into data.
+    uint32_t (*clientData)(const char *name, void *data, uint32_t size);
+};
+
+extern "C" {
+typedef const StandInApi *(*StandInApiFunction)();
+
+__attribute__((visibility("default"))) const StandInApi *standInApi();
+}
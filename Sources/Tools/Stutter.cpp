@@ -0,0 +1,423 @@
+// -*- comment-column: 50; fill-column: 110; c-basic-offset: 4; tab-width: 4; indent-tabs-mode: nil -*-
+
+// Flies an offline build of the gauge closed loop against the stand-in's sim (see StandIn/SimModel.h) with
+// the sim's timing made worse in a repeatable way, and scores how smooth the flight looks, to find out how
+// much of the stutter near the ground comes from the sim's timing. Build the gauge as described in
+// StandIn/StandIn.h, and this, from the top of the repository, with:
+//
+//   g++ -std=c++14 -O2 -ISources/Tools/StandIn -ISources/Code Sources/Tools/Stutter.cpp -o stutter -ldl -pthread
+//
+// Usage: stutter [-n runs] [-s seed] [-r frame rate] [-j jitter ms] [-d drop %] [-a apply delay frames]
+//                [-z freeze delay frames] [-t seconds] [-p jump feet] [-f scenario folder] [-g] [-b gauge]
+//                [-x exceptions] [-v] flyingbrick.so
+//
+// Each run flies the same pilot inputs: a descent from 300 ft with some forward speed, a landing, a wait on
+// the ground, and a climb. With -g it starts parked on the ground instead, with the parking brake set, and
+// the climb has to take it off the ground: if it does not climb 10 ft the exit status is 1. The same goes
+// for the scenarios that start on the ground with the ignition on, like runway and taxi. Run i uses seed + i,
+// so a run that stutters can be repeated on its own with -n 1. With -b it flies the gauge of another brick,
+// like HeavyBrick (see Variant.h), with its own control path, instead of the FlyingBrick's FlightModel.
+// With -x, up to that many SimConnect exceptions are delivered to the gauge during the flight, from 3 seconds
+// in, as if the latest call had failed: alternately one that has the gauge re-create a subsystem and one that
+// has it re-open the connection. Each comes 100 state callbacks after the gauge recovered from the one before,
+// so that it counts as healthy again and does not escalate (see Recovery in FlyingBrick.cpp). Each must have
+// the gauge set the state again within 10 frames, and the gauge must not give up, or the exit status is 1. With -f, each run is flown from each of the .flt files in the folder instead of from 300 ft (see
+// Scenario.h), like PackageSources/SimObjects/Airplanes/FlyingBrick for all the phases the aircraft ships.
+// Each run is in a process and work folder of its own. For each run, and the worst of all runs, it reports:
+//
+// - Position jumps: frames in which the aircraft moved more than the jump distance (1 ft by default) away
+//   from where its velocity in the frame before would have taken it, and the largest of those.
+// - The RMS and largest vertical jerk, in ft/s³, from the altitude in each frame.
+// - How many times each of the freeze flags and SIM ON GROUND changed.
+// - SetDataOnSimObject calls and bytes per frame.
+// - How often the gauge set anything: the share of frames in which it did, and the mean, deviation and
+//   largest of the times between those, in milliseconds. Compare a build with FLYINGBRICK_TICK defined as 1
+//   to one without it, with some frames dropped, to see how steady each way of scheduling the controller is.
+//
+// With -x, also, after each exception until the gauge set the state again, the most frames that took, the
+// most SimConnect calls and wall time of one of those frames, which is where re-opening the connection shows,
+// and what the gauge itself published about it and its SimConnect traffic in its metrics (see
+// Sources/Code/Metrics.h). The stand-in answers each call at once, so the time is that of the gauge's side of
+// re-opening, without the sim's.
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+
+#include <dlfcn.h>
+#include <fcntl.h>
+#include <sys/wait.h>
+
+#include "Metrics.h"
+#include "Scenario.h"
+#include "SimConnect.h"
+#include "SimModel.h"
+#include "ThisAircraft.h"
+#include "WorkFolder.h"
+
+namespace {
+
+struct Options {
+    int runs = 10;
+    uint64_t seed = 1;
+    double seconds = 60;
+    double jumpFeet = 1;
+    bool verbose = false;
+    bool ground = false;
+    std::string scenarioFolder;
+    std::string gauge = "FlightModel";
+    int exceptions = 0;
+    TimingModel timing;
+};
+
+Options options;
+
+struct Score {
+    bool ok;
+    int64_t frames, callbacks;
+    double setsPerFrame, bytesPerFrame;           // SetDataOnSimObject
+    double outputShare;                           // Of frames in which anything was set
+    double meanGap, gapDeviation, maxGap;         // Milliseconds between those
+    int64_t jumps;
+    double maxJump;
+    double rmsJerk, maxJerk;
+    int64_t toggles[4];                           // Of each of toggledFlags
+    bool mustTakeOff;                             // Started on the ground with the ignition on
+    double climbFeet;                             // Highest AGL over the one at the start
+
+    // With -x
+    int64_t exceptions, recovered;                // Delivered, and followed by the gauge setting the state
+    int64_t maxFramesToControl;
+    int64_t maxRecoveryCalls;                     // SimConnect calls in one of those frames
+    double maxRecoveryMilliSeconds;               // Wall time of one of those frames
+    MetricsRecord metrics;                        // The gauge's own, at the end
+};
+
+// A start on the ground fails if the climb does not take the aircraft this high
+constexpr double TakeOffFeet = 10;
+
+// With -x, when the exceptions are delivered
+constexpr double ExceptionStartSeconds = 3;
+constexpr int64_t HealthyCallbacks = 100;
+
+// An exception fails if the gauge does not set the state again within this many frames after it
+constexpr int64_t MaxFramesToControl = 10;
+
+const char *const toggledFlags[] = {
+    "IS ALTITUDE FREEZE ON",
+    "IS ATTITUDE FREEZE ON",
+    "IS LATITUDE LONGITUDE FREEZE ON",
+    "SIM ON GROUND",
+};
+
+// The pilot's inputs at a time after the start
+void pilot(SimModel &sim, double seconds) {
+    sim.set("ELEVATOR POSITION", seconds < 8 ? -0.3 : 0);
+    sim.set("GENERAL ENG THROTTLE LEVER POSITION:1", seconds < 30 ? 0 : seconds < 45 ? 1 : 0.5);
+}
+
+// Put the sim in the initial conditions of the scenario, or 300 ft up or on the ground without one. Returns
+// whether the pilot's climb should take the aircraft off the ground.
+bool startFrom(SimModel &sim, const Scenario *scenario) {
+    if (scenario == nullptr) {
+        sim.place(options.ground ? 0 : 300);
+        if (options.ground)
+            sim.set("BRAKE PARKING POSITION", 1);
+        return options.ground;
+    }
+    placeInScenario(sim, *scenario);
+    return !scenario->airborne && sim.get("MASTER IGNITION SWITCH") != 0;
+}
+
+Score fly(const std::string &library, uint64_t seed, const Scenario *scenario) {
+    Score score = {};
+
+    void *handle = dlopen(library.c_str(), RTLD_NOW | RTLD_LOCAL);
+    const StandInApiFunction function = handle != nullptr ? (StandInApiFunction)dlsym(handle, "standInApi") : nullptr;
+    if (function == nullptr || function()->version != StandInApi::CurrentVersion) {
+        std::fprintf(stderr, "stutter: %s is not a gauge built with this version of the stand-in\n", library.c_str());
+        return score;
+    }
+    const StandInApi &api = *function();
+    if (!api.selectGauge(options.gauge.c_str())) {
+        std::fprintf(stderr, "stutter: %s has no gauge %s\n", library.c_str(), options.gauge.c_str());
+        return score;
+    }
+
+    TimingModel timing = options.timing;
+    timing.seed = seed;
+    SimModel sim(api, timing);
+
+    api.setTime(int64_t(sim.time() * 1e9));
+    api.install();
+    if (!sim.start()) {
+        std::fprintf(stderr, "stutter: the gauge did not ask for the state\n");
+        return score;
+    }
+    score.mustTakeOff = startFrom(sim, scenario);
+    const double startAgl = sim.get("PLANE ALT ABOVE GROUND");
+
+    static constexpr double EarthRadiusFeet = 20902231;
+    double previous[3] = {}, velocity[3] = {};
+    double previousFlags[4] = {};
+    double previousSeconds = 0, verticalSpeed = NAN, verticalAcceleration = NAN;
+    double jerkSquares = 0;
+    int64_t jerks = 0;
+
+    // The frame in which the latest exception was delivered, until the gauge set the state again, and the
+    // state callbacks when it did
+    int64_t failedFrame = -1, recoveredCallbacks = 0;
+
+    const double start = sim.time();
+    while (sim.time() - start < options.seconds) {
+        const double elapsed = sim.time() - start;
+        if (score.exceptions < options.exceptions && failedFrame < 0 && elapsed >= ExceptionStartSeconds
+            && sim.callbacks() - recoveredCallbacks >= HealthyCallbacks) {
+            api.deliverException(score.exceptions % 2 == 0 ? SIMCONNECT_EXCEPTION_ERROR : SIMCONNECT_EXCEPTION_UNOPENED);
+            score.exceptions++;
+            failedFrame = sim.frames();
+        }
+
+        pilot(sim, elapsed);
+        const auto stepStart = std::chrono::steady_clock::now();
+        sim.step();
+        if (failedFrame >= 0) {
+            const double milliSeconds =
+                std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - stepStart).count();
+            score.maxRecoveryMilliSeconds = std::max(score.maxRecoveryMilliSeconds, milliSeconds);
+            score.maxRecoveryCalls = std::max<int64_t>(score.maxRecoveryCalls, api.frame()->calls);
+            if (api.frame()->sets > 0) {
+                score.recovered += sim.frames() - failedFrame <= MaxFramesToControl;
+                score.maxFramesToControl = std::max(score.maxFramesToControl, sim.frames() - failedFrame);
+                failedFrame = -1;
+                recoveredCallbacks = sim.callbacks();
+            }
+        }
+
+        // In feet, north, east and up
+        const double position[3] = {
+            sim.get("PLANE LATITUDE") * EarthRadiusFeet,
+            sim.get("PLANE LONGITUDE") * EarthRadiusFeet * std::cos(sim.get("PLANE LATITUDE")),
+            sim.get("PLANE ALTITUDE"),
+        };
+        const double seconds = sim.time() - previousSeconds;
+        if (sim.frames() > 1) {
+            double jump = 0;
+            for (int i = 0; i < 3; i++)
+                jump += std::pow(position[i] - (previous[i] + velocity[i] * seconds), 2);
+            jump = std::sqrt(jump);
+            if (jump > options.jumpFeet) {
+                score.jumps++;
+                score.maxJump = std::max(score.maxJump, jump);
+            }
+
+            const double vs = (position[2] - previous[2]) / seconds;
+            if (!std::isnan(verticalSpeed)) {
+                const double acceleration = (vs - verticalSpeed) / seconds;
+                if (!std::isnan(verticalAcceleration)) {
+                    const double jerk = (acceleration - verticalAcceleration) / seconds;
+                    jerkSquares += jerk * jerk;
+                    jerks++;
+                    score.maxJerk = std::max(score.maxJerk, std::fabs(jerk));
+                }
+                verticalAcceleration = acceleration;
+            }
+            verticalSpeed = vs;
+
+            for (int i = 0; i < 4; i++)
+                score.toggles[i] += sim.get(toggledFlags[i]) != previousFlags[i];
+        }
+
+        std::copy(position, position + 3, previous);
+        velocity[0] = sim.get("VELOCITY WORLD Z");
+        velocity[1] = sim.get("VELOCITY WORLD X");
+        velocity[2] = sim.get("VELOCITY WORLD Y");
+        for (int i = 0; i < 4; i++)
+            previousFlags[i] = sim.get(toggledFlags[i]);
+        previousSeconds = sim.time();
+        score.climbFeet = std::max(score.climbFeet, sim.get("PLANE ALT ABOVE GROUND") - startAgl);
+    }
+    if (api.clientData(THISAIRCRAFT ".Metrics", &score.metrics, sizeof(score.metrics)) != sizeof(score.metrics))
+        score.metrics = MetricsRecord();
+    api.kill();
+
+    score.ok = true;
+    score.frames = sim.frames();
+    score.callbacks = sim.callbacks();
+    score.setsPerFrame = double(sim.sets()) / std::max<int64_t>(1, sim.frames());
+    score.bytesPerFrame = double(sim.bytes()) / std::max<int64_t>(1, sim.frames());
+    score.outputShare = double(sim.outputFrames()) / std::max<int64_t>(1, sim.frames());
+    score.meanGap = sim.meanOutputGap() * 1000;
+    score.gapDeviation = sim.outputGapDeviation() * 1000;
+    score.maxGap = sim.maxOutputGap() * 1000;
+    score.rmsJerk = jerks > 0 ? std::sqrt(jerkSquares / jerks) : 0;
+    return score;
+}
+
+// Fly in a process and work folder of its own, so that nothing from the run before is left in the gauge
+Score flyAlone(const std::string &library, uint64_t seed, const Scenario *scenario) {
+    Score score = {};
+    int fds[2];
+    if (pipe(fds) != 0)
+        return score;
+
+    std::fflush(stdout);
+    const pid_t pid = fork();
+    if (pid == 0) {
+        close(fds[0]);
+        if (!options.verbose) {
+            const int null = open("/dev/null", O_WRONLY);
+            dup2(null, STDOUT_FILENO);
+
+            // The gauge reports each exception there
+            if (options.exceptions > 0)
+                dup2(null, STDERR_FILENO);
+        }
+        {
+            WorkFolder folder;
+            score = folder.ok() ? fly(library, seed, scenario) : score;
+        }
+        const bool written = write(fds[1], &score, sizeof(score)) == sizeof(score);
+        std::fflush(stdout);
+        _exit(written ? 0 : 1);
+    }
+
+    close(fds[1]);
+    if (pid > 0 && read(fds[0], &score, sizeof(score)) != sizeof(score))
+        score.ok = false;
+    close(fds[0]);
+    if (pid > 0)
+        waitpid(pid, nullptr, 0);
+    return score;
+}
+
+void printRecovery(const char *label, const Score &score) {
+    const MetricsRecord &metrics = score.metrics;
+    std::printf("%-16s %lld of %lld exceptions recovered from in %lld frames at most, up to %lld calls and %.2f ms"
+                " in a frame; gauge: %lld resets, %lld reopens (max %.2f ms), back in control %lld times in %lld"
+                " frames at most%s; %lld calls (%lld failed), %lld packets received, %lld for other requests\n",
+                label, (long long)score.recovered, (long long)score.exceptions,
+                (long long)score.maxFramesToControl, (long long)score.maxRecoveryCalls,
+                score.maxRecoveryMilliSeconds, (long long)metrics.resets, (long long)metrics.reopens,
+                metrics.maxReopenMilliSeconds, (long long)metrics.recovered, (long long)metrics.maxFramesToControl,
+                metrics.failed != 0 ? ", gave up" : "", (long long)metrics.calls, (long long)metrics.callsFailed,
+                (long long)metrics.packetsReceived, (long long)metrics.otherRequests);
+}
+
+void print(const char *label, const Score &score) {
+    std::printf("%-16s %8lld %8lld %6.2f %6.1f %6.1f %6.1f %6.1f %6.1f %6lld %8.2f %10.1f %10.1f %6lld %6lld %6lld %6lld\n",
+                label, (long long)score.frames, (long long)score.callbacks, score.setsPerFrame, score.bytesPerFrame,
+                score.outputShare * 100, score.meanGap, score.gapDeviation, score.maxGap,
+                (long long)score.jumps, score.maxJump,
+                score.rmsJerk, score.maxJerk, (long long)score.toggles[0], (long long)score.toggles[1],
+                (long long)score.toggles[2], (long long)score.toggles[3]);
+}
+
+int usage() {
+    std::fprintf(stderr, "usage: stutter [-n runs] [-s seed] [-r frame rate] [-j jitter ms] [-d drop %%]"
+                 " [-a apply delay frames] [-z freeze delay frames] [-t seconds] [-p jump feet] [-f scenario folder]"
+                 " [-g] [-b gauge] [-x exceptions] [-v] flyingbrick.so\n");
+    return 2;
+}
+
+} // namespace
+
+int main(int argc, char **argv) {
+    int opt;
+    while ((opt = getopt(argc, argv, "n:s:r:j:d:a:z:t:p:f:gb:x:v")) != -1) {
+        switch (opt) {
+        case 'n': options.runs = std::atoi(optarg); break;
+        case 's': options.seed = std::strtoull(optarg, nullptr, 10); break;
+        case 'r': options.timing.frameSeconds = 1 / std::atof(optarg); break;
+        case 'j': options.timing.jitterSeconds = std::atof(optarg) / 1000; break;
+        case 'd': options.timing.dropProbability = std::atof(optarg) / 100; break;
+        case 'a': options.timing.applyDelayFrames = std::atoi(optarg); break;
+        case 'z': options.timing.freezeDelayFrames = std::atoi(optarg); break;
+        case 't': options.seconds = std::atof(optarg); break;
+        case 'p': options.jumpFeet = std::atof(optarg); break;
+        case 'f': options.scenarioFolder = optarg; break;
+        case 'g': options.ground = true; break;
+        case 'b': options.gauge = optarg; break;
+        case 'x': options.exceptions = std::atoi(optarg); break;
+        case 'v': options.verbose = true; break;
+        default: return usage();
+        }
+    }
+    if (argc - optind != 1 || options.runs < 1 || !(options.timing.frameSeconds > 0))
+        return usage();
+
+    // The gauge is loaded after chdir() into the work folder
+    char *library = realpath(argv[optind], nullptr);
+    if (library == nullptr) {
+        std::fprintf(stderr, "stutter: cannot find %s\n", argv[optind]);
+        return 2;
+    }
+
+    // Without a folder, one run per seed from 300 ft
+    std::vector<Scenario> scenarios;
+    if (!options.scenarioFolder.empty()) {
+        const char *temporary = std::getenv("TMPDIR");
+        const std::string cache = std::string(temporary != nullptr ? temporary : "/tmp") + "/flyingbrick-scenarios.bin";
+        std::string error;
+        ScenarioLoadStatistics statistics;
+        if (!loadScenarios(options.scenarioFolder, cache, scenarios, error, &statistics) || scenarios.empty()) {
+            std::fprintf(stderr, "stutter: %s\n", error.empty() ? "no scenarios in the folder" : error.c_str());
+            std::free(library);
+            return 2;
+        }
+        if (options.verbose)
+            std::printf("%zu scenarios, %zu parsed and %zu from the cache, in %.2f ms\n", statistics.files,
+                        statistics.parsed, statistics.cached, statistics.milliSeconds);
+    }
+    const size_t starts = std::max<size_t>(1, scenarios.size());
+
+    std::printf("%-16s %8s %8s %6s %6s %6s %6s %6s %6s %6s %8s %10s %10s %6s %6s %6s %6s\n", "seed", "frames",
+                "states", "sets", "bytes", "out %", "gap", "gap sd", "gap mx", "jumps", "max ft",
+                "RMS jerk", "max jerk", "alt", "att", "pos", "ground");
+    Score worst = {};
+    bool tookOff = true, recovered = true;
+    for (int run = 0; run < options.runs; run++) {
+        for (size_t start = 0; start < starts; start++) {
+            const uint64_t seed = options.seed + run;
+            const Scenario *scenario = scenarios.empty() ? nullptr : &scenarios[start];
+            const std::string label = std::to_string(seed) + (scenario != nullptr ? std::string(" ") + scenario->name : "");
+            const Score score = flyAlone(library, seed, scenario);
+            if (!score.ok) {
+                std::printf("%-16s failed\n", label.c_str());
+                std::free(library);
+                return 2;
+            }
+            print(label.c_str(), score);
+            if (score.mustTakeOff && score.climbFeet < TakeOffFeet) {
+                std::printf("%-16s did not take off, climbed %.1f ft\n", label.c_str(), score.climbFeet);
+                tookOff = false;
+            }
+            if (options.exceptions > 0) {
+                printRecovery(label.c_str(), score);
+                recovered = recovered && score.recovered == score.exceptions && score.metrics.failed == 0;
+            }
+
+            const bool first = run == 0 && start == 0;
+            worst.frames = std::max(worst.frames, score.frames);
+            worst.callbacks = std::max(worst.callbacks, score.callbacks);
+            worst.setsPerFrame = std::max(worst.setsPerFrame, score.setsPerFrame);
+            worst.bytesPerFrame = std::max(worst.bytesPerFrame, score.bytesPerFrame);
+            worst.outputShare = first ? score.outputShare : std::min(worst.outputShare, score.outputShare);
+            worst.meanGap = std::max(worst.meanGap, score.meanGap);
+            worst.gapDeviation = std::max(worst.gapDeviation, score.gapDeviation);
+            worst.maxGap = std::max(worst.maxGap, score.maxGap);
+            worst.jumps = std::max(worst.jumps, score.jumps);
+            worst.maxJump = std::max(worst.maxJump, score.maxJump);
+            worst.rmsJerk = std::max(worst.rmsJerk, score.rmsJerk);
+            worst.maxJerk = std::max(worst.maxJerk, score.maxJerk);
+            for (int i = 0; i < 4; i++)
+                worst.toggles[i] = std::max(worst.toggles[i], score.toggles[i]);
+        }
+    }
+    if (options.runs * starts > 1)
+        print("worst", worst);
+    std::free(library);
+    return tookOff && recovered ? 0 : 1;
+}
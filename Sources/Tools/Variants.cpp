@@ -0,0 +1,263 @@
+// -*- comment-column: 50; fill-column: 110; c-basic-offset: 4; tab-width: 4; indent-tabs-mode: nil -*-
+
+// Compares the control inputs of the variants in Sources/Code/Variant.h, with their response curves as
+// constant tables, to the same curves as tables built at run time, which is what the gauge uses when
+// aircraft.cfg overrides them or when it is built with FLYINGBRICK_RUNTIME_PARAMETERS defined as 1. Build
+// this, from the top of the repository, with:
+//
+//   g++ -std=c++14 -O2 -ISources/Code Sources/Tools/Variants.cpp -o variants
+//
+// and for WebAssembly like MathCheck.cpp.
+//
+// Usage: variants [-b benchmark iterations]
+//
+// The inputs of both must be the same to the bit over every axis position the sim can report, a grid of
+// 1/100000 of the range, and the ends and beyond; the exit status is 1 if they are not. Then it measures the
+// time per frame of each, and shows the size of the tables each variant has in the module.
+//
+// At the edge of a stick dead zone the tables ramp up from zero over one table interval, where a dead zone
+// applied to the position would step. The exit status is also 1 if that ramp is not straight, from exactly
+// zero at the edge to the curve's own value one interval out, on both sides of each dead zone.
+//
+// Last, it compares the FlyingBrick's tables to the hard-coded formulas with branches that it had before its
+// response curves: the largest difference away from the dead zone edges, which must be rounding, the largest
+// at them, and the time per frame of the formulas.
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+
+#include <unistd.h>
+
+#include "ResponseCurve.h"
+#include "Variant.h"
+
+namespace {
+
+struct Options {
+    long iterations = 20000000;
+};
+
+Options options;
+
+struct ControlInputs {
+    double yawRate;
+    double velBodyZ, velBodyX;
+    double verticalSpeed;
+};
+
+// As in FlyingBrick.cpp when the curves are overridden
+struct ResponseCurves {
+    ResponseCurve rudder, aileron, elevator, throttle;
+
+    explicit ResponseCurves(const ResponseCurveDefinitions &definitions)
+        : rudder(definitions.rudder), aileron(definitions.aileron), elevator(definitions.elevator),
+          throttle(definitions.throttle) {
+    }
+
+    void axes2inputs(double rudder, double aileron, double elevator, double throttle,
+                     ControlInputs &inputs) const {
+        inputs.yawRate = this->rudder(rudder);
+        inputs.velBodyX = this->aileron(aileron);
+        inputs.velBodyZ = this->elevator(elevator);
+        inputs.verticalSpeed = this->throttle(throttle);
+    }
+};
+
+// Where the runtime curves are, hidden from the optimizer as the gauge's are from it
+ResponseCurves *volatile runtimeCurves;
+
+bool same(const ControlInputs &a, const ControlInputs &b) {
+    return std::memcmp(&a, &b, sizeof(a)) == 0;
+}
+
+template <typename Variant>
+long compare(const ResponseCurves &runtime) {
+    static constexpr long Grid = 100000;
+    long different = 0;
+    for (long i = -Grid / 10; i <= Grid + Grid / 10; i++) {
+        const double axis = -1 + 2.0 * i / Grid, throttle = double(i) / Grid;
+        ControlInputs constant, built;
+        VariantControl<Variant>::axes2inputs(axis, -axis, axis * 0.5, throttle, constant);
+        runtime.axes2inputs(axis, -axis, axis * 0.5, throttle, built);
+        different += !same(constant, built);
+        different += VariantControl<Variant>::verticalSpeed(throttle) != runtime.throttle(throttle);
+    }
+    return different;
+}
+
+volatile double sink;
+
+// The best of ten rounds, as in MathCheck.cpp
+template <typename Function>
+double nanosecondsPer(Function function) {
+    static constexpr int Rounds = 10;
+    const long iterations = std::max(1L, options.iterations / Rounds);
+    double best = HUGE_VAL;
+    for (int round = 0; round < Rounds; round++) {
+        const auto start = std::chrono::steady_clock::now();
+        double sum = 0;
+        for (long i = 0; i < iterations; i++)
+            sum += function(i);
+        sink = sum;
+        const std::chrono::duration<double, std::nano> elapsed = std::chrono::steady_clock::now() - start;
+        best = std::min(best, elapsed.count() / iterations);
+    }
+    return best;
+}
+
+// Axes moving as a pilot's would, within a frame's worth of the range
+double axis(long i, int shift) {
+    return 0.0001 * ((i >> shift) & 16383) - 0.8;
+}
+
+// The ramp over the table interval just out of a dead zone, with the other axes centred, for one axis
+template <typename Variant>
+long rampErrors(double deadZone, double (*input)(double)) {
+    static constexpr double Interval = 2.0 / ResponseCurve::Intervals;
+    static constexpr int Steps = 64;
+    long errors = 0;
+    for (double side: { -1.0, 1.0 }) {
+        const double edge = side * deadZone, out = input(side * (deadZone + Interval));
+        errors += input(edge) != 0;
+        for (int step = 0; step <= Steps; step++) {
+            const double t = double(step) / Steps;
+            errors += std::abs(input(side * (deadZone + t * Interval)) - t * out) > 1e-12 * std::abs(out);
+        }
+    }
+    return errors;
+}
+
+template <typename Variant>
+double aileronInput(double aileron) {
+    ControlInputs inputs;
+    VariantControl<Variant>::axes2inputs(0, aileron, 0, 0.5, inputs);
+    return inputs.velBodyX;
+}
+
+template <typename Variant>
+double elevatorInput(double elevator) {
+    ControlInputs inputs;
+    VariantControl<Variant>::axes2inputs(0, 0, elevator, 0.5, inputs);
+    return inputs.velBodyZ;
+}
+
+template <typename Variant>
+bool report(const char *name) {
+    static ResponseCurves runtime(variantResponseCurves<Variant>());
+    runtimeCurves = &runtime;
+    const long different = compare<Variant>(runtime);
+
+    const double constant = nanosecondsPer([](long i) {
+        ControlInputs inputs;
+        VariantControl<Variant>::axes2inputs(axis(i, 0), axis(i, 1), axis(i, 2), axis(i, 3) + 0.5, inputs);
+        return inputs.yawRate + inputs.velBodyX + inputs.velBodyZ + inputs.verticalSpeed;
+    });
+    const double built = nanosecondsPer([](long i) {
+        ControlInputs inputs;
+        runtimeCurves->axes2inputs(axis(i, 0), axis(i, 1), axis(i, 2), axis(i, 3) + 0.5, inputs);
+        return inputs.yawRate + inputs.velBodyX + inputs.velBodyZ + inputs.verticalSpeed;
+    });
+
+    const long ramp = rampErrors<Variant>(Variant::StickDeadZone, aileronInput<Variant>)
+        + rampErrors<Variant>(Variant::StickDeadZone, elevatorInput<Variant>);
+
+    std::printf("%-12s %9ld %10.2f %10.2f %8zu %5ld\n", name, different, constant, built, sizeof(ResponseCurves),
+                ramp);
+    return different == 0 && ramp == 0;
+}
+
+// What the FlyingBrick's control inputs were before its response curves
+struct Formulas {
+    static constexpr double Hundredth = 0.01;
+
+    static double throttle2vs(double throttle) {
+        if (throttle < 0.45)
+            return (throttle - 0.45) / 0.45 * 1000 / 60;
+        else if (throttle > 0.55)
+            return (throttle - 0.55) / 0.45 * 1000 / 60;
+        else
+            return 0;
+    }
+
+    static void axes2inputs(double rudder, double aileron, double elevator, double throttle,
+                            ControlInputs &inputs) {
+        inputs.yawRate = rudder * (45 / 180.0 * M_PI);
+        if (elevator < -Hundredth)
+            inputs.velBodyZ = -elevator * (100 * 1.68781042021544);
+        else if (elevator > Hundredth)
+            inputs.velBodyZ = -elevator * (50 * 1.68781042021544);
+        else
+            inputs.velBodyZ = 0;
+        if (std::abs(aileron) > Hundredth)
+            inputs.velBodyX = aileron * (50 * 1.68781042021544);
+        else
+            inputs.velBodyX = 0;
+        inputs.verticalSpeed = throttle2vs(throttle);
+    }
+};
+
+// Returns whether the tables are the formulas but for rounding, away from the edges of the dead zones
+bool reportFormulas() {
+    static constexpr long Grid = 100000;
+    static constexpr double Interval = 2.0 / ResponseCurve::Intervals;
+    double rounding = 0, edges = 0;
+    for (long i = -Grid / 10; i <= Grid + Grid / 10; i++) {
+        const double axis = -1 + 2.0 * i / Grid, throttle = double(i) / Grid;
+        ControlInputs tables, formulas;
+        VariantControl<FlyingBrickVariant>::axes2inputs(axis, -axis, axis * 0.5, throttle, tables);
+        Formulas::axes2inputs(std::max(-1.0, std::min(1.0, axis)), std::max(-1.0, std::min(1.0, -axis)),
+                              axis * 0.5, std::max(0.0, std::min(1.0, throttle)), formulas);
+
+        const double stick[2] = { -axis, axis * 0.5 };
+        const double difference[2] = { std::abs(tables.velBodyX - formulas.velBodyX),
+                                       std::abs(tables.velBodyZ - formulas.velBodyZ) };
+        for (int j = 0; j < 2; j++) {
+            const double magnitude = std::abs(stick[j]);
+            const bool edge = magnitude > Formulas::Hundredth && magnitude < Formulas::Hundredth + Interval;
+            (edge ? edges : rounding) = std::max(edge ? edges : rounding, difference[j]);
+        }
+        rounding = std::max(rounding, std::abs(tables.yawRate - formulas.yawRate));
+        rounding = std::max(rounding, std::abs(tables.verticalSpeed - formulas.verticalSpeed));
+    }
+
+    const double time = nanosecondsPer([](long i) {
+        ControlInputs inputs;
+        Formulas::axes2inputs(axis(i, 0), axis(i, 1), axis(i, 2), axis(i, 3) + 0.5, inputs);
+        return inputs.yawRate + inputs.velBodyX + inputs.velBodyZ + inputs.verticalSpeed;
+    });
+
+    std::printf("\n%-12s %10s %10s %10s\n", "", "rounding", "at edges", "ns");
+    std::printf("%-12s %10.3g %10.3g %10.2f\n", "formulas", rounding, edges, time);
+    return rounding < 1e-12;
+}
+
+int usage() {
+    std::fprintf(stderr, "usage: variants [-b benchmark iterations]\n");
+    return 2;
+}
+
+}
+
+int main(int argc, char **argv) {
+    int option;
+    while ((option = getopt(argc, argv, "b:")) != -1) {
+        switch (option) {
+        case 'b': options.iterations = std::atol(optarg); break;
+        default: return usage();
+        }
+    }
+    if (optind != argc || options.iterations <= 0)
+        return usage();
+
+    std::printf("variant      different ns constant ns runtime  bytes  ramp\n");
+    bool same = true;
+    same &= report<FlyingBrickVariant>(FlyingBrickVariant::name());
+    same &= report<HeavyBrickVariant>(HeavyBrickVariant::name());
+    same &= report<DemoBrickVariant>(DemoBrickVariant::name());
+    same &= reportFormulas();
+    return same ? 0 : 1;
+}
@@ -0,0 +1,44 @@
+// -*- comment-column: 50; fill-column: 110; c-basic-offset: 4; tab-width: 4; indent-tabs-mode: nil -*-
+
+#pragma once
+
+#include <cstdio>
+
+#include <ftw.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+// A new temporary folder made the current one, for an offline build of the gauge to use as its work folder
+// (see StandIn/StandIn.h), so that it does not find the snapshot or anything else left by another run. The
+// folder is removed with everything in it when this goes out of scope.
+
+class WorkFolder {
+public:
+    WorkFolder() {
+        if (mkdtemp(path_) == nullptr || chdir(path_) != 0)
+            path_[0] = 0;
+    }
+
+    ~WorkFolder() {
+        if (ok())
+            nftw(path_, remove, 16, FTW_DEPTH | FTW_PHYS);
+    }
+
+    WorkFolder(const WorkFolder&) = delete;
+    WorkFolder &operator=(const WorkFolder&) = delete;
+
+    bool ok() const {
+        return path_[0] != 0;
+    }
+
+    const char *path() const {
+        return path_;
+    }
+
+private:
+    char path_[32] = "/tmp/flyingbrick-XXXXXX";
+
+    static int remove(const char *path, const struct stat*, int, struct FTW*) {
+        return std::remove(path);
+    }
+};
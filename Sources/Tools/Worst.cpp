@@ -0,0 +1,771 @@
+// -*- comment-column: 50; fill-column: 110; c-basic-offset: 4; tab-width: 4; indent-tabs-mode: nil -*-
+
+// Searches for what makes the gauge slowest in a single frame, as it is the rare slow frame that a pilot
+// notices, not the average. Flies an offline build of the gauge against the stand-in's sim (see
+// StandIn/SimModel.h) with streams of things done to the state and to the gauge, frame by frame: pause
+// toggles, the ignition flapping, the AGL jumping around static_cg_height + 1, frames at Null Island or of
+// another zombie state, bursts of exceptions, flights loaded, axes slammed and freezes the sim drops. Build
+// the gauge as described in StandIn/StandIn.h, and this, from the top of the repository, with:
+//
+//   g++ -std=c++14 -O2 -ISources/Tools/StandIn -ISources/Code Sources/Tools/Worst.cpp -o worst -ldl -pthread
+//
+// Usage: worst [-i iterations] [-f frames] [-s seed] [-w allocation us] [-m minimize runs]
+//              [-r replays] [-o corpus folder] [-g scenario folder] flyingbrick.so
+//        worst -c corpus folder [-r replays] [-x max us] [-g scenario folder] flyingbrick.so
+//
+// The first form searches. It starts from a stream generated for each of the things above, and each
+// iteration mutates one of those: new steps, a burst of one kind, a range spliced in from another, a range
+// cleared. The fitness of a stream is its worst frame, as the time spent in the gauge in that frame plus a
+// weight per allocation, as allocations are what the slow paths have in common and, unlike times, they do
+// not vary from run to run. A mutation that looks like it beats the stream it came from is run three times
+// more and goes by the least time for each frame, so that a frame the machine happened to interrupt does
+// not get it in. What there is at the end is minimized: cut after its worst frame, then cleared of all steps
+// the worst frame does not need, as long as it stays at least 80% as slow. Each is written to the corpus
+// folder, Sources/Tools/WorstCases by default, as <kind>.stream, a text file of a step per line:
+//
+//   <frame> <kind> <count> <value>
+//
+// A stream starts 300 ft up, or with -g from one of the scenarios in the folder (see Scenario.h), like
+// PackageSources/SimObjects/Airplanes/FlyingBrick: each generated stream from one picked at random, and a
+// mutation can pick another. The file of a stream that starts from a scenario says which, as a line
+// "start <scenario>", and replaying it needs -g with the folder it is in.
+//
+// The second form replays a corpus as a regression benchmark. Both end with a report of the time per frame
+// over all frames of all streams replayed: the median, p99, p99.99 and the largest, and the worst frame of
+// each stream. With -x the exit status is 1 if the largest is more than that many microseconds. The report
+// also has, per frame and for the worst frame of each stream, the bytes of the messages delivered to the
+// gauge and of the state it set, and the cache misses in the gauge, where the machine can count them (see
+// CacheMisses.h; "-" where it can not).
+//
+// Each run is in a process and work folder of its own, as in Stutter.cpp. The first frames, when the gauge
+// sets up the connection, are left out of the fitness and the report, as they are the same in every stream.
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <new>
+#include <string>
+#include <vector>
+
+#include <dirent.h>
+#include <dlfcn.h>
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <sys/wait.h>
+
+#include "CacheMisses.h"
+#include "Scenario.h"
+#include "SimConnect.h"
+#include "SimModel.h"
+#include "WorkFolder.h"
+
+// Allocations, by the gauge too, as it gets its operator new from here
+static int64_t allocations;
+
+void *operator new(std::size_t size) {
+    allocations++;
+    void *p = std::malloc(size > 0 ? size : 1);
+    if (p == nullptr)
+        throw std::bad_alloc();
+    return p;
+}
+
+void operator delete(void *p) noexcept {
+    std::free(p);
+}
+
+void operator delete(void *p, std::size_t) noexcept {
+    std::free(p);
+}
+
+namespace {
+
+struct Options {
+    int iterations = 300;
+    int frames = 300;
+    uint64_t seed = 1;
+    double allocationMicroSeconds = 1;
+    int minimizeRuns = 200;
+    int replays = 10;
+    double maxMicroSeconds = 0;
+    int warmUpFrames = 10;
+    std::string corpusFolder;
+    std::string scenarioFolder;
+    std::string outputFolder = "Sources/Tools/WorstCases";
+};
+
+Options options;
+std::vector<Scenario> scenarios;
+
+enum StepKind {
+    StepNone,
+    StepPause,                                    // The Pause system event, value 1 or 0
+    StepIgnition,                                 // The ignition switch, value 1 or 0, from then on
+    StepAgl,                                      // Put the aircraft value feet above static_cg_height + 1
+    StepNullIsland,                               // Deliver 0N 0E in this frame
+    StepZombie,                                   // Deliver value as the AGL in this frame
+    StepExceptions,                               // Count exceptions of type value
+    StepFlightLoaded,
+    StepThrottle,                                 // The axes, from then on
+    StepElevator,
+    StepRudder,
+    StepUnfrozen,                                 // Deliver the freeze flags as off in this frame
+    StepKindCount
+};
+
+const char *const stepNames[StepKindCount] = {
+    "none", "pause", "ignition", "agl", "null-island", "zombie", "exceptions", "flight-loaded", "throttle",
+    "elevator", "rudder", "unfrozen",
+};
+
+struct Step {
+    int kind;
+    int count;
+    double value;
+};
+
+// A step per frame
+struct Stream {
+    int kind;                                     // What it was generated as
+    std::string name;
+    std::string start;                            // The scenario, or empty for 300 ft up
+    std::vector<Step> steps;
+};
+
+struct FrameCost {
+    int64_t nanoseconds;                          // In the gauge
+    int64_t allocations;
+    int64_t bytes;                                // Delivered to the gauge and set by it
+    int64_t cacheMisses;                          // In the gauge, -1 if they can not be counted
+};
+
+struct Evaluation {
+    bool ok;
+    std::vector<FrameCost> frames;
+    double fitness;                               // The worst frame, in microseconds with the allocations
+    int worstFrame;
+};
+
+// The gauge, and the time, allocations and cache misses in it during the frame
+const StandInApi *gauge;
+const CacheMisses *cacheMisses;
+int64_t frameNanoseconds, frameAllocations, frameCacheMisses;
+
+template <typename Function>
+auto measure(Function function) -> decltype(function()) {
+    const int64_t allocated = allocations;
+    const uint64_t missed = cacheMisses->read();
+    const auto start = std::chrono::steady_clock::now();
+    struct Account {
+        const int64_t allocated;
+        const uint64_t missed;
+        const std::chrono::steady_clock::time_point start;
+        ~Account() {
+            frameNanoseconds += std::chrono::duration_cast<std::chrono::nanoseconds>(
+                std::chrono::steady_clock::now() - start).count();
+            frameCacheMisses += cacheMisses->read() - missed;
+            frameAllocations += allocations - allocated;
+        }
+    } account = { allocated, missed, start };
+    return function();
+}
+
+void measuredUpdate() {
+    measure([] { gauge->update(); });
+}
+
+bool measuredDeliverState(const void *data, uint32_t size) {
+    return measure([=] { return gauge->deliverState(data, size); });
+}
+
+double cost(const FrameCost &frame) {
+    return frame.nanoseconds / 1000.0 + options.allocationMicroSeconds * frame.allocations;
+}
+
+void score(Evaluation &evaluation) {
+    evaluation.fitness = 0;
+    evaluation.worstFrame = -1;
+    for (size_t i = options.warmUpFrames; i < evaluation.frames.size(); i++) {
+        if (cost(evaluation.frames[i]) > evaluation.fitness) {
+            evaluation.fitness = cost(evaluation.frames[i]);
+            evaluation.worstFrame = int(i);
+        }
+    }
+}
+
+void apply(SimModel &sim, const Step &step, double restingAgl) {
+    switch (step.kind) {
+    case StepPause:
+        measure([&] { return gauge->deliverSystemEvent("Pause", step.value != 0); });
+        break;
+    case StepIgnition:
+        sim.set("MASTER IGNITION SWITCH", step.value);
+        break;
+    case StepAgl:
+        sim.place(restingAgl + 1 + step.value);
+        break;
+    case StepNullIsland:
+        sim.overrideOnce("PLANE LATITUDE", 0);
+        sim.overrideOnce("PLANE LONGITUDE", 0);
+        break;
+    case StepZombie:
+        sim.overrideOnce("PLANE ALT ABOVE GROUND", step.value);
+        break;
+    case StepExceptions:
+        for (int i = 0; i < step.count; i++)
+            measure([&] { return gauge->deliverException(uint32_t(step.value)); });
+        break;
+    case StepFlightLoaded:
+        measure([&] { return gauge->deliverSystemEvent("FlightLoaded", 0); });
+        break;
+    case StepThrottle:
+        sim.set("GENERAL ENG THROTTLE LEVER POSITION:1", step.value);
+        break;
+    case StepElevator:
+        sim.set("ELEVATOR POSITION", step.value);
+        break;
+    case StepRudder:
+        sim.set("RUDDER PEDAL POSITION", step.value);
+        break;
+    case StepUnfrozen:
+        sim.overrideOnce("IS ALTITUDE FREEZE ON", 0);
+        sim.overrideOnce("IS ATTITUDE FREEZE ON", 0);
+        sim.overrideOnce("IS LATITUDE LONGITUDE FREEZE ON", 0);
+        break;
+    }
+}
+
+const Scenario *findScenario(const std::string &name) {
+    for (const Scenario &scenario: scenarios) {
+        if (name == scenario.name)
+            return &scenario;
+    }
+    return nullptr;
+}
+
+Evaluation fly(const std::string &library, const Stream &stream) {
+    Evaluation evaluation = {};
+
+    void *handle = dlopen(library.c_str(), RTLD_NOW | RTLD_LOCAL);
+    const StandInApiFunction function =
+        handle != nullptr ? (StandInApiFunction)dlsym(handle, "standInApi") : nullptr;
+    if (function == nullptr || function()->version != StandInApi::CurrentVersion) {
+        std::fprintf(stderr, "worst: %s is not a gauge built with this version of the stand-in\n",
+                     library.c_str());
+        return evaluation;
+    }
+    gauge = function();
+    const CacheMisses counter;
+    cacheMisses = &counter;
+
+    // The sim calls into the gauge through these, so that what it does in them counts
+    StandInApi measured = *gauge;
+    measured.update = measuredUpdate;
+    measured.deliverState = measuredDeliverState;
+
+    TimingModel timing;
+    timing.seed = options.seed;
+    SimModel sim(measured, timing);
+
+    gauge->setTime(int64_t(sim.time() * 1e9));
+    gauge->install();
+    if (!sim.start()) {
+        std::fprintf(stderr, "worst: the gauge did not ask for the state\n");
+        return evaluation;
+    }
+    if (stream.start.empty()) {
+        sim.place(300);
+        sim.set("GENERAL ENG THROTTLE LEVER POSITION:1", 0.5);
+    } else {
+        const Scenario *scenario = findScenario(stream.start);
+        if (scenario == nullptr) {
+            std::fprintf(stderr, "worst: no scenario %s\n", stream.start.c_str());
+            return evaluation;
+        }
+        placeInScenario(sim, *scenario);
+    }
+
+    evaluation.frames.reserve(stream.steps.size());
+    for (const Step &step: stream.steps) {
+        frameNanoseconds = frameAllocations = frameCacheMisses = 0;
+        apply(sim, step, sim.restingAgl);
+        sim.step();
+        const StandInFrame &frame = *gauge->frame();
+        evaluation.frames.push_back({ frameNanoseconds, frameAllocations, frame.received + frame.bytes,
+                                      counter.ok() ? frameCacheMisses : -1 });
+    }
+    gauge->kill();
+
+    evaluation.ok = true;
+    score(evaluation);
+    return evaluation;
+}
+
+// Fly in a process and work folder of its own, so that nothing from the run before is left in the gauge
+Evaluation flyAlone(const std::string &library, const Stream &stream) {
+    Evaluation evaluation = {};
+    int fds[2];
+    if (pipe(fds) != 0)
+        return evaluation;
+
+    std::fflush(stdout);
+    const pid_t pid = fork();
+    if (pid == 0) {
+        close(fds[0]);
+        const int null = open("/dev/null", O_WRONLY);
+        dup2(null, STDOUT_FILENO);
+        dup2(null, STDERR_FILENO);
+        {
+            WorkFolder folder;
+            evaluation = folder.ok() ? fly(library, stream) : evaluation;
+        }
+        const uint64_t count = evaluation.ok ? evaluation.frames.size() : 0;
+        const size_t bytes = count * sizeof(FrameCost);
+        const bool written = write(fds[1], &count, sizeof(count)) == sizeof(count)
+            && (bytes == 0 || write(fds[1], evaluation.frames.data(), bytes) == ssize_t(bytes));
+        _exit(written ? 0 : 1);
+    }
+
+    close(fds[1]);
+    uint64_t count = 0;
+    if (pid > 0 && read(fds[0], &count, sizeof(count)) == sizeof(count) && count > 0) {
+        evaluation.frames.resize(count);
+        char *data = reinterpret_cast<char*>(evaluation.frames.data());
+        size_t got = 0;
+        ssize_t chunk;
+        while (got < count * sizeof(FrameCost)
+               && (chunk = read(fds[0], data + got, count * sizeof(FrameCost) - got)) > 0)
+            got += chunk;
+        evaluation.ok = got == count * sizeof(FrameCost);
+    }
+    close(fds[0]);
+    if (pid > 0)
+        waitpid(pid, nullptr, 0);
+    if (evaluation.ok)
+        score(evaluation);
+    return evaluation;
+}
+
+// Keep the least cost of each frame of the runs of a stream, which is what it costs without interruptions
+// by the machine
+bool keepLeast(Evaluation &least, const Evaluation &evaluation) {
+    if (!evaluation.ok || evaluation.frames.size() != least.frames.size())
+        return least.ok = false;
+    for (size_t i = 0; i < least.frames.size(); i++) {
+        FrameCost &frame = least.frames[i];
+        frame.nanoseconds = std::min(frame.nanoseconds, evaluation.frames[i].nanoseconds);
+        frame.allocations = std::min(frame.allocations, evaluation.frames[i].allocations);
+        frame.cacheMisses = std::min(frame.cacheMisses, evaluation.frames[i].cacheMisses);
+    }
+    score(least);
+    return true;
+}
+
+Evaluation flyConfirmed(const std::string &library, const Stream &stream, int runs) {
+    Evaluation least = flyAlone(library, stream);
+    for (int run = 1; least.ok && run < runs; run++)
+        keepLeast(least, flyAlone(library, stream));
+    return least;
+}
+
+Step randomStep(Random &random, int kind) {
+    static const uint32_t exceptions[] = {
+        SIMCONNECT_EXCEPTION_ERROR, SIMCONNECT_EXCEPTION_UNOPENED, SIMCONNECT_EXCEPTION_TOO_MANY_REQUESTS,
+        SIMCONNECT_EXCEPTION_UNRECOGNIZED_ID, SIMCONNECT_EXCEPTION_DATA_ERROR,
+        SIMCONNECT_EXCEPTION_ALREADY_CREATED, SIMCONNECT_EXCEPTION_SIZE_MISMATCH,
+    };
+    Step step = { kind, 1, 0 };
+    switch (kind) {
+    case StepPause:
+    case StepIgnition:
+        step.value = random.upTo(1);
+        break;
+    case StepAgl:
+        step.value = 1.5 * random.symmetric();
+        break;
+    case StepZombie:
+        step.value = random.upTo(1) ? -1000 : 200000;
+        break;
+    case StepExceptions:
+        step.count = 1 + random.upTo(7);
+        step.value = exceptions[random.upTo(int(sizeof(exceptions) / sizeof(exceptions[0])) - 1)];
+        break;
+    case StepThrottle:
+        step.value = random.uniform();
+        break;
+    case StepElevator:
+    case StepRudder:
+        step.value = random.symmetric();
+        break;
+    }
+    return step;
+}
+
+// A stream for each of the things the search starts from, with some of that thing in every few frames
+Stream generate(int kind, Random &random) {
+    Stream stream;
+    stream.kind = kind;
+    stream.name = stepNames[kind];
+    if (!scenarios.empty())
+        stream.start = scenarios[random.upTo(int(scenarios.size()) - 1)].name;
+    stream.steps.assign(options.frames, Step{ StepNone, 0, 0 });
+    const int every = kind == StepExceptions || kind == StepFlightLoaded ? 30 : kind == StepAgl ? 1 : 3;
+    for (int i = options.warmUpFrames; i < options.frames; i += every) {
+        stream.steps[i] = randomStep(random, kind);
+        if (kind == StepPause || kind == StepIgnition)
+            stream.steps[i].value = (i / every) % 2;
+    }
+    return stream;
+}
+
+// Mostly of the kind the stream was generated as. Exceptions only in the streams of exceptions: the gauge
+// logs each, which is slower than anything else it does, and gives up after a burst, so they would hide what
+// the others are slow at.
+bool allowed(const Stream &stream, int kind) {
+    return kind != StepExceptions || stream.kind == StepExceptions;
+}
+
+int randomKind(const Stream &stream, Random &random) {
+    if (random.upTo(3) > 0)
+        return stream.kind;
+    int kind;
+    do
+        kind = 1 + random.upTo(StepKindCount - 2);
+    while (!allowed(stream, kind));
+    return kind;
+}
+
+Stream mutate(const Stream &parent, const std::vector<Stream> &corpus, Random &random) {
+    Stream child = parent;
+    std::vector<Step> &steps = child.steps;
+    const int frames = int(steps.size());
+    const int from = options.warmUpFrames + random.upTo(frames - options.warmUpFrames - 1);
+    const int length = 1 + random.upTo(std::min(30, frames - from - 1));
+    switch (random.upTo(scenarios.empty() ? 3 : 4)) {
+    case 0:                                       // A few new steps
+        for (int i = 0, n = 1 + random.upTo(4); i < n; i++) {
+            const int frame = options.warmUpFrames + random.upTo(frames - options.warmUpFrames - 1);
+            steps[frame] = randomStep(random, randomKind(child, random));
+        }
+        break;
+    case 1: {                                     // A burst of one kind
+        const int kind = randomKind(child, random);
+        for (int i = from; i < from + length; i++)
+            steps[i] = randomStep(random, kind);
+        break;
+    }
+    case 2: {                                     // A range from another stream
+        const Stream &other = corpus[random.upTo(int(corpus.size()) - 1)];
+        const int at = options.warmUpFrames + random.upTo(int(other.steps.size()) - options.warmUpFrames - 1);
+        for (int i = 0; i < length && at + i < int(other.steps.size()); i++)
+            if (allowed(child, other.steps[at + i].kind))
+                steps[from + i] = other.steps[at + i];
+        break;
+    }
+    case 3:                                       // A range cleared
+        for (int i = from; i < from + length; i++)
+            steps[i] = Step{ StepNone, 0, 0 };
+        break;
+    default:                                      // Another start
+        child.start = scenarios[random.upTo(int(scenarios.size()) - 1)].name;
+        break;
+    }
+    return child;
+}
+
+// Cut after the worst frame, then clear ranges of steps, halving them down to single ones, as long as what
+// is left stays at least this slow
+Stream minimize(const std::string &library, const Stream &stream, const Evaluation &evaluation) {
+    static constexpr double Keep = 0.8;
+    Stream result = stream;
+    result.steps.resize(evaluation.worstFrame + 1);
+    const double target = Keep * evaluation.fitness;
+
+    int runs = 0;
+    for (int chunk = int(result.steps.size()) / 2; chunk >= 1 && runs < options.minimizeRuns; chunk /= 2) {
+        for (int from = 0; from < int(result.steps.size()) && runs < options.minimizeRuns; from += chunk) {
+            Stream candidate = result;
+            bool any = false;
+            for (int i = from; i < std::min(from + chunk, int(candidate.steps.size())); i++) {
+                any |= candidate.steps[i].kind != StepNone;
+                candidate.steps[i] = Step{ StepNone, 0, 0 };
+            }
+            if (!any)
+                continue;
+            runs++;
+            const Evaluation tried = flyConfirmed(library, candidate, 2);
+            if (tried.ok && tried.worstFrame == int(candidate.steps.size()) - 1 && tried.fitness >= target)
+                result = candidate;
+        }
+    }
+    return result;
+}
+
+bool writeStream(const std::string &fileName, const Stream &stream, const Evaluation &evaluation) {
+    std::FILE *file = std::fopen(fileName.c_str(), "w");
+    if (file == nullptr)
+        return false;
+    const FrameCost &worst = evaluation.frames[evaluation.worstFrame];
+    std::fprintf(file, "# From %s: worst frame %d, %.1f us in the gauge with %lld allocations\n",
+                 stream.name.c_str(), evaluation.worstFrame, worst.nanoseconds / 1000.0,
+                 (long long)worst.allocations);
+    if (!stream.start.empty())
+        std::fprintf(file, "start %s\n", stream.start.c_str());
+    std::fprintf(file, "frames %zu\n", stream.steps.size());
+    for (size_t i = 0; i < stream.steps.size(); i++) {
+        const Step &step = stream.steps[i];
+        if (step.kind != StepNone)
+            std::fprintf(file, "%zu %s %d %.17g\n", i, stepNames[step.kind], step.count, step.value);
+    }
+    return std::fclose(file) == 0;
+}
+
+bool readStream(const std::string &fileName, Stream &stream) {
+    std::FILE *file = std::fopen(fileName.c_str(), "r");
+    if (file == nullptr)
+        return false;
+    char line[256];
+    bool ok = true;
+    while (ok && std::fgets(line, sizeof(line), file) != nullptr) {
+        size_t frames, frame;
+        char kind[32], start[32];
+        Step step = {};
+        if (line[0] == '#' || line[0] == '\n') {
+            continue;
+        } else if (std::sscanf(line, "start %31s", start) == 1) {
+            stream.start = start;
+        } else if (std::sscanf(line, "frames %zu", &frames) == 1) {
+            stream.steps.assign(frames, Step{ StepNone, 0, 0 });
+        } else if (std::sscanf(line, "%zu %31s %d %lf", &frame, kind, &step.count, &step.value) == 4) {
+            step.kind = 0;
+            while (step.kind < StepKindCount && std::strcmp(stepNames[step.kind], kind) != 0)
+                step.kind++;
+            ok = step.kind < StepKindCount && frame < stream.steps.size();
+            if (ok)
+                stream.steps[frame] = step;
+        } else {
+            ok = false;
+        }
+    }
+    std::fclose(file);
+    return ok && !stream.steps.empty();
+}
+
+bool readCorpus(const std::string &folder, std::vector<Stream> &corpus) {
+    DIR *directory = opendir(folder.c_str());
+    if (directory == nullptr)
+        return false;
+    std::vector<std::string> names;
+    while (const dirent *entry = readdir(directory)) {
+        const std::string name = entry->d_name;
+        if (name.size() > 7 && name.compare(name.size() - 7, 7, ".stream") == 0)
+            names.push_back(name);
+    }
+    closedir(directory);
+    std::sort(names.begin(), names.end());
+    for (const std::string &name: names) {
+        Stream stream = {};
+        stream.name = name;
+        if (!readStream(folder + "/" + name, stream)) {
+            std::fprintf(stderr, "worst: cannot read %s/%s\n", folder.c_str(), name.c_str());
+            return false;
+        }
+        corpus.push_back(stream);
+    }
+    return !corpus.empty();
+}
+
+double percentile(const std::vector<double> &sorted, double fraction) {
+    if (sorted.empty())
+        return 0;
+    return sorted[std::min(sorted.size() - 1, size_t(std::ceil(fraction * sorted.size())) - (fraction > 0))];
+}
+
+// Replays each stream, and returns the largest time of any frame, in microseconds. The worst frame of a
+// stream is by the least time of each frame over the replays, as in the search.
+double report(const std::string &library, const std::vector<Stream> &corpus) {
+    std::vector<double> all, misses;
+    double bytes = 0;
+    std::printf("\n%-24s %8s %10s %8s %8s %8s %10s\n", "stream", "frames", "worst us", "allocs", "bytes",
+                "misses", "max us");
+    for (const Stream &stream: corpus) {
+        Evaluation least = {};
+        double max = 0;
+        for (int replay = 0; replay < options.replays; replay++) {
+            const Evaluation evaluation = flyAlone(library, stream);
+            if (!evaluation.ok || evaluation.frames.size() != stream.steps.size()) {
+                least.ok = false;
+                break;
+            }
+            for (size_t i = options.warmUpFrames; i < evaluation.frames.size(); i++) {
+                all.push_back(evaluation.frames[i].nanoseconds / 1000.0);
+                max = std::max(max, all.back());
+                bytes += evaluation.frames[i].bytes;
+                if (evaluation.frames[i].cacheMisses >= 0)
+                    misses.push_back(evaluation.frames[i].cacheMisses);
+            }
+            if (replay == 0)
+                least = evaluation;
+            else
+                keepLeast(least, evaluation);
+        }
+        if (!least.ok || least.worstFrame < 0) {
+            std::printf("%-24s failed\n", stream.name.c_str());
+            continue;
+        }
+        const FrameCost &worst = least.frames[least.worstFrame];
+        const std::string worstMisses = worst.cacheMisses >= 0 ? std::to_string(worst.cacheMisses) : "-";
+        std::printf("%-24s %8zu %10.1f %8lld %8lld %8s %10.1f\n", stream.name.c_str(), stream.steps.size(),
+                    worst.nanoseconds / 1000.0, (long long)worst.allocations, (long long)worst.bytes,
+                    worstMisses.c_str(), max);
+    }
+    std::sort(all.begin(), all.end());
+    std::sort(misses.begin(), misses.end());
+    const double max = all.empty() ? 0 : all.back();
+    std::printf("\n%zu frames: median %.1f us, p99 %.1f us, p99.99 %.1f us, max %.1f us\n", all.size(),
+                percentile(all, 0.5), percentile(all, 0.99), percentile(all, 0.9999), max);
+    std::printf("per frame: %.0f bytes delivered and set", bytes / std::max<size_t>(1, all.size()));
+    if (misses.empty())
+        std::printf(", cache misses not counted here\n");
+    else
+        std::printf(", cache misses median %.0f, p99 %.0f, max %.0f\n", percentile(misses, 0.5),
+                    percentile(misses, 0.99), misses.back());
+    return max;
+}
+
+int search(const std::string &library) {
+    Random random(options.seed);
+    std::vector<Stream> corpus;
+    std::vector<Evaluation> evaluations;
+
+    // One of each, which mutations of it then compete with, so that the slowest kind does not crowd out the
+    // slow paths of the others
+    for (int kind = 1; kind < StepKindCount; kind++) {
+        const Stream stream = generate(kind, random);
+        const Evaluation evaluation = flyConfirmed(library, stream, 3);
+        if (!evaluation.ok) {
+            std::fprintf(stderr, "worst: flying the stream %s failed\n", stream.name.c_str());
+            return 2;
+        }
+        corpus.push_back(stream);
+        evaluations.push_back(evaluation);
+        std::printf("%-24s %10.1f at frame %d\n", stream.name.c_str(), evaluation.fitness,
+                    evaluation.worstFrame);
+    }
+
+    int accepted = 0;
+    for (int iteration = 0; iteration < options.iterations; iteration++) {
+        const int parent = random.upTo(int(corpus.size()) - 1);
+        Stream child = mutate(corpus[parent], corpus, random);
+        const Evaluation quick = flyAlone(library, child);
+        if (!quick.ok || quick.fitness <= evaluations[parent].fitness)
+            continue;
+        const Evaluation confirmed = flyConfirmed(library, child, 3);
+        if (!confirmed.ok || confirmed.fitness <= evaluations[parent].fitness)
+            continue;
+        child.name = std::string(stepNames[child.kind]) + "+" + std::to_string(iteration);
+        corpus[parent] = child;
+        evaluations[parent] = confirmed;
+        accepted++;
+        std::printf("%-24s %10.1f at frame %d, iteration %d\n", child.name.c_str(), confirmed.fitness,
+                    confirmed.worstFrame, iteration);
+    }
+    std::printf("%d of %d mutations accepted\n", accepted, options.iterations);
+
+    mkdir(options.outputFolder.c_str(), 0777);
+    std::vector<Stream> minimized;
+    for (size_t i = 0; i < corpus.size(); i++) {
+        Stream stream = minimize(library, corpus[i], evaluations[i]);
+        const Evaluation evaluation = flyConfirmed(library, stream, 3);
+        if (!evaluation.ok || evaluation.worstFrame < 0)
+            continue;
+        const std::string fileName = std::string(stepNames[stream.kind]) + ".stream";
+        if (!writeStream(options.outputFolder + "/" + fileName, stream, evaluation)) {
+            std::fprintf(stderr, "worst: cannot write %s/%s\n", options.outputFolder.c_str(),
+                         fileName.c_str());
+            return 2;
+        }
+        stream.name = fileName;
+        minimized.push_back(stream);
+    }
+    report(library, minimized);
+    return 0;
+}
+
+int usage() {
+    std::fprintf(stderr, "usage: worst [-i iterations] [-f frames] [-s seed] [-w allocation us]"
+                 " [-m minimize runs] [-r replays] [-o corpus folder] [-g scenario folder] flyingbrick.so\n"
+                 "       worst -c corpus folder [-r replays] [-x max us] [-g scenario folder]"
+                 " flyingbrick.so\n");
+    return 2;
+}
+
+} // namespace
+
+int main(int argc, char **argv) {
+    int opt;
+    while ((opt = getopt(argc, argv, "i:f:s:w:m:r:o:c:x:g:")) != -1) {
+        switch (opt) {
+        case 'i': options.iterations = std::atoi(optarg); break;
+        case 'f': options.frames = std::atoi(optarg); break;
+        case 's': options.seed = std::strtoull(optarg, nullptr, 10); break;
+        case 'w': options.allocationMicroSeconds = std::atof(optarg); break;
+        case 'm': options.minimizeRuns = std::atoi(optarg); break;
+        case 'r': options.replays = std::atoi(optarg); break;
+        case 'o': options.outputFolder = optarg; break;
+        case 'c': options.corpusFolder = optarg; break;
+        case 'x': options.maxMicroSeconds = std::atof(optarg); break;
+        case 'g': options.scenarioFolder = optarg; break;
+        default: return usage();
+        }
+    }
+    if (argc - optind != 1 || options.iterations < 0 || options.replays < 1
+        || options.frames <= options.warmUpFrames + 1)
+        return usage();
+
+    // The gauge is loaded after chdir() into the work folder
+    char *library = realpath(argv[optind], nullptr);
+    if (library == nullptr) {
+        std::fprintf(stderr, "worst: cannot find %s\n", argv[optind]);
+        return 2;
+    }
+
+    if (!options.scenarioFolder.empty()) {
+        const char *temporary = std::getenv("TMPDIR");
+        const std::string cache =
+            std::string(temporary != nullptr ? temporary : "/tmp") + "/flyingbrick-scenarios.bin";
+        std::string error;
+        if (!loadScenarios(options.scenarioFolder, cache, scenarios, error) || scenarios.empty()) {
+            std::fprintf(stderr, "worst: %s\n", error.empty() ? "no scenarios in the folder" : error.c_str());
+            std::free(library);
+            return 2;
+        }
+    }
+
+    int status;
+    if (options.corpusFolder.empty()) {
+        status = search(library);
+    } else {
+        std::vector<Stream> corpus;
+        if (!readCorpus(options.corpusFolder, corpus)) {
+            std::fprintf(stderr, "worst: no corpus in %s\n", options.corpusFolder.c_str());
+            std::free(library);
+            return 2;
+        }
+        for (const Stream &stream: corpus) {
+            if (!stream.start.empty() && findScenario(stream.start) == nullptr) {
+                std::fprintf(stderr, "worst: %s starts from the scenario %s, give its folder with -g\n",
+                             stream.name.c_str(), stream.start.c_str());
+                std::free(library);
+                return 2;
+            }
+        }
+        const double max = report(library, corpus);
+        status = options.maxMicroSeconds > 0 && max > options.maxMicroSeconds ? 1 : 0;
+    }
+    std::free(library);
+    return status;
+}